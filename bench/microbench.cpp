@@ -0,0 +1,789 @@
+/**
+ * @file microbench.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Microbenchmarks for the hot paths of the server: parsing of the
+ *        posts and of the commands, the Database operations and the
+ *        fan-out of a post to the subscribers of its topic.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+
+#include "../include/helpers.h"
+#include "../include/constants.h"
+#include "../include/database.h"
+#include "../include/command_parser.h"
+#include "../include/post.h"
+#include "../include/network.h"
+#include "../include/topic_kernels.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <sys/socket.h>
+
+using namespace std;
+
+/*
+    Allocations are counted by replacing the global operator new, so
+    that allocs/op covers the containers of the standard library too.
+    Every replacement goes through counted_malloc / counted_free, which
+    are never inlined: the compiler only sees operator new paired with
+    operator delete, never free() on the result of a new.
+*/
+static uint64_t allocations = 0;
+
+__attribute__((noinline)) static void* counted_malloc(size_t size) {
+    allocations ++;
+    void *memory = malloc(size == 0 ? 1 : size);
+    if(memory == NULL) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+__attribute__((noinline)) static void counted_free(void *memory) {
+    free(memory);
+}
+
+void* operator new(size_t size) {
+    return counted_malloc(size);
+}
+
+void* operator new[](size_t size) {
+    return counted_malloc(size);
+}
+
+void operator delete(void *memory) noexcept {
+    counted_free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    counted_free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    counted_free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    counted_free(memory);
+}
+
+/*
+    | TOPICS | SUBSCRIBERS | OFFLINE | ITERATIONS | BUDGET |
+    |________|_____________|_________|____________|________|
+
+    Parameters of the run.
+    <topics>        = topics of the database
+    <subscribers>   = subscribers of every topic (distinct clients)
+    <offline>       = fraction of the subscribers that are disconnected,
+    |                 with SF set (their posts are stored)
+    <iterations>    = maximum operations of a benchmark
+    <budget_ms>     = maximum time of a benchmark
+*/
+struct Bench_Config {
+    int topics = 100;
+    int subscribers = 100;
+    double offline = 0.25;
+    uint64_t iterations = 1000000;
+    uint64_t budget_ms = 300;
+};
+
+/*
+    Measurement of a benchmark: only the code between measure_start and
+    measure_stop is counted, the setup of each batch is left out.
+*/
+struct Measure {
+    uint64_t ops = 0;
+    uint64_t ns = 0;
+    uint64_t allocations = 0;
+    uint64_t start_ns;
+    uint64_t start_allocations;
+};
+
+static uint64_t clock_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void measure_start(struct Measure* measure) {
+    measure->start_allocations = allocations;
+    measure->start_ns = clock_ns();
+}
+
+static void measure_stop(struct Measure* measure, uint64_t ops) {
+    uint64_t end = clock_ns();
+    measure->ns += end - measure->start_ns;
+    measure->allocations += allocations - measure->start_allocations;
+    measure->ops += ops;
+}
+
+static bool measure_done(struct Measure* measure, struct Bench_Config* config) {
+    return measure->ops >= config->iterations ||
+           measure->ns >= config->budget_ms * 1000000ULL;
+}
+
+static void report(const char *name, struct Measure* measure) {
+    double ops = measure->ops == 0 ? 1 : measure->ops;
+    cerr << left << setw(34) << name << right
+         << setw(12) << fixed << setprecision(1) << measure->ns / ops
+         << setw(14) << setprecision(2) << measure->allocations / ops
+         << setw(12) << measure->ops << endl;
+}
+
+/* Socket of the fake clients: well above the descriptors in use */
+#define BENCH_FIRST_SOCKET 100000
+#define BENCH_BATCH 64
+#define BENCH_HOT_TOPICS 4
+#define BENCH_ORDER_LEN 4096
+
+/*
+    Benchmark database: client (t, s) is subscribed to topic t with SF
+    set and is connected at socket BENCH_FIRST_SOCKET + t * subscribers + s,
+    except for the first <offline> fraction of the subscribers of every
+    topic. The connected clients receive their posts on /dev/null, so a
+    delivery costs the Database work plus one failing send().
+*/
+static void build_database(struct Database* database, struct Bench_Config* config,
+                           int sink) {
+    int offline = (int) (config->subscribers * config->offline);
+    for(int t = 0; t < config->topics; t++) {
+        string topic = "topic_" + to_string(t);
+        for(int s = 0; s < config->subscribers; s++) {
+            string ID = "c" + to_string(t) + "_" + to_string(s);
+            int socket = BENCH_FIRST_SOCKET + t * config->subscribers + s;
+
+            struct Subscriber &user = (*database).online[ID];
+            strcpy(user.ID, ID.c_str());
+            user.online = s >= offline;
+            user.socket_fd = user.online ? sink : -1;
+            subscribe_topic(database, &user, topic, true);
+
+            struct Subscriber location;
+            strcpy(location.ID, user.ID);
+            location.socket_fd = user.socket_fd;
+            location.online = user.online;
+            (*database).locations[socket] = location;
+
+            struct Login_Key key;
+            make_login_key(user.ID, &key);
+            set_session(&(*database).sessions, &key, user.socket_fd,
+                        user.online ? SESSION_ONLINE : SESSION_OFFLINE);
+        }
+    }
+}
+
+static void fill_post(struct Subscription_Post* post, const char *topic, int type) {
+    memset(post, 0, sizeof(struct Subscription_Post));
+    strcpy(post->topic, topic);
+    post->data_type = type;
+    switch(type) {
+        case 0: {
+            uint32_t value = htonl(123456);
+            post->content[0] = 1;
+            memcpy(post->content + 1, &value, sizeof(uint32_t));
+            break;
+        }
+        case 1: {
+            uint16_t value = htons(4242);
+            memcpy(post->content, &value, sizeof(uint16_t));
+            break;
+        }
+        case 2: {
+            uint32_t value = htonl(314159);
+            post->content[0] = 0;
+            memcpy(post->content + 1, &value, sizeof(uint32_t));
+            post->content[5] = 5;
+            break;
+        }
+        default:
+            strcpy(post->content, "The quick brown fox jumps over the lazy dog");
+    }
+}
+
+static void bench_receive_post(struct Bench_Config* config, int type, const char *name) {
+    struct Subscription_Post post;
+    fill_post(&post, "topic_0", type);
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(source));
+    source.sin_port = htons(4573);
+    char IP[16] = "127.0.0.1";
+
+    struct Send_Post transform;
+    struct Measure measure;
+    while(!measure_done(&measure, config)) {
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            receive_post(&post, &transform, IP, source);
+        }
+        measure_stop(&measure, BENCH_BATCH);
+    }
+    report(name, &measure);
+}
+
+/*
+    Former form of the posts in the SF queues (the text of the post and
+    its metadata), and of the retained posts (sequence and text), for
+    the comparison of the stored bytes
+*/
+struct Text_Post {
+    int operation;
+    char content[BUFLEN];
+    uint64_t ingress_ns;
+    uint64_t sequence;
+    char topic[TOPIC_LEN + 1];
+    time_t queued_at;
+};
+
+struct Text_Retained_Post {
+    uint64_t sequence;
+    string content;
+};
+
+/**
+ * @brief Changes the number of a post by a small step, as a sensor or a
+ * counter does.
+ */
+static void step_post(struct Subscription_Post* post) {
+    int step = rand() % 21 - 10;
+    uint32_t number;
+    uint16_t short_number;
+    switch(post->data_type) {
+        case 0:
+        case 2:
+            memcpy(&number, post->content + 1, sizeof(uint32_t));
+            number = htonl(ntohl(number) + step);
+            memcpy(post->content + 1, &number, sizeof(uint32_t));
+            break;
+        case 1:
+            memcpy(&short_number, post->content, sizeof(uint16_t));
+            short_number = htons(ntohs(short_number) + step);
+            memcpy(post->content, &short_number, sizeof(uint16_t));
+            break;
+    }
+}
+
+/**
+ * @brief Bytes per post of RETENTION_LEN posts of one topic and source,
+ * in an SF queue and in the log of the topic, before and after the
+ * compact forms. The texts made from the log are checked against the
+ * texts of the live posts.
+ */
+static void bench_stored_bytes(int type, const char *name) {
+    struct Subscription_Post post;
+    fill_post(&post, "topic_0", type);
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(source));
+    source.sin_family = AF_INET;
+    source.sin_port = htons(4573);
+    inet_aton("127.0.0.1", &source.sin_addr);
+    string topic("topic_0");
+
+    srand(42);
+    deque<struct Stored_Post> queue;
+    struct Post_Log log;
+    vector<string> texts;
+    uint64_t queue_bytes = 0, text_bytes = 0;
+    struct Send_Post transform;
+    for(uint64_t sequence = 1; sequence <= RETENTION_LEN; sequence++) {
+        step_post(&post);
+        format_post(&post, source, &transform);
+        texts.push_back(transform.content);
+        text_bytes += sizeof(struct Text_Retained_Post);
+        if(texts.back().size() > 15) {
+            text_bytes += texts.back().size() + 1;
+        }
+
+        queue.emplace_back();
+        store_post(&queue.back(), &topic, &post, source, sequence, 0, 0);
+        queue_bytes += stored_post_bytes(&queue.back());
+        log_post(&log, sequence, &post, source);
+    }
+
+    struct Log_Cursor cursor;
+    uint64_t sequence;
+    seek_log(&log, topic, 1, &cursor);
+    for(uint64_t i = 0; i < RETENTION_LEN; i++) {
+        DIE(next_logged(&cursor, &sequence) == false || sequence != i + 1, "log");
+        format_post(&cursor.post, cursor.source, &transform);
+        DIE(texts[i] != transform.content, "log text");
+    }
+    format_stored_post(&queue.back(), &transform);
+    DIE(texts.back() != transform.content, "queue text");
+
+    double old_queue = sizeof(struct Text_Post);
+    double new_queue = (double) queue_bytes / RETENTION_LEN;
+    double old_log = (double) text_bytes / RETENTION_LEN;
+    double new_log = (double) log_bytes(&log) / RETENTION_LEN;
+    cerr << left << setw(34) << name << right << fixed << setprecision(1)
+         << setw(9) << old_queue << " -> " << setw(6) << new_queue
+         << " (" << setw(5) << old_queue / new_queue << "x)"
+         << setw(9) << old_log << " -> " << setw(6) << new_log
+         << " (" << setw(5) << old_log / new_log << "x)" << endl;
+}
+
+static void bench_command_parser(struct Bench_Config* config) {
+    char buffer[BUFLEN];
+    char result[TOPIC_LEN];
+    strcpy(buffer, "subscribe topic_of_a_typical_length 1\n");
+
+    struct Measure measure;
+    while(!measure_done(&measure, config)) {
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            check_command_format(buffer, 3);
+        }
+        measure_stop(&measure, BENCH_BATCH);
+    }
+    report("check_command_format", &measure);
+
+    measure = Measure();
+    while(!measure_done(&measure, config)) {
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            obtain_nth_argument(buffer, 1, result);
+        }
+        measure_stop(&measure, BENCH_BATCH);
+    }
+    report("obtain_nth_argument", &measure);
+}
+
+/*
+    add_new_client reads the ID frame from the socket, so every batch of
+    frames is written in one end of a socket pair (not measured) and the
+    server side reads them from the other one.
+*/
+static void write_ID_frames(int socket, vector<string> &IDs) {
+    string frames;
+    for(auto &ID : IDs) {
+        struct Send_Header header;
+        header.size = ID.size() + 1;
+        header.operation = ID_CODE;
+        header.sequence = 0;
+        frames.append((const char *) &header, sizeof(struct Send_Header));
+        frames.append(ID.c_str(), ID.size() + 1);
+    }
+    send_all(socket, frames.data(), frames.size());
+}
+
+static void bench_add_new_client(struct Bench_Config* config, int sink) {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+
+    /* (1) New IDs */
+    {
+        int pair[2];
+        DIE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0, "socketpair");
+        struct Database database;
+        build_database(&database, config, sink);
+
+        struct Measure measure;
+        uint64_t next = 0;
+        while(!measure_done(&measure, config)) {
+            vector<string> IDs;
+            for(int i = 0; i < BENCH_BATCH; i++) {
+                IDs.push_back("new_" + to_string(next++));
+            }
+            write_ID_frames(pair[1], IDs);
+
+            measure_start(&measure);
+            for(int i = 0; i < BENCH_BATCH; i++) {
+                add_new_client(pair[0], address, &database);
+            }
+            measure_stop(&measure, BENCH_BATCH);
+        }
+        report("add_new_client (new ID)", &measure);
+        close(pair[0]);
+        close(pair[1]);
+    }
+
+    /* (2) Clients logging in again (offline clients of the database) */
+    int offline = (int) (config->subscribers * config->offline);
+    if(offline == 0) {
+        return;
+    }
+
+    int pair[2];
+    DIE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0, "socketpair");
+    struct Database database;
+    build_database(&database, config, sink);
+
+    vector<string> pool;
+    for(int t = 0; t < config->topics; t++) {
+        for(int s = 0; s < offline; s++) {
+            pool.push_back("c" + to_string(t) + "_" + to_string(s));
+        }
+    }
+
+    struct Measure measure;
+    size_t next = 0;
+    while(!measure_done(&measure, config)) {
+        vector<string> IDs;
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            IDs.push_back(pool[next++ % pool.size()]);
+        }
+        write_ID_frames(pair[1], IDs);
+
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            add_new_client(pair[0], address, &database);
+        }
+        measure_stop(&measure, BENCH_BATCH);
+
+        for(auto &ID : IDs) {
+            struct Login_Key key;
+            make_login_key(ID.c_str(), &key);
+            set_session(&database.sessions, &key, -1, SESSION_OFFLINE);
+            database.online[ID].online = false;
+        }
+    }
+    report("add_new_client (reconnect)", &measure);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+static void bench_ID_already_in_database(struct Bench_Config* config, int sink) {
+    struct Database database;
+    build_database(&database, config, sink);
+
+    /* A free ID: every lookup is a miss */
+    char ID[BUFLEN] = "free_ID";
+    struct Measure measure;
+    while(!measure_done(&measure, config)) {
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            ID_already_in_database(ID, &database);
+        }
+        measure_stop(&measure, BENCH_BATCH);
+    }
+    report("ID_already_in_database (miss)", &measure);
+}
+
+static void bench_subscriptions(struct Bench_Config* config, int sink) {
+    struct Database database;
+    build_database(&database, config, sink);
+
+    /* Client of the benchmark: subscribes to the existing topics in turn */
+    int socket = BENCH_FIRST_SOCKET - 1;
+    struct Subscriber &user = database.online["bench"];
+    strcpy(user.ID, "bench");
+    user.online = true;
+    user.socket_fd = sink;
+    struct Subscriber location;
+    strcpy(location.ID, user.ID);
+    location.socket_fd = sink;
+    location.online = true;
+    database.locations[socket] = location;
+
+    vector<string> subscribe, unsubscribe;
+    for(int t = 0; t < BENCH_BATCH; t++) {
+        string topic = "topic_" + to_string(t % config->topics);
+        subscribe.push_back("subscribe " + topic + " 1\n");
+        unsubscribe.push_back("unsubscribe " + topic + "\n");
+    }
+
+    struct Measure add, remove;
+    char buffer[BUFLEN];
+    while(!measure_done(&add, config)) {
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            strcpy(buffer, subscribe[i].c_str());
+            measure_start(&add);
+            add_subscription(&database, socket, buffer);
+            measure_stop(&add, 1);
+        }
+        for(int i = BENCH_BATCH - 1; i >= 0; i--) {
+            strcpy(buffer, unsubscribe[i].c_str());
+            measure_start(&remove);
+            remove_subscription(&database, socket, buffer);
+            measure_stop(&remove, 1);
+        }
+    }
+    report("add_subscription", &add);
+    report("remove_subscription", &remove);
+}
+
+static void bench_fan_out(struct Bench_Config* config, int sink) {
+    struct Database database;
+    build_database(&database, config, sink);
+
+    vector<struct Subscription_Post> posts(config->topics);
+    for(int t = 0; t < config->topics; t++) {
+        fill_post(&posts[t], ("topic_" + to_string(t)).c_str(), 0);
+    }
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(source));
+
+    struct Measure measure;
+    uint64_t deliveries = 0;
+    int next = 0;
+    while(!measure_done(&measure, config)) {
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            publish_post(&database, &posts[next], source, 0);
+            next = (next + 1) % config->topics;
+        }
+        measure_stop(&measure, BENCH_BATCH);
+        deliveries += BENCH_BATCH * config->subscribers;
+
+        /* Empty the SF queues, so that they do not grow with the run */
+        for(auto &user : database.online) {
+            if(!user.second.SF_queue.empty()) {
+                user.second.SF_queue.clear();
+            }
+        }
+    }
+    report("publish_post (per post)", &measure);
+
+    struct Measure per_delivery = measure;
+    per_delivery.ops = deliveries;
+    report("publish_post (per subscriber)", &per_delivery);
+}
+
+/**
+ * @brief Fan-out of bursts of INGEST_BATCH_LEN posts for BENCH_HOT_TOPICS
+ * topics, post by post and as ingest batches grouped by topic.
+ */
+static void bench_batch_fan_out(struct Bench_Config* config, int sink) {
+    struct Database database;
+    build_database(&database, config, sink);
+
+    struct Ingest_Batch *batch = new struct Ingest_Batch;
+    int hot = min(config->topics, BENCH_HOT_TOPICS);
+    batch->count = INGEST_BATCH_LEN;
+    for(int i = 0; i < INGEST_BATCH_LEN; i++) {
+        struct Ingest_Post &ingested = batch->posts[i];
+        fill_post(&ingested.post, ("topic_" + to_string(i % hot)).c_str(), 0);
+        memset(&ingested.source, 0, sizeof(struct sockaddr_in));
+        ingested.ingress_ns = 0;
+        ingested.length = sizeof(struct Subscription_Post);
+    }
+
+    for(int batched = 0; batched < 2; batched++) {
+        struct Measure measure;
+        while(!measure_done(&measure, config)) {
+            measure_start(&measure);
+            if(batched) {
+                publish_batch(&database, batch);
+            } else {
+                for(int i = 0; i < INGEST_BATCH_LEN; i++) {
+                    publish_post(&database, &batch->posts[i].post, batch->posts[i].source, 0);
+                }
+            }
+            measure_stop(&measure, INGEST_BATCH_LEN);
+
+            for(auto &user : database.online) {
+                if(!user.second.SF_queue.empty()) {
+                    user.second.SF_queue.clear();
+                }
+            }
+        }
+        report(batched ? "publish_batch (burst, per post)" : "publish_post (burst, per post)",
+               &measure);
+    }
+    delete batch;
+}
+
+/**
+ * @brief Topic of the benchmarks, of a typical length.
+ */
+static string bench_topic(int t) {
+    return "building_" + to_string(t % 97) + "/floor_" + to_string(t / 97) + "/temperature";
+}
+
+/**
+ * @brief Lookups of the topics of <order> in the topic index (with the
+ * kernels in use) and in a map hashed with std::hash, from the fixed
+ * width topics of the posts.
+ */
+static void bench_topic_lookup(struct Bench_Config* config, vector<struct Subscription_Post> &posts,
+                               vector<int> &order, const char *name) {
+    Topic_Index index;
+    unordered_map<string, int> plain;
+    for(size_t t = 0; t < posts.size(); t++) {
+        index[posts[t].topic];
+        plain[posts[t].topic] = t;
+    }
+
+    struct Measure measure;
+    size_t next = 0, found = 0;
+    while(!measure_done(&measure, config)) {
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            struct Topic_Key key;
+            make_topic_key(posts[order[next]].topic, &key);
+            found += index.find(key) != index.end();
+            next = (next + 1) % order.size();
+        }
+        measure_stop(&measure, BENCH_BATCH);
+    }
+    report((string(name) + " " + kernels.name).c_str(), &measure);
+
+    measure = Measure();
+    while(!measure_done(&measure, config)) {
+        measure_start(&measure);
+        for(int i = 0; i < BENCH_BATCH; i++) {
+            found += plain.find(posts[order[next]].topic) != plain.end();
+            next = (next + 1) % order.size();
+        }
+        measure_stop(&measure, BENCH_BATCH);
+    }
+    report((string(name) + " std::hash").c_str(), &measure);
+    DIE(found == 0, "lookup");
+}
+
+/**
+ * @brief The topic kernels at every level the CPU has: end of a fixed
+ * width topic, hash and compare of a padded topic, and the lookups of
+ * the topics of the posts, uniform over all the topics or skewed (90%
+ * on BENCH_HOT_TOPICS topics).
+ */
+static void bench_topic_kernels(struct Bench_Config* config) {
+    vector<struct Subscription_Post> posts(config->topics);
+    for(int t = 0; t < config->topics; t++) {
+        fill_post(&posts[t], bench_topic(t).c_str(), 0);
+    }
+
+    srand(7);
+    vector<int> uniform(BENCH_ORDER_LEN), skewed(BENCH_ORDER_LEN);
+    int hot = min(config->topics, BENCH_HOT_TOPICS);
+    for(int i = 0; i < BENCH_ORDER_LEN; i++) {
+        uniform[i] = rand() % config->topics;
+        skewed[i] = (rand() % 10 != 0) ? rand() % hot : rand() % config->topics;
+    }
+
+    vector<struct Topic_Key> keys(config->topics);
+    for(int t = 0; t < config->topics; t++) {
+        make_topic_key(posts[t].topic, &keys[t]);
+    }
+    struct Topic_Key first, second = keys[0];
+
+    int best = best_kernel_level();
+    for(int level = KERNELS_SCALAR; level <= best; level++) {
+        select_kernels(level);
+        for(int t = 0; t < config->topics; t++) {
+            make_topic_key(posts[t].topic, &first);
+            DIE(first.hash != keys[t].hash || first.length != keys[t].length ||
+                memcmp(first.topic, keys[t].topic, TOPIC_BLOCK_LEN) != 0,
+                "the keys differ between the kernels");
+        }
+
+        struct Measure measure;
+        uint64_t total = 0;
+        int next = 0;
+        while(!measure_done(&measure, config)) {
+            measure_start(&measure);
+            for(int i = 0; i < BENCH_BATCH; i++) {
+                total += kernels.length(posts[next].topic, TOPIC_LEN);
+                next = (next + 1) % config->topics;
+            }
+            measure_stop(&measure, BENCH_BATCH);
+        }
+        report((string("topic length ") + kernels.name).c_str(), &measure);
+
+        measure = Measure();
+        while(!measure_done(&measure, config)) {
+            measure_start(&measure);
+            for(int i = 0; i < BENCH_BATCH; i++) {
+                total += kernels.hash(keys[next].topic, TOPIC_BLOCK_LEN);
+                next = (next + 1) % config->topics;
+            }
+            measure_stop(&measure, BENCH_BATCH);
+        }
+        report((string("topic hash ") + kernels.name).c_str(), &measure);
+
+        measure = Measure();
+        while(!measure_done(&measure, config)) {
+            measure_start(&measure);
+            for(int i = 0; i < BENCH_BATCH; i++) {
+                make_topic_key(posts[next].topic, &first);
+                total += first.hash;
+                next = (next + 1) % config->topics;
+            }
+            measure_stop(&measure, BENCH_BATCH);
+        }
+        report((string("topic key ") + kernels.name).c_str(), &measure);
+
+        measure = Measure();
+        while(!measure_done(&measure, config)) {
+            measure_start(&measure);
+            for(int i = 0; i < BENCH_BATCH; i++) {
+                total += kernels.equal(keys[next].topic, second.topic, TOPIC_BLOCK_LEN);
+                next = (next + 1) % config->topics;
+            }
+            measure_stop(&measure, BENCH_BATCH);
+        }
+        report((string("topic compare ") + kernels.name).c_str(), &measure);
+        DIE(total == 0, "kernels");
+
+        bench_topic_lookup(config, posts, uniform, "lookup (uniform)");
+        bench_topic_lookup(config, posts, skewed, "lookup (skewed)");
+    }
+    select_kernels(best);
+}
+
+static void usage(char *file) {
+    fprintf(stderr, "Usage: %s [-t topics] [-s subscribers_per_topic] "
+                    "[-o offline_fraction] [-n iterations] [-m budget_ms]\n", file);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    struct Bench_Config config;
+    int option;
+    while((option = getopt(argc, argv, "t:s:o:n:m:")) != -1) {
+        switch(option) {
+            case 't': config.topics = atoi(optarg); break;
+            case 's': config.subscribers = atoi(optarg); break;
+            case 'o': config.offline = atof(optarg); break;
+            case 'n': config.iterations = strtoull(optarg, NULL, 10); break;
+            case 'm': config.budget_ms = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]);
+        }
+    }
+    if(config.topics <= 0 || config.subscribers <= 0 || config.offline < 0 ||
+       config.offline > 1 || config.iterations == 0) {
+        usage(argv[0]);
+    }
+
+    /* The messages of the server are printed on cout */
+    streambuf *console = cout.rdbuf();
+    ofstream null_stream("/dev/null");
+    cout.rdbuf(null_stream.rdbuf());
+
+    int sink = open("/dev/null", O_WRONLY);
+    DIE(sink < 0, "open");
+
+    cerr << "topics " << config.topics << ", subscribers/topic " << config.subscribers
+         << ", offline " << config.offline << endl;
+    cerr << left << setw(34) << "benchmark" << right << setw(12) << "ns/op"
+         << setw(14) << "allocs/op" << setw(12) << "ops" << endl;
+
+    bench_receive_post(&config, 0, "receive_post (INT)");
+    bench_receive_post(&config, 1, "receive_post (SHORT_REAL)");
+    bench_receive_post(&config, 2, "receive_post (FLOAT)");
+    bench_receive_post(&config, 3, "receive_post (STRING)");
+    bench_command_parser(&config);
+    bench_topic_kernels(&config);
+    bench_add_new_client(&config, sink);
+    bench_ID_already_in_database(&config, sink);
+    bench_subscriptions(&config, sink);
+    bench_fan_out(&config, sink);
+    bench_batch_fan_out(&config, sink);
+
+    cerr << endl << left << setw(34) << "stored bytes/post" << right
+         << setw(32) << "SF queue" << setw(32) << "retained log" << endl;
+    bench_stored_bytes(0, "stored post (INT)");
+    bench_stored_bytes(1, "stored post (SHORT_REAL)");
+    bench_stored_bytes(2, "stored post (FLOAT)");
+    bench_stored_bytes(3, "stored post (STRING)");
+
+    cout.rdbuf(console);
+    close(sink);
+    return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ * @file replay.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Replay of a capture of the UDP ingest (server -C) against a
+ *        server: the datagrams are sent again at their original times,
+ *        or N times faster, each source from its own socket.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+
+#include "../include/helpers.h"
+#include "../include/constants.h"
+#include "../include/capture.h"
+#include <errno.h>
+#include <iomanip>
+#include <time.h>
+
+using namespace std;
+
+/*
+    ./bench/replay [-x speed] [-l loops] <capture_file> <IP_SERVER> <PORT_SERVER>
+
+    <speed> = the capture is replayed <speed> times faster (1 - original
+    |         timing, 0 - as fast as possible)
+    <loops> = number of times the capture is replayed
+*/
+struct Replay_Config {
+    double speed = 1;
+    int loops = 1;
+    const char *path = NULL;
+    struct sockaddr_in server;
+};
+
+/*
+    A sleep only wakes up within tens of microseconds: the replay sleeps
+    until REPLAY_SPIN_NS before the send time and spins the rest.
+*/
+#define REPLAY_SPIN_NS          100000ULL
+#define REPLAY_MAX_SOURCES      1024
+#define REPLAY_LATE_NS          1000000ULL
+
+/*
+    Result of a replay
+
+    <sources>   = captured source -> socket sending its datagrams, so the
+    |             server sees as many sources (admission, analytics) as
+    |             in the capture; after REPLAY_MAX_SOURCES the sockets
+    |             are shared
+    <lag_total>, <lag_max>, <late> = delay of the sends after their
+    |             scheduled time, sends later than REPLAY_LATE_NS
+*/
+struct Replay {
+    unordered_map<uint64_t, int> sources;
+    vector<int> sockets;
+    uint64_t sent = 0;
+    uint64_t bytes = 0;
+    uint64_t lag_total = 0;
+    uint64_t lag_max = 0;
+    uint64_t late = 0;
+};
+
+static uint64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief Waits until <deadline> (CLOCK_MONOTONIC).
+ */
+static void wait_until(uint64_t deadline) {
+    uint64_t now = monotonic_ns();
+    if(deadline > now + REPLAY_SPIN_NS) {
+        struct timespec wakeup;
+        wakeup.tv_sec  = (deadline - REPLAY_SPIN_NS) / 1000000000ULL;
+        wakeup.tv_nsec = (deadline - REPLAY_SPIN_NS) % 1000000000ULL;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR);
+    }
+    while(monotonic_ns() < deadline);
+}
+
+/**
+ * @brief Socket of a captured source, opened at its first datagram.
+ */
+static int source_socket(struct Replay* replay, struct sockaddr_in *source) {
+    uint64_t key = ((uint64_t) source->sin_addr.s_addr << 16) | source->sin_port;
+    auto known = replay->sources.find(key);
+    if(known != replay->sources.end()) {
+        return known->second;
+    }
+
+    int socket_fd;
+    if(replay->sockets.size() < REPLAY_MAX_SOURCES) {
+        socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        DIE(socket_fd < 0, "Error in opening the UDP socket.");
+        replay->sockets.push_back(socket_fd);
+    } else {
+        socket_fd = replay->sockets[replay->sources.size() % REPLAY_MAX_SOURCES];
+    }
+    replay->sources[key] = socket_fd;
+    return socket_fd;
+}
+
+/**
+ * @brief Sends the datagrams of the capture once.
+ *
+ * @return false - not a capture file
+ */
+static bool replay_capture(struct Replay_Config* config, struct Replay* replay) {
+    FILE *file = open_capture_file(config->path);
+    if(file == NULL) {
+        return false;
+    }
+
+    struct Capture_Record record;
+    record.time_ns = 0;
+    uint64_t first_ns = 0, start = 0;
+    while(read_capture_record(file, &record)) {
+        if(start == 0) {
+            first_ns = record.time_ns;
+            start = monotonic_ns();
+        }
+
+        uint64_t scheduled = start;
+        if(config->speed > 0) {
+            scheduled += (uint64_t) ((record.time_ns - first_ns) / config->speed);
+            wait_until(scheduled);
+        }
+
+        int socket_fd = source_socket(replay, &record.source);
+        int return_value = sendto(socket_fd, record.datagram, record.length, 0,
+                                  (struct sockaddr *) &config->server, sizeof(struct sockaddr_in));
+        DIE(return_value < 0 && errno != ENOBUFS, "Error in sending the datagram.");
+
+        uint64_t lag = monotonic_ns() - scheduled;
+        replay->sent ++;
+        replay->bytes += record.length;
+        if(config->speed > 0) {
+            replay->lag_total += lag;
+            replay->lag_max = max(replay->lag_max, lag);
+            replay->late += lag > REPLAY_LATE_NS;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static void usage(char *file) {
+    fprintf(stderr, "Usage: %s [-x speed] [-l loops] capture_file "
+                    "server_address server_port\n", file);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    struct Replay_Config config;
+    int option;
+    while((option = getopt(argc, argv, "x:l:")) != -1) {
+        switch(option) {
+            case 'x': config.speed = atof(optarg); break;
+            case 'l': config.loops = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if(argc - optind != 3 || config.speed < 0 || config.loops <= 0) {
+        usage(argv[0]);
+    }
+    config.path = argv[optind];
+
+    memset(&config.server, 0, sizeof(struct sockaddr_in));
+    config.server.sin_family = AF_INET;
+    config.server.sin_port = htons(atoi(argv[optind + 2]));
+    if(inet_aton(argv[optind + 1], &config.server.sin_addr) == 0) {
+        usage(argv[0]);
+    }
+
+    struct Replay replay;
+    uint64_t start = monotonic_ns();
+    for(int loop = 0; loop < config.loops; loop++) {
+        if(replay_capture(&config, &replay) == false) {
+            fprintf(stderr, "%s is not a capture file.\n", config.path);
+            return 1;
+        }
+    }
+    double seconds = (monotonic_ns() - start) / 1e9;
+
+    cerr << "sent " << replay.sent << " datagrams (" << replay.bytes << " bytes) from "
+         << replay.sources.size() << " sources in " << fixed << setprecision(3)
+         << seconds << " s, " << setprecision(0) << replay.sent / max(seconds, 1e-9)
+         << " datagrams/s" << endl;
+    if(config.speed > 0 && replay.sent != 0) {
+        cerr << "lag after the scheduled times: avg " << setprecision(1)
+             << replay.lag_total / replay.sent / 1000.0 << " us, max "
+             << replay.lag_max / 1000.0 << " us, " << replay.late << " sends later than "
+             << REPLAY_LATE_NS / 1000000 << " ms" << endl;
+    }
+
+    for(int socket_fd : replay.sockets) {
+        close(socket_fd);
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+/**
+ * @file admission.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Cheap checks done on every UDP datagram before it is formatted
+ * and looked up: validation of the post and a token bucket per source.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/admission.h"
+#include <time.h>
+#include <algorithm>
+
+using namespace std;
+
+#define TOKEN_UNIT      1000000000ULL
+
+void init_admission(struct Admission* admission, uint64_t rate, uint64_t burst) {
+    admission->buckets.assign(ADMISSION_TABLE_LEN, Source_Bucket());
+    admission->used         = 0;
+    admission->rate         = rate;
+    admission->burst        = max(burst, (uint64_t) 1);
+    admission->malformed    = 0;
+    admission->dropped      = 0;
+    admission->next_aging   = 0;
+    memset(&admission->overflow, 0, sizeof(struct Source_Bucket));
+    admission->overflow.tokens = admission->burst * TOKEN_UNIT;
+}
+
+/**
+ * @brief Minimum payload of every data type:
+ * INT - sign + uint32, SHORT_REAL - uint16, FLOAT - sign + uint32 + uint8,
+ * STRING - at least the terminator or one character. A STRING is ended by
+ * its NUL or by the end of the datagram (the rest of <post> is zeroed);
+ * one without a NUL in CONTENT_LEN bytes gets one in its last byte, so
+ * its text is never read past <content>.
+ * 
+ * @param post received datagram
+ * @param length received bytes
+ * @return true - the post can be decoded
+ * @return false - malformed post
+ */
+bool valid_datagram(struct Subscription_Post* post, int length) {
+    static const int payload_length[] = {5, 2, 6, 1};
+
+    int header_length = TOPIC_LEN + 1;
+    if(length < header_length || memchr(post->topic, '\0', TOPIC_LEN) == NULL ||
+       post->topic[0] == '\0') {
+        return false;
+    }
+
+    unsigned char data_type = post->data_type;
+    if(data_type > 3 || length - header_length < payload_length[data_type]) {
+        return false;
+    }
+    if((data_type == 0 || data_type == 2) && (unsigned char) post->content[0] > 1) {
+        return false;
+    }
+    if(data_type == 3) {
+        post->content[CONTENT_LEN - 1] = '\0';
+    }
+    return true;
+}
+
+static uint64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static size_t source_slot(uint64_t key, size_t mask) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key & mask;
+}
+
+/**
+ * @brief Inserts the bucket in a table having free slots.
+ */
+static void place_bucket(vector<struct Source_Bucket> &buckets, const struct Source_Bucket &bucket) {
+    size_t mask = buckets.size() - 1;
+    size_t slot = source_slot(bucket.key, mask);
+    while(buckets[slot].key != 0) {
+        slot = (slot + 1) & mask;
+    }
+    buckets[slot] = bucket;
+}
+
+/**
+ * @brief Rebuilds the table without the sources idle since ADMISSION_IDLE_NS,
+ * doubling it if they are still too many. Rebuilding (instead of deleting
+ * in place) keeps the probe sequences without tombstones.
+ * 
+ * @param admission admission control
+ * @param now current time
+ */
+static void age_sources(struct Admission* admission, uint64_t now) {
+    vector<struct Source_Bucket> old_buckets;
+    old_buckets.swap(admission->buckets);
+
+    size_t alive = 0;
+    for(auto &bucket : old_buckets) {
+        if(bucket.key != 0 && now - bucket.last_seen < ADMISSION_IDLE_NS) {
+            alive ++;
+        }
+    }
+
+    size_t capacity = old_buckets.size();
+    while(alive >= capacity / 2 && capacity < ADMISSION_MAX_SOURCES) {
+        capacity *= 2;
+    }
+
+    admission->buckets.assign(capacity, Source_Bucket());
+    admission->used = 0;
+    for(auto &bucket : old_buckets) {
+        if(bucket.key != 0 && now - bucket.last_seen < ADMISSION_IDLE_NS) {
+            place_bucket(admission->buckets, bucket);
+            admission->used ++;
+        }
+    }
+}
+
+/**
+ * @brief Finds the bucket of the source, adding a full bucket for a new
+ * source. When the table is full of active sources the shared overflow
+ * bucket is used, without aging the table again before <next_aging>.
+ */
+static struct Source_Bucket* find_bucket(struct Admission* admission, uint64_t key, uint64_t now) {
+    size_t mask = admission->buckets.size() - 1;
+    size_t slot = source_slot(key, mask);
+    while(admission->buckets[slot].key != 0) {
+        if(admission->buckets[slot].key == key) {
+            return &admission->buckets[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if(4 * (admission->used + 1) > 3 * admission->buckets.size()) {
+        if(now < admission->next_aging) {
+            return &admission->overflow;
+        }
+        age_sources(admission, now);
+        if(4 * (admission->used + 1) > 3 * admission->buckets.size()) {
+            admission->next_aging = now + ADMISSION_AGING_NS;
+            return &admission->overflow;
+        }
+        return find_bucket(admission, key, now);
+    }
+
+    struct Source_Bucket &bucket = admission->buckets[slot];
+    memset(&bucket, 0, sizeof(struct Source_Bucket));
+    bucket.key          = key;
+    bucket.tokens       = admission->burst * TOKEN_UNIT;
+    bucket.last_refill  = now;
+    admission->used ++;
+    return &bucket;
+}
+
+/**
+ * @brief Refills the bucket of the source for the time since its last
+ * datagram and takes one token.
+ * 
+ * @param admission admission control
+ * @param source sender of the datagram
+ * @return true - accepted
+ * @return false - dropped
+ */
+bool admit_datagram(struct Admission* admission, const struct sockaddr_in* source) {
+    if(admission->rate == 0) {
+        return true;
+    }
+
+    uint64_t now = monotonic_ns();
+    uint64_t key = ((uint64_t) ntohl(source->sin_addr.s_addr) << 16 | ntohs(source->sin_port)) + 1;
+    struct Source_Bucket* bucket = find_bucket(admission, key, now);
+
+    uint64_t limit = admission->burst * TOKEN_UNIT;
+    uint64_t elapsed = min(now - bucket->last_refill, limit / admission->rate + 1);
+    bucket->tokens = min(limit, bucket->tokens + elapsed * admission->rate);
+    bucket->last_refill = now;
+    bucket->last_seen   = now;
+
+    if(bucket->tokens < TOKEN_UNIT) {
+        bucket->dropped ++;
+        admission->dropped ++;
+        return false;
+    }
+    bucket->tokens -= TOKEN_UNIT;
+    bucket->accepted ++;
+    return true;
+}
+
+void print_admission_stats(struct Admission* admission) {
+    cout << "Malformed datagrams: " << admission->malformed << ", dropped by rate: "
+         << admission->dropped << ", sources: " << admission->used << endl;
+
+    vector<const struct Source_Bucket*> dropping;
+    for(auto &bucket : admission->buckets) {
+        if(bucket.key != 0 && bucket.dropped != 0) {
+            dropping.push_back(&bucket);
+        }
+    }
+    sort(dropping.begin(), dropping.end(),
+         [](const struct Source_Bucket* a, const struct Source_Bucket* b) {
+             return a->dropped > b->dropped;
+         });
+
+    for(size_t i = 0; i < dropping.size() && i < ADMISSION_REPORTED_SOURCES; i++) {
+        uint64_t key = dropping[i]->key - 1;
+        struct in_addr address;
+        address.s_addr = htonl(key >> 16);
+        cout << "  " << inet_ntoa(address) << ":" << (key & 0xffff) << " accepted "
+             << dropping[i]->accepted << ", dropped " << dropping[i]->dropped << endl;
+    }
+    if(admission->overflow.dropped != 0 || admission->overflow.accepted != 0) {
+        cout << "  overflow accepted " << admission->overflow.accepted << ", dropped "
+             << admission->overflow.dropped << endl;
+    }
+}
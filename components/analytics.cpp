@@ -0,0 +1,207 @@
+/**
+ * @file analytics.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Count-min sketches with a top-k heap each, for the topics and
+ * sources that dominate the traffic, in constant memory.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/analytics.h"
+#include <algorithm>
+
+using namespace std;
+
+static void init_hitters(struct Heavy_Hitters* hitters) {
+    hitters->counters.assign(SKETCH_DEPTH * SKETCH_WIDTH, 0);
+    hitters->top.clear();
+    hitters->top.reserve(ANALYTICS_TOP_K);
+    hitters->names.assign(ANALYTICS_TOP_K, string());
+}
+
+void init_analytics(struct Analytics* analytics) {
+    init_hitters(&analytics->messages);
+    init_hitters(&analytics->fan_out);
+    init_hitters(&analytics->volume);
+    analytics->next_decay = time(NULL) + ANALYTICS_WINDOW;
+    analytics->random     = 0x9e3779b97f4a7c15ULL ^ time(NULL);
+}
+
+/**
+ * @brief Hash of the key, 8 bytes at a time, mixed so that both halves
+ * can index the rows.
+ */
+static uint64_t key_hash(const char *key, size_t length) {
+    uint64_t hash = length * 0x9e3779b97f4a7c15ULL;
+    uint64_t word;
+    for(; length >= sizeof(uint64_t); key += sizeof(uint64_t), length -= sizeof(uint64_t)) {
+        memcpy(&word, key, sizeof(uint64_t));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    if(length > 0) {
+        word = 0;
+        for(size_t i = 0; i < length; i++) {
+            word |= (uint64_t) (unsigned char) key[i] << (8 * i);
+        }
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return hash ^ (hash >> 32);
+}
+
+static bool heap_less(const struct Heavy_Hitter &a, const struct Heavy_Hitter &b) {
+    return a.estimate > b.estimate;
+}
+
+/**
+ * @brief Moves the entry at <i> down after its estimate grew.
+ */
+static void sift_down(vector<struct Heavy_Hitter> &top, size_t i) {
+    while(true) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if(left < top.size() && top[left].estimate < top[smallest].estimate) {
+            smallest = left;
+        }
+        if(right < top.size() && top[right].estimate < top[smallest].estimate) {
+            smallest = right;
+        }
+        if(smallest == i) {
+            return;
+        }
+        swap(top[i], top[smallest]);
+        i = smallest;
+    }
+}
+
+/**
+ * @brief Adds <amount> to the counters of the key (row i uses the hash
+ * h1 + i * h2) and keeps the key in the heap if it is one of the largest.
+ * 
+ * @param hitters sketch and heap
+ * @param hash hash of the key
+ * @param amount amount to add
+ * @param name key, only copied when it enters the heap
+ * @param length length of the key
+ */
+static void add_to_hitters(struct Heavy_Hitters* hitters, uint64_t hash, uint64_t amount,
+                           const char *name, size_t length) {
+    uint32_t h1 = hash;
+    uint32_t h2 = (hash >> 32) | 1;
+
+    uint64_t estimate = UINT64_MAX;
+    for(unsigned int row = 0; row < SKETCH_DEPTH; row++) {
+        uint64_t &counter = hitters->counters[row * SKETCH_WIDTH +
+                                              ((h1 + row * h2) & (SKETCH_WIDTH - 1))];
+        counter += amount;
+        estimate = min(estimate, counter);
+    }
+
+    vector<struct Heavy_Hitter> &top = hitters->top;
+    if(top.size() == ANALYTICS_TOP_K && estimate <= top[0].estimate) {
+        return;
+    }
+
+    /*
+        A key already in the heap only has its estimate raised
+    */
+    for(size_t i = 0; i < top.size(); i++) {
+        if(top[i].hash == hash) {
+            top[i].estimate = estimate;
+            sift_down(top, i);
+            return;
+        }
+    }
+
+    /*
+        Replace the smallest entry, reusing its name slot
+    */
+    if(top.size() == ANALYTICS_TOP_K) {
+        top[0].hash     = hash;
+        top[0].estimate = estimate;
+        hitters->names[top[0].slot].assign(name, length);
+        sift_down(top, 0);
+        return;
+    }
+    hitters->names[top.size()].assign(name, length);
+    top.push_back(Heavy_Hitter{hash, estimate, (unsigned int) top.size()});
+    push_heap(top.begin(), top.end(), heap_less);
+}
+
+void record_post(struct Analytics* analytics, const char *topic,
+                 const struct sockaddr_in* source, int bytes, uint64_t fan_out_bytes) {
+    analytics->random ^= analytics->random << 13;
+    analytics->random ^= analytics->random >> 7;
+    analytics->random ^= analytics->random << 17;
+    if((analytics->random & (ANALYTICS_SAMPLE - 1)) != 0) {
+        return;
+    }
+
+    size_t topic_length = strnlen(topic, TOPIC_LEN);
+    uint64_t topic_key = key_hash(topic, topic_length);
+    add_to_hitters(&analytics->messages, topic_key, ANALYTICS_SAMPLE, topic, topic_length);
+    add_to_hitters(&analytics->fan_out, topic_key, fan_out_bytes * ANALYTICS_SAMPLE,
+                   topic, topic_length);
+
+    /*
+        The source is kept as its 6 bytes, formatted when printed
+    */
+    char address[6];
+    memcpy(address, &source->sin_addr.s_addr, 4);
+    memcpy(address + 4, &source->sin_port, 2);
+    uint64_t source_key = ((uint64_t) source->sin_addr.s_addr << 16 | source->sin_port) *
+                          0x9e3779b97f4a7c15ULL;
+    add_to_hitters(&analytics->volume, source_key ^ (source_key >> 29),
+                   (uint64_t) bytes * ANALYTICS_SAMPLE, address, 6);
+}
+
+static void decay_hitters(struct Heavy_Hitters* hitters) {
+    for(auto &counter : hitters->counters) {
+        counter >>= 1;
+    }
+    for(auto &hitter : hitters->top) {
+        hitter.estimate >>= 1;
+    }
+}
+
+void decay_analytics(struct Analytics* analytics, time_t now) {
+    if(now < analytics->next_decay) {
+        return;
+    }
+    decay_hitters(&analytics->messages);
+    decay_hitters(&analytics->fan_out);
+    decay_hitters(&analytics->volume);
+    analytics->next_decay = now + ANALYTICS_WINDOW;
+}
+
+static void print_hitters(const char *title, struct Heavy_Hitters* hitters, bool addresses) {
+    vector<struct Heavy_Hitter> sorted = hitters->top;
+    sort(sorted.begin(), sorted.end(), heap_less);
+
+    cout << title << ":" << endl;
+    for(auto &hitter : sorted) {
+        const string &name = hitters->names[hitter.slot];
+        if(addresses) {
+            struct in_addr address;
+            uint16_t port;
+            memcpy(&address.s_addr, name.data(), 4);
+            memcpy(&port, name.data() + 4, 2);
+            cout << "  " << inet_ntoa(address) << ":" << ntohs(port);
+        } else {
+            cout << "  " << name;
+        }
+        cout << " " << hitter.estimate << endl;
+    }
+}
+
+void print_analytics(struct Analytics* analytics) {
+    print_hitters("Top topics by posts", &analytics->messages, false);
+    print_hitters("Top topics by fan-out bytes", &analytics->fan_out, false);
+    print_hitters("Top sources by bytes", &analytics->volume, true);
+}
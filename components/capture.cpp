@@ -0,0 +1,149 @@
+/**
+ * @file capture.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Capture of the datagrams received by the server, with their
+ * receive times and sources, and reading of the capture files.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#include "../include/capture.h"
+
+using namespace std;
+
+/**
+ * @brief Writes <value> 7 bits per byte, the high bit set on all the
+ * bytes but the last.
+ *
+ * @return the number of bytes written in <buffer> (at most 10)
+ */
+static int put_varint(char *buffer, uint64_t value) {
+    int length = 0;
+    while(value >= 0x80) {
+        buffer[length++] = (char) (value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (char) value;
+    return length;
+}
+
+/**
+ * @brief Reads a varint written by put_varint.
+ *
+ * @return false - end of the file inside the value
+ */
+static bool get_varint(FILE *file, uint64_t *value) {
+    *value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if(byte == EOF) {
+            return false;
+        }
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool open_capture(struct Capture* capture, const char *path) {
+    capture->file = fopen(path, "wb");
+    if(capture->file == NULL) {
+        return false;
+    }
+    setvbuf(capture->file, NULL, _IOFBF, CAPTURE_BUFFER_LEN);
+
+    capture->last_ns = 0;
+    capture->records = 0;
+    capture->bytes   = 8;
+    return fwrite(CAPTURE_MAGIC, 8, 1, capture->file) == 1;
+}
+
+void capture_datagram(struct Capture* capture, const void *datagram, int length,
+                      const struct sockaddr_in *source, uint64_t received_ns) {
+    if(capture->file == NULL || length < 0) {
+        return;
+    }
+
+    /*
+        The kernel timestamps of two sockets (taken over) may go back
+        a little: the delta stays unsigned
+    */
+    uint64_t delta = (received_ns > capture->last_ns) ? received_ns - capture->last_ns : 0;
+    capture->last_ns += delta;
+
+    char header[32];
+    int size = put_varint(header, delta);
+    memcpy(header + size, &source->sin_addr.s_addr, sizeof(uint32_t));
+    size += sizeof(uint32_t);
+    memcpy(header + size, &source->sin_port, sizeof(uint16_t));
+    size += sizeof(uint16_t);
+    size += put_varint(header + size, length);
+
+    if(fwrite(header, size, 1, capture->file) != 1 ||
+       (length > 0 && fwrite(datagram, length, 1, capture->file) != 1)) {
+        cerr << "Error in writing the capture, capture stopped." << endl;
+        fclose(capture->file);
+        capture->file = NULL;
+        return;
+    }
+    capture->records ++;
+    capture->bytes += size + length;
+}
+
+void close_capture(struct Capture* capture) {
+    if(capture->file == NULL) {
+        return;
+    }
+    if(fclose(capture->file) != 0) {
+        cerr << "Error in writing the capture." << endl;
+    }
+    capture->file = NULL;
+}
+
+void print_capture_stats(struct Capture* capture) {
+    if(capture == NULL || capture->records == 0) {
+        return;
+    }
+    cout << "Captured " << capture->records << " datagrams (" << capture->bytes
+         << " bytes)." << endl;
+}
+
+FILE *open_capture_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        return NULL;
+    }
+    setvbuf(file, NULL, _IOFBF, CAPTURE_BUFFER_LEN);
+
+    char magic[8];
+    if(fread(magic, 8, 1, file) != 1 || memcmp(magic, CAPTURE_MAGIC, 8) != 0) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+bool read_capture_record(FILE *file, struct Capture_Record* record) {
+    uint64_t delta, length;
+    if(get_varint(file, &delta) == false) {
+        return false;
+    }
+
+    memset(&record->source, 0, sizeof(struct sockaddr_in));
+    record->source.sin_family = AF_INET;
+    if(fread(&record->source.sin_addr.s_addr, sizeof(uint32_t), 1, file) != 1 ||
+       fread(&record->source.sin_port, sizeof(uint16_t), 1, file) != 1 ||
+       get_varint(file, &length) == false || length > sizeof(record->datagram)) {
+        return false;
+    }
+    if(length > 0 && fread(record->datagram, length, 1, file) != 1) {
+        return false;
+    }
+    record->time_ns += delta;
+    record->length = length;
+    return true;
+}
@@ -58,4 +58,78 @@ void obtain_nth_argument(char buffer[BUFLEN], int n, char result[TOPIC_LEN]) {
         }
         p = strtok(NULL, tokens);
     }
+}
+
+
+/**
+ * @brief Skips the separators and marks the following word as a token.
+ * Nothing is copied, the token points inside the buffer.
+ * 
+ * @param cursor - position in the line
+ * @param end - end of the line
+ * @param token - found token
+ * @return true - a token was found
+ * @return false - end of line
+ */
+bool next_token(const char **cursor, const char *end, struct Token *token) {
+    const char *p = *cursor;
+
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\0')) {
+        p ++;
+    }
+    if(p == end) {
+        *cursor = p;
+        return false;
+    }
+
+    token->start = p;
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\0') {
+        p ++;
+    }
+    token->length = p - token->start;
+    *cursor = p;
+
+    return true;
+}
+
+
+/**
+ * @brief Marks the bytes until the next '\n' (or the end of the buffer)
+ * as a line.
+ * 
+ * @param cursor - position in the buffer
+ * @param end - end of the buffer
+ * @param line - found line
+ * @return true - a line was found
+ * @return false - end of buffer
+ */
+bool next_line(const char **cursor, const char *end, struct Token *line) {
+    if(*cursor >= end) {
+        return false;
+    }
+
+    const char *new_line = (const char *) memchr(*cursor, '\n', end - *cursor);
+    if(new_line == NULL) {
+        new_line = end;
+    }
+
+    line->start     = *cursor;
+    line->length    = new_line - *cursor;
+    *cursor         = (new_line == end) ? end : new_line + 1;
+
+    return true;
+}
+
+
+/**
+ * @brief Compares a token with a C string.
+ * 
+ * @param token - token
+ * @param word - word
+ * @return true - same content
+ * @return false - different content
+ */
+bool token_equals(struct Token *token, const char *word) {
+    return strlen(word) == token->length &&
+           memcmp(token->start, word, token->length) == 0;
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+/**
+ * @file compression.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Batch frames and the LZ77 codec compressing them. The codec
+ * finds matches with a hash table of 4-byte prefixes (one probe per
+ * position), so it costs a few ns per byte and needs no dictionary.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/compression.h"
+#include <cstring>
+
+using namespace std;
+
+#define MIN_MATCH       4
+#define MAX_OFFSET      65535
+#define HASH_BITS       12
+
+void append_batch_record(string &records, uint64_t sequence, const char *content, int size) {
+    uint32_t length = size;
+    records.append((const char *) &sequence, sizeof(uint64_t));
+    records.append((const char *) &length, sizeof(uint32_t));
+    records.append(content, size);
+}
+
+bool next_batch_record(const char **cursor, const char *end, uint64_t *sequence,
+                       const char **content, uint32_t *size) {
+    if(end - *cursor < (long) (sizeof(uint64_t) + sizeof(uint32_t))) {
+        return false;
+    }
+    memcpy(sequence, *cursor, sizeof(uint64_t));
+    memcpy(size, *cursor + sizeof(uint64_t), sizeof(uint32_t));
+    *cursor += sizeof(uint64_t) + sizeof(uint32_t);
+    if((uint64_t) (end - *cursor) < *size) {
+        return false;
+    }
+    *content = *cursor;
+    *cursor += *size;
+    return true;
+}
+
+static uint32_t read_u32(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(uint32_t));
+    return value;
+}
+
+static uint32_t prefix_hash(uint32_t prefix) {
+    return (prefix * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/**
+ * @brief Writes the rest of a length that did not fit in its 4 bits.
+ */
+static void put_length(string &block, size_t length) {
+    while(length >= 255) {
+        block.push_back((char) 255);
+        length -= 255;
+    }
+    block.push_back((char) length);
+}
+
+static void put_sequence(string &block, const char *literals, size_t literal_length,
+                         size_t offset, size_t match_length) {
+    size_t match_code = (match_length == 0) ? 0 : match_length - MIN_MATCH;
+    unsigned char token = (min(literal_length, (size_t) 15) << 4) | min(match_code, (size_t) 15);
+    block.push_back((char) token);
+    if(literal_length >= 15) {
+        put_length(block, literal_length - 15);
+    }
+    block.append(literals, literal_length);
+    if(match_length == 0) {
+        return;
+    }
+    block.push_back((char) (offset & 0xff));
+    block.push_back((char) (offset >> 8));
+    if(match_code >= 15) {
+        put_length(block, match_code - 15);
+    }
+}
+
+void compress_block(const char *input, size_t length, string &block) {
+    int32_t table[1 << HASH_BITS];
+    memset(table, -1, sizeof(table));
+
+    size_t anchor = 0, position = 0;
+    while(position + MIN_MATCH <= length) {
+        uint32_t prefix = read_u32(input + position);
+        uint32_t slot = prefix_hash(prefix);
+        int32_t candidate = table[slot];
+        table[slot] = position;
+
+        if(candidate < 0 || position - candidate > MAX_OFFSET ||
+           read_u32(input + candidate) != prefix) {
+            position ++;
+            continue;
+        }
+
+        size_t match = MIN_MATCH;
+        while(position + match < length && input[candidate + match] == input[position + match]) {
+            match ++;
+        }
+        put_sequence(block, input + anchor, position - anchor, position - candidate, match);
+        position += match;
+        anchor = position;
+    }
+    put_sequence(block, input + anchor, length - anchor, 0, 0);
+}
+
+/**
+ * @brief Reads the rest of a length that did not fit in its 4 bits.
+ */
+static bool get_length(const unsigned char **cursor, const unsigned char *end, size_t *length) {
+    unsigned char byte;
+    do {
+        if(*cursor >= end) {
+            return false;
+        }
+        byte = *(*cursor)++;
+        *length += byte;
+    } while(byte == 255);
+    return true;
+}
+
+bool decompress_block(const char *block, size_t length, string &output, size_t raw_length) {
+    const unsigned char *cursor = (const unsigned char *) block;
+    const unsigned char *end = cursor + length;
+    output.clear();
+    output.reserve(raw_length);
+
+    while(cursor < end) {
+        unsigned char token = *cursor++;
+        size_t literal_length = token >> 4;
+        if(literal_length == 15 && get_length(&cursor, end, &literal_length) == false) {
+            return false;
+        }
+        if((size_t) (end - cursor) < literal_length ||
+           output.size() + literal_length > raw_length) {
+            return false;
+        }
+        output.append((const char *) cursor, literal_length);
+        cursor += literal_length;
+
+        /* The last sequence has no match */
+        if(cursor == end) {
+            break;
+        }
+        if(end - cursor < 2) {
+            return false;
+        }
+        size_t offset = cursor[0] | (cursor[1] << 8);
+        cursor += 2;
+        size_t match_length = token & 0x0f;
+        if(match_length == 15 && get_length(&cursor, end, &match_length) == false) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if(offset == 0 || offset > output.size() ||
+           output.size() + match_length > raw_length) {
+            return false;
+        }
+
+        /* The copied bytes may overlap the ones being written */
+        size_t from = output.size() - offset;
+        for(size_t i = 0; i < match_length; i++) {
+            output.push_back(output[from + i]);
+        }
+    }
+    return output.size() == raw_length;
+}
+
+void build_batch(const string &records, string &body) {
+    uint32_t raw_length = records.size();
+    body.assign((const char *) &raw_length, sizeof(uint32_t));
+    compress_block(records.data(), records.size(), body);
+}
+
+bool open_batch(const char *body, int size, string &records) {
+    if(size < (int) sizeof(uint32_t)) {
+        return false;
+    }
+    uint32_t raw_length = read_u32(body);
+    if(raw_length > MAX_BATCH_RAW_LEN) {
+        return false;
+    }
+    return decompress_block(body + sizeof(uint32_t), size - sizeof(uint32_t),
+                            records, raw_length);
+}
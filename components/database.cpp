@@ -23,6 +23,14 @@
 #include "../include/subscriber.h"
 #include "../include/helpers.h"
 #include "../include/command_parser.h"
+#include "../include/snapshot.h"
+#include "../include/federation.h"
+#include "../include/network.h"
+#include "../include/latency.h"
+#include "../include/event_loop.h"
+#include "../include/compression.h"
+#include "../include/retention.h"
+#include "../include/multicast.h"
 #include <cstring>
 #include <sstream>
 #include <vector>
@@ -31,78 +39,326 @@
 using namespace std;
 
 /**
- * @brief Function that adds a new client to the Database
+ * @brief Creates the shared memory ring of a client connected on a Unix
+ * domain socket and passes its descriptors to the client (SCM_RIGHTS).
+ * Clients connected over TCP keep using the socket.
  * 
+ * @param database - database
+ * @param socket - socket of the client
+ */
+static void open_shared_ring(struct Database* database, int socket) {
+    struct sockaddr_storage address;
+    socklen_t length = sizeof(struct sockaddr_storage);
+    if(getsockname(socket, (struct sockaddr *) &address, &length) < 0 ||
+       address.ss_family != AF_UNIX) {
+        return;
+    }
+
+    struct Connection connection;
+    connection.socket_fd = socket;
+    connection.transport = TRANSPORT_SHM;
+    if(create_ring(&connection.ring, SHM_RING_LEN) == false) {
+        return;
+    }
+
+    int fds[2] = {connection.ring.memory_fd, connection.ring.event_fd};
+    if(send_frame(socket, SHM_SETUP_CODE, NULL, 0) == false ||
+       send_fds(socket, fds, 2) == false) {
+        destroy_ring(&connection.ring);
+        return;
+    }
+    (*database).connections[socket] = connection;
+    if((*database).loop != NULL) {
+        (*database).loop->rings[socket] = &(*database).connections[socket].ring;
+    }
+}
+
+void parse_resume(const char *body, int size, unordered_map<string, uint64_t> &resume_from) {
+    const char *cursor = body;
+    const char *end = body + size;
+    struct Token line, topic, sequence;
+    while(next_line(&cursor, end, &line)) {
+        const char *p = line.start;
+        const char *line_end = line.start + line.length;
+        if(next_token(&p, line_end, &topic) && next_token(&p, line_end, &sequence) &&
+           topic.length < TOPIC_LEN) {
+            resume_from[string(topic.start, topic.length)] =
+                strtoull(string(sequence.start, sequence.length).c_str(), NULL, 10);
+        }
+    }
+}
+
+/**
+ * @brief Reads the RESUME frame sent after the ID: one "<topic> <sequence>"
+ * line for every topic, having the last sequence received by the client.
+ * 
+ * @param socket - socket of the client
+ * @param resume_from - result - topic -> last received sequence
+ * @return true - valid frame
+ * @return false - the client disconnected or sent another frame
+ */
+static bool receive_resume(int socket, unordered_map<string, uint64_t> &resume_from) {
+    struct Send_Header header;
+    vector<char> body;
+    if(recv_frame(socket, &header, body, MAX_BULK_LEN) == false ||
+       header.operation != RESUME_CODE) {
+        return false;
+    }
+    parse_resume(body.data(), header.size, resume_from);
+    return true;
+}
+
+/**
+ * @brief Adds the post to the batch of the client at <socket>. The batch
+ * is sent once it holds BATCH_RAW_LEN bytes, or at its deadline.
+ * 
+ * @param database - database
+ * @param socket - socket of the client
+ * @param sequence - sequence of the post in its topic
+ * @param content - text of the post
+ * @param size - size of the text (with its '\0')
+ */
+static void batch_post(struct Database* database, int socket, uint64_t sequence,
+                       const char *content, int size, int priority,
+                       const struct Egress_Mark *mark = NULL) {
+    auto pending = (*database).batches.find(socket);
+    if(pending != (*database).batches.end() && pending->second.priority != priority) {
+        flush_batch(database, socket);
+    }
+
+    struct Post_Batch &batch = (*database).batches[socket];
+    if(batch.records.empty()) {
+        batch.deadline = now_ns() + BATCH_DELAY_NS;
+        batch.priority = priority;
+    }
+    append_batch_record(batch.records, sequence, content, size);
+    if(mark != NULL) {
+        batch.marks.push_back(*mark);
+    }
+    if(batch.records.size() >= BATCH_RAW_LEN) {
+        flush_batch(database, socket);
+    }
+}
+
+/**
+ * @brief Sends the SF queue of a client that logs in again. For the topics
+ * in <resume_from> the client gets exactly the posts after its last
+ * sequence: the queued posts it already received are skipped, the posts
+ * still retained in the log of the topic are sent from the log (also for
+ * topics without SF) and the queue only fills in what the log no longer
+ * has.
+ * 
+ * @param database - database
+ * @param subscriber - client
+ * @param socket - socket of the client
+ * @param resume_from - topic -> last sequence received by the client
+ */
+static void replay_posts(struct Database* database, struct Subscriber* subscriber,
+                         int socket, unordered_map<string, uint64_t> &resume_from) {
+    struct Send_Post transform;
+    for(struct Stored_Post &pkt : subscriber->SF_queue) {
+        if(pkt.operation == EVICTED_POST) {
+            continue;
+        }
+
+        bool deliver = true;
+        auto resumed = resume_from.find(*pkt.topic);
+        if(pkt.sequence != 0 && resumed != resume_from.end()) {
+            auto log = (*database).topic_logs.find(*pkt.topic);
+            uint64_t oldest_retained = UINT64_MAX;
+            if(log != (*database).topic_logs.end() && log->second.retained.count != 0) {
+                oldest_retained = log->second.retained.first;
+            }
+
+            if(pkt.sequence <= resumed->second || pkt.sequence >= oldest_retained) {
+                deliver = false;
+            } else {
+                resumed->second = pkt.sequence;
+            }
+        }
+        if(deliver == false) {
+            continue;
+        }
+
+        /* The text is only made now */
+        format_stored_post(&pkt, &transform);
+        int priority = topic_priority(database, *pkt.topic);
+        struct Egress_Mark mark = {pkt.ingress_ns, pkt.topic, NULL, TRACE_REPLAY, 0};
+        bool traced = (*database).tracer != NULL && pkt.ingress_ns != 0;
+        if(traced) {
+            mark.histogram = &(*database).tracer->replay;
+        }
+        if(subscriber->batch_frames) {
+            batch_post(database, socket, pkt.sequence, transform.content,
+                       strlen(transform.content) + 1, priority, traced ? &mark : NULL);
+        } else {
+            deliver_frame(database, socket, SUBSCRIPTION_SEND, transform.content,
+                          strlen(transform.content) + 1, pkt.sequence, priority,
+                          &mark, traced ? 1 : 0);
+        }
+    }
+    release_queue(subscriber);
+    journal_drain((*database).journal, subscriber->ID);
+
+    for(auto &resumed : resume_from) {
+        auto log = (*database).topic_logs.find(resumed.first);
+        if(log == (*database).topic_logs.end() || log->second.retained.count == 0 ||
+           subscriber->subscription_types.find(resumed.first) == subscriber->subscription_types.end()) {
+            continue;
+        }
+
+        /*
+            The retained sequences are consecutive, the cursor skips the
+            blocks before the first missing post
+        */
+        struct Log_Cursor cursor;
+        uint64_t sequence;
+        seek_log(&log->second.retained, log->first, resumed.second + 1, &cursor);
+        int priority = topic_priority(database, resumed.first);
+        while(next_logged(&cursor, &sequence)) {
+            format_post(&cursor.post, cursor.source, &transform);
+            if(subscriber->batch_frames) {
+                batch_post(database, socket, sequence, transform.content,
+                           strlen(transform.content) + 1, priority);
+            } else {
+                deliver_frame(database, socket, SUBSCRIPTION_SEND, transform.content,
+                              strlen(transform.content) + 1, sequence, priority);
+            }
+        }
+    }
+
+    /* The replay is sent as soon as it is built */
+    flush_batch(database, socket);
+}
+
+/**
+ * @brief Function that adds a new client to the Database, once its ID and
+ * its resume frame are received and its session is CONNECTING.
+ * 
+ * @param database - database
  * @param socket - socket of the new client
  * @param adress - address of the client
- * @param database - database
- * @return true - The operation ends up with success
- * @return false - The operation fails (There is already a client connected with the given ID
- * in the database)
+ * @param key - ID of the client
+ * @param operation - operation of the ID frame (ID_CODE / ID_SHM_CODE and
+ * the ID_RESUME_FLAG / ID_BATCH_FLAG / ID_MULTICAST_FLAG flags)
+ * @param resume_from - topic -> last sequence received by the client
  */
-bool add_new_client(int socket, struct sockaddr_in adress, struct Database *database)
+void login_client(struct Database* database, int socket, struct sockaddr_in adress,
+                  const struct Login_Key* key, int operation,
+                  unordered_map<string, uint64_t> &resume_from)
 {
    /*
-        In order for the server to know the client's ID, we send the server a packet from
-        the client with its assigned ID. The server then follows the steps:
+        The server follows the steps:
 
         1. Check if the given ID is already in the Database
-            1.1 If Yes - check if the ID is corresponding to an already connected user
-            in which case we send Fail and send an ID_IN_USE packet back to the client.
+            1.1 If Yes - and the ID is corresponding to an already connected user
+            the login was refused by begin_login.
 
             1.2 If Yes - and the ID is corresponding to a not connected client, then
             connect the client and send back to the client the Posts in the queue.
 
         2. Add the new client to the local Database
    */
-
-    char ID[BUFLEN];
-    ID[0] = '\0';
-    struct Send_Header received_header;
-    int return_value = recv(socket, &received_header, sizeof(struct Send_Header), 0);
-    DIE(return_value < 0, "Error in receiving header");
-    return_value = recv(socket, ID, received_header.size, 0);
-
-    /* (1.1) */
-    if(ID_already_in_database(ID, database) == true) {
-        cout << "Client " << ID << " already connected." << endl;
-        return false;
-    }
-
+    const char *ID = key->ID;
     cout << "New client " << ID << " connected from " << inet_ntoa(adress.sin_addr);
     cout << ":" <<  socket << "." << endl;
     
+    /*
+        A client on the same host (Unix domain socket) may ask for a shared
+        memory ring. It is set up before the enqueued posts are sent, so
+        that all the posts go through the ring, in order.
+    */
+    if((operation & ~ID_FLAGS) == ID_SHM_CODE) {
+        open_shared_ring(database, socket);
+    }
+
     /* (1.2) */
     auto find_user = (*database).online.find(ID);
     if(find_user != (*database).online.end()) {
         /*
-            Send the enqueued posts
+            Send the enqueued posts and the ones missed since the sequences
+            of the client
         */
-        while(!find_user->second.SF_queue.empty()) {
-            struct Send_Post pkt = find_user->second.SF_queue.front();
-            find_user->second.SF_queue.pop();
+        find_user->second.batch_frames = (operation & ID_BATCH_FLAG) != 0;
+        find_user->second.multicast = (operation & ID_MULTICAST_FLAG) != 0;
+        find_user->second.heartbeats = (operation & ID_HEARTBEAT_FLAG) != 0;
+        replay_posts(database, &find_user->second, socket, resume_from);
 
-            struct Send_Header header;
-            header.operation = SUBSCRIPTION_SEND;
-            char aux[BUFLEN];
-            strcpy(aux, pkt.content);
-            header.size = strlen(aux) + 1;
+        /*
+            Keep the subscriptions of the client, only update its connection
+        */
+        find_user->second.socket_fd = socket;
+        find_user->second.online    = true;
+    } else {
+        /* (2) */
+        struct Subscriber &new_subscriber = (*database).online[ID];
+        strcpy(new_subscriber.ID, ID);
+        new_subscriber.socket_fd    = socket;
+        new_subscriber.online       = true;
+        new_subscriber.batch_frames = (operation & ID_BATCH_FLAG) != 0;
+        new_subscriber.multicast    = (operation & ID_MULTICAST_FLAG) != 0;
+        new_subscriber.heartbeats   = (operation & ID_HEARTBEAT_FLAG) != 0;
+        journal_client((*database).journal, ID);
+    }
 
-            return_value = send(socket, &header, sizeof(struct Send_Header), 0);
-            return_value = send(socket, aux, header.size, 0);
+    struct Subscriber location;
+    strcpy(location.ID, ID);
+    location.socket_fd  = socket;
+    location.online     = true;
+    (*database).locations[socket] = location;
+    set_session(&(*database).sessions, key, socket, SESSION_ONLINE);
 
-        }
+    /* The group and the topics it takes from it, after the replay */
+    multicast_login(database, &(*database).online[ID]);
+}
+
+/**
+ * @brief Receives the ID of a new client (blocking) and adds it to the
+ * Database. The server does the same in the coroutine of the connection
+ * (see session.cpp), without blocking.
+ * 
+ * @param socket - socket of the new client
+ * @param adress - address of the client
+ * @param database - database
+ * @return true - The operation ends up with success
+ * @return false - The operation fails (There is already a client connected with the given ID
+ * in the database)
+ */
+bool add_new_client(int socket, struct sockaddr_in adress, struct Database *database)
+{
+    char ID[BUFLEN];
+    ID[0] = '\0';
+    struct Send_Header received_header;
+    if(recv_all(socket, &received_header, sizeof(struct Send_Header)) == false ||
+       received_header.size <= 0 || received_header.size >= ID_MAX_LEN ||
+       recv_all(socket, ID, received_header.size) == false) {
+        return false;
     }
+    ID[received_header.size] = '\0';
 
-    /* (2) */
-    struct Subscriber new_subscriber;
-    strcpy(new_subscriber.ID, ID);
-    new_subscriber.socket_fd    = socket;
-    new_subscriber.online       = true;
+    /*
+        (1.1) The ID is hashed once; the session stays CONNECTING until
+        the login ends, so the same ID cannot log in twice meanwhile.
+    */
+    struct Login_Key key;
+    make_login_key(ID, &key);
+    if(begin_login(&(*database).sessions, &key, socket) == false) {
+        cout << "Client " << ID << " already connected." << endl;
+        return false;
+    }
 
-    (*database).locations[socket] = new_subscriber;
-    (*database).online[ID] = new_subscriber;
+    /*
+        A client that keeps its sequences follows the ID with the last
+        sequence it received on each topic.
+    */
+    unordered_map<string, uint64_t> resume_from;
+    if((received_header.operation & ID_RESUME_FLAG) != 0 &&
+       receive_resume(socket, resume_from) == false) {
+        set_session(&(*database).sessions, &key, -1, SESSION_OFFLINE);
+        return false;
+    }
 
+    login_client(database, socket, adress, &key, received_header.operation, resume_from);
     return true;
 }
 
@@ -116,58 +372,330 @@ bool add_new_client(int socket, struct sockaddr_in adress, struct Database *data
  */
 
 bool ID_already_in_database(char ID[BUFLEN], struct Database* database) {
-    for(auto user_data : (*database).locations) {
-        struct Subscriber user = user_data.second;
-        if(strcmp(user.ID, ID) == 0 && user.online == true) {
-            return true;
-        }
+    struct Login_Key key;
+    make_login_key(ID, &key);
+    struct Session* session = find_session(&(*database).sessions, &key);
+    return session != NULL && session->state != SESSION_OFFLINE;
+}
+
+/**
+ * @brief Finds the subscriber connected at <socket_fd>
+ * 
+ * @param database - database
+ * @param socket_fd - client
+ * @return the subscriber stored in the online map or NULL
+ */
+struct Subscriber* find_subscriber(struct Database* database, int socket_fd) {
+    auto location = (*database).locations.find(socket_fd);
+    if(location == (*database).locations.end()) {
+        return NULL;
     }
-    return false;
+
+    auto subscriber = (*database).online.find(location->second.ID);
+    if(subscriber == (*database).online.end()) {
+        return NULL;
+    }
+    return &subscriber->second;
 }
 
 /**
- * @brief Breaks the command received from the client into 3 pieces
- * and adds the received topic to the subscriber's hashmap of
- * subscribed topics and SF and stores the subscriber in the
- * hashmap of the database.
+ * @brief Applies a single command line: "subscribe <topic> <SF>" or
+ * "unsubscribe <topic>". The line is split into tokens without
+ * being copied, only the topic is copied once as the key of the maps.
  * 
  * @param database - database
- * @param socket_fd - client 
- * @param buffer - command
+ * @param subscriber - client
+ * @param line - command line
+ * @return true - the command was valid and applied
+ * @return false - invalid command
  */
-void add_subscription(struct Database* database, int socket_fd, char buffer[BUFLEN]) {
-    struct Subscriber subscriber2 = (*database).locations[socket_fd];
-    auto subscriber = (*database).online.find(subscriber2.ID);
+static bool apply_command_line(struct Database* database, struct Subscriber* subscriber,
+                               struct Token line) {
+    const char *cursor = line.start;
+    const char *end = line.start + line.length;
+    struct Token command, topic, SF, extra;
 
-    char topic[TOPIC_LEN];
-    char SF[2];
+    if(next_token(&cursor, end, &command) == false ||
+       next_token(&cursor, end, &topic) == false ||
+       topic.length >= TOPIC_LEN) {
+        return false;
+    }
 
-    /*
-        Obtain the SF char
-    */
-    SF[0] = buffer[strlen(buffer) - 2];
-    SF[1] = '\0';
+    if(token_equals(&command, SUBSCRIBE_REQUEST)) {
+        if(next_token(&cursor, end, &SF) == false || SF.length != 1 ||
+           (SF.start[0] != '0' && SF.start[0] != '1') ||
+           next_token(&cursor, end, &extra) == true) {
+            return false;
+        }
+        subscribe_topic(database, subscriber, string(topic.start, topic.length),
+                        SF.start[0] == '1');
+        return true;
+    }
 
-    /*
-        Obtain the topic
-    */
-    obtain_nth_argument(buffer, 2, topic);
+    if(token_equals(&command, UNSUBSCRIBE_REQUEST)) {
+        if(next_token(&cursor, end, &extra) == true) {
+            return false;
+        }
+        unsubscribe_topic(database, subscriber, string(topic.start, topic.length));
+        return true;
+    }
 
-    /*
-        Check SF validation and update client's topics hashmap
-    */
-    if(SF[0] == '1') {
-        subscriber->second.subscription_types[topic] = true;
-    } else if(SF[0] == '0'){
-        subscriber->second.subscription_types[topic] = false;
-    } else {
-        DIE(SF[0] != '0' && SF[0] == '1', "Command Error");
+    return false;
+}
+
+/**
+ * @brief Records the traced posts of a frame the transport accepted at once.
+ */
+static void trace_sent(struct Database* database, int socket_fd,
+                       const struct Egress_Mark *marks, int mark_count) {
+    uint64_t now = now_ns();
+    for(int i = 0; i < mark_count; i++) {
+        record_latency((*database).tracer, marks[i].histogram, marks[i].topic->c_str(),
+                       marks[i].ingress_ns, now, socket_fd, marks[i].kind);
     }
+}
 
+/**
+ * @brief Sends the frame on the transport of the client. Only the clients
+ * having a shared memory ring are in the connections map; the event loop
+ * knows their rings too, so that a full ring never blocks it.
+ * 
+ * @param database - database
+ * @param socket_fd - socket of the client
+ * @param operation - operation of the frame
+ * @param body - body of the frame
+ * @param size - size of the body
+ * @param sequence - sequence of the post in its topic (0 for other frames)
+ * @param priority - class of the frame when the client is backlogged
+ * @return true - the frame was sent
+ * @return false - the client cannot receive frames anymore
+ */
+bool deliver_frame(struct Database* database, int socket_fd, int operation,
+                   const char *body, int size, uint64_t sequence, int priority,
+                   const struct Egress_Mark *marks, int mark_count) {
     /*
-        Add the client to the subscription map of the database
+        The posts batched for the client go first, so it receives all the
+        frames in order
     */
-    (*database).subscription[topic].push_back(subscriber->second);
+    if(!(*database).batches.empty() && (*database).batches.count(socket_fd) != 0) {
+        flush_batch(database, socket_fd);
+    }
+    if((*database).loop != NULL) {
+        return queue_frame((*database).loop, socket_fd, operation, body, size, sequence,
+                           priority, marks, mark_count);
+    }
+    if(!(*database).connections.empty()) {
+        auto connection = (*database).connections.find(socket_fd);
+        if(connection != (*database).connections.end() &&
+           connection->second.transport == TRANSPORT_SHM) {
+            bool written = ring_write_frame(&connection->second.ring, operation, body, size,
+                                            socket_fd, sequence);
+            if(written) {
+                trace_sent(database, socket_fd, marks, mark_count);
+            }
+            return written;
+        }
+    }
+    bool sent = send_frame(socket_fd, operation, body, size, sequence);
+    if(sent) {
+        trace_sent(database, socket_fd, marks, mark_count);
+    }
+    return sent;
+}
+
+void flush_batch(struct Database* database, int socket_fd) {
+    auto batch = (*database).batches.find(socket_fd);
+    if(batch == (*database).batches.end()) {
+        return;
+    }
+
+    /* Erased first: deliver_frame sends the pending batch before a frame */
+    string records = move(batch->second.records);
+    int priority = batch->second.priority;
+    vector<struct Egress_Mark> marks = move(batch->second.marks);
+    (*database).batches.erase(batch);
+
+    string body;
+    build_batch(records, body);
+    deliver_frame(database, socket_fd, BATCH_CODE, body.data(), body.size(), 0, priority,
+                  marks.data(), marks.size());
+}
+
+int topic_priority(struct Database* database, const string &topic) {
+    if((*database).priorities.empty()) {
+        return PRIORITY_NORMAL;
+    }
+    auto entry = (*database).priorities.find(topic);
+    return (entry == (*database).priorities.end()) ? PRIORITY_NORMAL : entry->second;
+}
+
+void flush_batches(struct Database* database, uint64_t now) {
+    vector<int> due;
+    for(auto &batch : (*database).batches) {
+        if(batch.second.deadline <= now) {
+            due.push_back(batch.first);
+        }
+    }
+    for(int socket_fd : due) {
+        flush_batch(database, socket_fd);
+    }
+}
+
+uint64_t next_batch_deadline(struct Database* database) {
+    uint64_t deadline = 0;
+    for(auto &batch : (*database).batches) {
+        if(deadline == 0 || batch.second.deadline < deadline) {
+            deadline = batch.second.deadline;
+        }
+    }
+    return deadline;
+}
+
+/**
+ * @brief Unmaps the ring of the client, if it has one, and drops the
+ * posts still batched for it.
+ * 
+ * @param database - database
+ * @param socket_fd - socket of the client
+ */
+void close_connection(struct Database* database, int socket_fd) {
+    (*database).batches.erase(socket_fd);
+    auto connection = (*database).connections.find(socket_fd);
+    if(connection == (*database).connections.end()) {
+        return;
+    }
+    if(connection->second.transport == TRANSPORT_SHM) {
+        if((*database).loop != NULL) {
+            (*database).loop->rings.erase(socket_fd);
+        }
+        destroy_ring(&connection->second.ring);
+    }
+    (*database).connections.erase(connection);
+}
+
+/**
+ * @brief The snapshots save the reserved sequence of each topic, which is
+ * safe after a crash. When the server stops on purpose no post follows, so
+ * the exact sequence is saved instead.
+ * 
+ * @param database - database
+ */
+void settle_sequences(struct Database* database) {
+    for(auto &log : (*database).topic_logs) {
+        log.second.reserved = log.second.sequence;
+    }
+}
+
+const string *intern_topic(struct Database* database, const string &topic) {
+    return &(*database).topic_logs.try_emplace(topic).first->first;
+}
+
+/**
+ * @brief Pushes the post in the SF queue of the subscriber, applies the
+ * retention policy of its topic and records the change in the journal.
+ * 
+ * @param database - database
+ * @param subscriber - offline client
+ * @param post - post to be sent at the next login
+ */
+void enqueue_post(struct Database* database, struct Subscriber* subscriber,
+                  struct Stored_Post* post) {
+    subscriber->SF_queue.push_back(*post);
+    journal_enqueue((*database).journal, subscriber->ID, post);
+    retain_post((*database).retention, subscriber);
+}
+
+/**
+ * @brief Adds the received topic to the subscriber's hashmap of
+ * subscribed topics and SF and stores the subscriber's ID in the
+ * subscribers of the topic.
+ * 
+ * @param database - database
+ * @param subscriber - client
+ * @param topic - topic
+ * @param SF - store and forward
+ */
+void subscribe_topic(struct Database* database, struct Subscriber* subscriber,
+                     const string &topic, bool SF) {
+    subscriber->subscription_types[topic] = SF;
+    journal_subscribe((*database).journal, subscriber->ID, topic, SF);
+    multicast_subscribed(database, subscriber, topic, true);
+
+    struct Topic_Subscribers &subscribers = (*database).subscription[topic];
+    if(subscribers.position.find(subscriber->ID) != subscribers.position.end()) {
+        return;
+    }
+    subscribers.position[subscriber->ID] = subscribers.IDs.size();
+    subscribers.IDs.push_back(subscriber->ID);
+
+    if(subscribers.IDs.size() == 1) {
+        federation_topic_added((*database).federation, topic);
+    }
+}
+
+/**
+ * @brief Removes the client from the subscribers of the topic by moving
+ * the last subscriber in its place, then updates the client's map of
+ * subscribed topics.
+ * 
+ * @param database - database
+ * @param subscriber - client
+ * @param topic - topic
+ */
+void unsubscribe_topic(struct Database* database, struct Subscriber* subscriber,
+                       const string &topic) {
+    if(subscriber->subscription_types.erase(topic) == 0) {
+        return;
+    }
+    journal_unsubscribe((*database).journal, subscriber->ID, topic);
+    multicast_subscribed(database, subscriber, topic, false);
+
+    auto topic_entry = (*database).subscription.find(topic);
+    if(topic_entry == (*database).subscription.end()) {
+        return;
+    }
+
+    struct Topic_Subscribers &subscribers = topic_entry->second;
+    auto position = subscribers.position.find(subscriber->ID);
+    if(position == subscribers.position.end()) {
+        return;
+    }
+
+    unsigned int index = position->second;
+    subscribers.position.erase(position);
+
+    if(index != subscribers.IDs.size() - 1) {
+        subscribers.IDs[index].swap(subscribers.IDs.back());
+        subscribers.position[subscribers.IDs[index]] = index;
+    }
+    subscribers.IDs.pop_back();
+
+    if(subscribers.IDs.empty()) {
+        federation_topic_removed((*database).federation, topic);
+        (*database).subscription.erase(topic_entry);
+    }
+}
+
+/**
+ * @brief Validates the subscribe command received from the client and
+ * adds the topic with its SF to the client's subscriptions.
+ * 
+ * @param database - database
+ * @param socket_fd - client 
+ * @param buffer - command
+ */
+void add_subscription(struct Database* database, int socket_fd, char buffer[BUFLEN]) {
+    struct Subscriber* subscriber = find_subscriber(database, socket_fd);
+    if(subscriber == NULL) {
+        return;
+    }
+
+    const char *cursor = buffer;
+    struct Token line;
+    if(next_line(&cursor, buffer + strlen(buffer), &line) == false ||
+       apply_command_line(database, subscriber, line) == false) {
+        cerr << "Invalid subscribe command from " << subscriber->ID << "." << endl;
+    }
 }
 
 /**
@@ -179,28 +707,50 @@ void add_subscription(struct Database* database, int socket_fd, char buffer[BUFL
  * @param buffer command
  */
 void remove_subscription(struct Database* database, int socket_fd, char buffer[BUFLEN]) {
-    struct Subscriber subscriber2 = (*database).locations[socket_fd];
-    auto subscriber = (*database).online.find(subscriber2.ID);
+    struct Subscriber* subscriber = find_subscriber(database, socket_fd);
+    if(subscriber == NULL) {
+        return;
+    }
 
-    char topic[TOPIC_LEN];
-    obtain_nth_argument(buffer, 2, topic);
+    const char *cursor = buffer;
+    struct Token line;
+    if(next_line(&cursor, buffer + strlen(buffer), &line) == false ||
+       apply_command_line(database, subscriber, line) == false) {
+        cerr << "Invalid unsubscribe command from " << subscriber->ID << "." << endl;
+    }
+}
 
-    /*
-        Remove subscription from map of the client
-    */
-    subscriber->second.subscription_types.erase(topic);
-    
-    int position = -1;
+/**
+ * @brief Walks the bulk frame line by line and applies every command
+ * for the same subscriber, which is only looked up once.
+ * 
+ * @param database database
+ * @param socket_fd client
+ * @param body frame body
+ * @param size size of the body
+ * @return number of applied commands
+ */
+int apply_bulk_subscriptions(struct Database* database, int socket_fd,
+                             const char *body, int size) {
+    struct Subscriber* subscriber = find_subscriber(database, socket_fd);
+    if(subscriber == NULL) {
+        return 0;
+    }
 
-    for(unsigned int i = 0; i < (*database).subscription[topic].size(); i++) {
-        if(strcmp((*database).subscription[topic][i].ID, subscriber2.ID) == 0) {
-            position = i;
-            break;
+    const char *cursor = body;
+    const char *end = body + size;
+    struct Token line;
+    int applied = 0;
+
+    while(next_line(&cursor, end, &line) == true) {
+        if(line.length == 0) {
+            continue;
+        }
+        if(apply_command_line(database, subscriber, line) == true) {
+            applied ++;
         }
     }
-    if(position != -1) {
-        (*database).subscription[topic].erase((*database).subscription[topic].begin() + position);
-    }
+    return applied;
 }
 
 /**
@@ -210,9 +760,20 @@ void remove_subscription(struct Database* database, int socket_fd, char buffer[B
  * @param socket_fd socket for user
  */
 void disconnect_client(struct Database* database, int socket_fd) {
-    struct Subscriber user = (*database).locations[socket_fd];
-    user.online = false;
-    (*database).locations[socket_fd] = user;
+    auto location = (*database).locations.find(socket_fd);
+    if(location == (*database).locations.end()) {
+        return;
+    }
+
+    auto user = (*database).online.find(location->second.ID);
+    if(user != (*database).online.end()) {
+        user->second.online = false;
+    }
+
+    struct Login_Key key;
+    make_login_key(location->second.ID, &key);
+    set_session(&(*database).sessions, &key, -1, SESSION_OFFLINE);
+    (*database).locations.erase(location);
 }
 
 /**
@@ -295,4 +856,192 @@ void receive_post (struct Subscription_Post* new_post, struct Send_Post* transfo
             break;
         }
     }
+}
+
+/**
+ * @brief Makes the text of the post, numbers it in its topic, retains it
+ * for the clients that resume from an older sequence and sends it to the
+ * multicast group.
+ * 
+ * @param database - database
+ * @param topic - topic of the post, with subscribers
+ * @param ingested - post
+ */
+static void number_post(struct Database* database, const string &topic,
+                        struct Ingest_Post* ingested) {
+    format_post(&ingested->post, ingested->source, &ingested->text);
+    ingested->size = strlen(ingested->text.content) + 1;
+    ingested->stored_ready = false;
+
+    ingested->log = &*(*database).topic_logs.try_emplace(topic).first;
+    struct Topic_Log &log = ingested->log->second;
+    ingested->sequence = ++log.sequence;
+    if(ingested->sequence > log.reserved) {
+        log.reserved = ingested->sequence + SEQUENCE_RESERVE;
+        journal_sequence((*database).journal, topic, log.reserved);
+    }
+    log_post(&log.retained, ingested->sequence, &ingested->post, ingested->source);
+
+    /*
+        Rate of the topic: a topic is hot for the next second when it had
+        at least BATCH_HOT_RATE posts in the last one
+    */
+    time_t second = time(NULL);
+    if(second != log.window) {
+        log.hot = (log.window == second - 1 && log.window_posts >= BATCH_HOT_RATE);
+        log.window = second;
+        log.window_posts = 0;
+    }
+    log.window_posts ++;
+    ingested->hot = log.hot;
+
+    /*
+        Multicast topic: one datagram for all the multicast clients
+    */
+    if(multicast_topic((*database).multicast, topic) == true) {
+        multicast_post((*database).multicast, ingested->text.content, ingested->size,
+                       ingested->sequence);
+    }
+}
+
+/**
+ * @brief Sends numbered posts of one topic to its connected subscribers
+ * and stores them for the offline subscribers having SF set. The list of
+ * subscribers is walked once: each subscriber is looked up and checked
+ * once, then gets all the posts in their order.
+ * 
+ * @param database - database
+ * @param topic_entry - topic and its subscribers
+ * @param posts - posts of the topic, in the order they were received
+ * @param count - number of posts
+ */
+static void fan_out_posts(struct Database* database,
+                          Topic_Index::iterator topic_entry,
+                          struct Ingest_Post* posts[], int count) {
+    const string &topic = topic_entry->first;
+    int priority = topic_priority(database, topic);
+    bool multicast = multicast_topic((*database).multicast, topic);
+    struct Latency_Tracer *tracer = (*database).tracer;
+    struct Latency_Histogram *histogram = NULL;
+    if(tracer != NULL) {
+        histogram = topic_histogram(tracer, topic.c_str());
+    }
+
+    uint64_t deliveries = 0;
+    for(auto &ID : topic_entry->second.IDs) {
+        auto test = (*database).online.find(ID);
+        if(test->second.online == true && multicast == true && test->second.multicast == true) {
+            continue;
+        } else if(test->second.online == true) {
+            /*
+                A failed delivery means the client left, its disconnection
+                is handled when the server reads its socket.
+            */
+            int socket = test->second.socket_fd;
+            for(int i = 0; i < count; i++) {
+                struct Egress_Mark mark = {posts[i]->ingress_ns, &posts[i]->log->first,
+                                           histogram, TRACE_LIVE, 0};
+                if(posts[i]->hot && test->second.batch_frames) {
+                    batch_post(database, socket, posts[i]->sequence, posts[i]->text.content,
+                               posts[i]->size, priority, (tracer != NULL) ? &mark : NULL);
+                } else {
+                    deliver_frame(database, socket, SUBSCRIPTION_SEND, posts[i]->text.content,
+                                  posts[i]->size, posts[i]->sequence, priority,
+                                  &mark, (tracer != NULL) ? 1 : 0);
+                }
+            }
+        } else if (test->second.subscription_types[topic] == true) {
+            /* The stored form is only made for the first offline client */
+            for(int i = 0; i < count; i++) {
+                if(posts[i]->stored_ready == false) {
+                    store_post(&posts[i]->stored, &posts[i]->log->first, &posts[i]->post,
+                               posts[i]->source, posts[i]->sequence, posts[i]->ingress_ns,
+                               time(NULL));
+                    posts[i]->stored_ready = true;
+                }
+                enqueue_post(database, &test->second, &posts[i]->stored);
+            }
+        } else {
+            continue;
+        }
+        deliveries ++;
+    }
+
+    for(int i = 0; i < count; i++) {
+        posts[i]->fan_out_bytes = deliveries * (posts[i]->size + sizeof(struct Send_Header));
+    }
+}
+
+/**
+ * @brief Transforms the post received from an UDP client (directly or
+ * through a peer server) and sends it to all the connected subscribers of
+ * its topic. For the disconnected users, store the post in their local
+ * queue of posts, that will be emptied once they restore their connection.
+ * 
+ * @param database - database
+ * @param new_post - post from the UDP client
+ * @param source - address of the UDP client
+ * @param ingress_ns - receive time of the datagram
+ * @return bytes of the frames sent and stored (cost of the fan-out)
+ */
+uint64_t publish_post(struct Database* database, struct Subscription_Post* new_post,
+                      struct sockaddr_in source, uint64_t ingress_ns) {
+    struct Topic_Key key;
+    make_topic_key(new_post->topic, &key);
+    auto topic_entry = (*database).subscription.find(key);
+    if(topic_entry == (*database).subscription.end()) {
+        return 0;
+    }
+
+    struct Ingest_Post ingested;
+    ingested.post       = *new_post;
+    ingested.source     = source;
+    ingested.ingress_ns = ingress_ns;
+    struct Ingest_Post *posts[1] = {&ingested};
+    number_post(database, topic_entry->first, &ingested);
+    fan_out_posts(database, topic_entry, posts, 1);
+    return ingested.fan_out_bytes;
+}
+
+void publish_batch(struct Database* database, struct Ingest_Batch* batch) {
+    /*
+        Group the posts by topic, in the order of their first post. A
+        burst is usually for a few hot topics, the groups are searched
+        linearly.
+    */
+    struct Topic_Group {
+        Topic_Index::iterator topic_entry;
+        int count;
+        struct Ingest_Post *posts[INGEST_BATCH_LEN];
+    };
+    static struct Topic_Group groups[INGEST_BATCH_LEN];
+    int group_count = 0;
+
+    for(int i = 0; i < batch->count; i++) {
+        struct Ingest_Post *ingested = &batch->posts[i];
+        ingested->fan_out_bytes = 0;
+        struct Topic_Key key;
+        make_topic_key(ingested->post.topic, &key);
+        auto topic_entry = (*database).subscription.find(key);
+        if(topic_entry == (*database).subscription.end()) {
+            continue;
+        }
+
+        int group = 0;
+        while(group < group_count && groups[group].topic_entry != topic_entry) {
+            group ++;
+        }
+        if(group == group_count) {
+            groups[group_count].topic_entry = topic_entry;
+            groups[group_count].count = 0;
+            group_count ++;
+        }
+        groups[group].posts[groups[group].count ++] = ingested;
+        number_post(database, topic_entry->first, ingested);
+    }
+
+    for(int group = 0; group < group_count; group++) {
+        fan_out_posts(database, groups[group].topic_entry, groups[group].posts,
+                      groups[group].count);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,677 @@
+/**
+ * @file event_loop.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Awaitable operations on the client sockets and the output
+ * queues, driven by the select() loop of the server.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#include "../include/event_loop.h"
+#include "../include/network.h"
+#include "../include/latency.h"
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+/*
+    Share of the output of each class when all of them are backlogged
+    (high, normal, bulk)
+*/
+static const uint64_t class_weights[PRIORITY_CLASSES] = {4, 2, 1};
+static const char *class_names[PRIORITY_CLASSES] = {"high", "normal", "bulk"};
+
+/**
+ * @brief A frame having <marks> was appended to the output of the socket,
+ * which now holds <queued> bytes.
+ */
+static void mark_queued(struct Event_Loop* loop, int socket_fd, const struct Egress_Mark *marks,
+                        int mark_count, size_t queued) {
+    if(mark_count == 0 || loop->tracer == NULL) {
+        return;
+    }
+    struct Egress_Log &log = loop->egress[socket_fd];
+    for(int i = 0; i < mark_count; i++) {
+        log.marks.push_back(marks[i]);
+        log.marks.back().end = log.sent + queued;
+    }
+}
+
+/**
+ * @brief The socket accepted <bytes> of its output: the deliveries whose
+ * frame is now sent are recorded.
+ */
+static void mark_sent(struct Event_Loop* loop, int socket_fd, size_t bytes) {
+    if(loop->egress.empty()) {
+        return;
+    }
+    auto log = loop->egress.find(socket_fd);
+    if(log == loop->egress.end()) {
+        return;
+    }
+    log->second.sent += bytes;
+    uint64_t now = now_ns();
+    deque<struct Egress_Mark> &marks = log->second.marks;
+    while(!marks.empty() && marks.front().end <= log->second.sent) {
+        struct Egress_Mark &mark = marks.front();
+        record_latency(loop->tracer, mark.histogram, mark.topic->c_str(), mark.ingress_ns,
+                       now, socket_fd, mark.kind);
+        marks.pop_front();
+    }
+    if(marks.empty()) {
+        loop->egress.erase(log);
+    }
+}
+
+/**
+ * @brief A frame having <marks> was written in the ring of the socket:
+ * the subscriber can read it now.
+ */
+static void mark_written(struct Event_Loop* loop, int socket_fd, const struct Egress_Mark *marks,
+                         int mark_count) {
+    if(mark_count == 0 || loop->tracer == NULL) {
+        return;
+    }
+    uint64_t now = now_ns();
+    for(int i = 0; i < mark_count; i++) {
+        record_latency(loop->tracer, marks[i].histogram, marks[i].topic->c_str(),
+                       marks[i].ingress_ns, now, socket_fd, marks[i].kind);
+    }
+}
+
+/**
+ * @brief Sends as much of the output of the socket as it accepts. On
+ * error the output is dropped, the reader of the socket handles the
+ * disconnection.
+ */
+static void flush_output(struct Event_Loop* loop, int socket_fd, string &output) {
+    ssize_t sent = send(socket_fd, output.data(), output.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    loop->writes ++;
+    if(sent > 0) {
+        loop->written += sent;
+        output.erase(0, sent);
+        mark_sent(loop, socket_fd, sent);
+    } else if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        loop->output.erase(socket_fd);
+        loop->egress.erase(socket_fd);
+    }
+}
+
+/**
+ * @brief Forgets the pending frames of a socket.
+ */
+static void drop_pending(struct Event_Loop* loop, int socket_fd) {
+    if(loop->pending.erase(socket_fd) == 0) {
+        return;
+    }
+    for(int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        erase(loop->active[priority], socket_fd);
+    }
+}
+
+/**
+ * @brief The held output of the socket is released: the time each frame
+ * was held is added to the delays of its class.
+ *
+ * @return the next held output
+ */
+static unordered_map<int, struct Held_Output>::iterator
+release_held(struct Event_Loop* loop, unordered_map<int, struct Held_Output>::iterator held,
+             uint64_t now) {
+    for(struct Held_Frame &frame : held->second.frames) {
+        add_latency(&loop->delays[frame.priority],
+                    (now > frame.queued_ns) ? now - frame.queued_ns : 0);
+    }
+    return loop->held.erase(held);
+}
+
+void shut_down_client(struct Event_Loop* loop, int socket_fd) {
+    loop->output[socket_fd].clear();
+    loop->egress.erase(socket_fd);
+    drop_pending(loop, socket_fd);
+    shutdown(socket_fd, SHUT_RDWR);
+}
+
+/**
+ * @brief Appends the frame to the queue of its class.
+ *
+ * @return false - the client exceeded MAX_CLIENT_OUTPUT
+ */
+static bool pend_frame(struct Event_Loop* loop, int socket_fd, struct Send_Header *header,
+                       const char *body, int size, int priority,
+                       const struct Egress_Mark *marks, int mark_count) {
+    struct Pending_Output &pending = loop->pending[socket_fd];
+    struct Class_Queue &queue = pending.classes[priority];
+    if(queue.frames.empty()) {
+        loop->active[priority].push_back(socket_fd);
+    }
+
+    queue.frames.push_back(Pending_Frame{now_ns(), string(), {}});
+    if(loop->tracer != NULL) {
+        queue.frames.back().marks.assign(marks, marks + mark_count);
+    }
+    string &bytes = queue.frames.back().bytes;
+    bytes.reserve(sizeof(struct Send_Header) + size);
+    bytes.append((const char *) header, sizeof(struct Send_Header));
+    bytes.append(body, size);
+    pending.bytes += bytes.size();
+
+    if(loop->output[socket_fd].size() + pending.bytes > MAX_CLIENT_OUTPUT) {
+        shut_down_client(loop, socket_fd);
+        return false;
+    }
+    return true;
+}
+
+Async async_recv_all(struct Event_Loop* loop, int socket_fd, void *buffer, size_t length) {
+    char *position = (char *) buffer;
+    while(length > 0) {
+        ssize_t received = recv(socket_fd, position, length, MSG_DONTWAIT);
+        if(received == 0) {
+            co_return false;
+        }
+        if(received < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                co_await Wait_Readable{loop, socket_fd};
+                continue;
+            }
+            if(errno == EINTR) {
+                continue;
+            }
+            co_return false;
+        }
+        position += received;
+        length -= received;
+        loop->partial.insert(socket_fd);
+    }
+    loop->partial.erase(socket_fd);
+    co_return true;
+}
+
+Async async_recv_frame(struct Event_Loop* loop, int socket_fd, struct Send_Header *header,
+                       vector<char> &body, int max_size) {
+    /*
+        The results of co_await are always stored before being tested:
+        g++ 12 loses the suspension of a co_await inside a condition.
+    */
+    bool received = co_await async_recv_all(loop, socket_fd, header, sizeof(struct Send_Header));
+    if(received == false || header->size < 0 || header->size > max_size) {
+        co_return false;
+    }
+
+    /* The header alone is part of a frame */
+    if(header->size > 0) {
+        loop->partial.insert(socket_fd);
+    }
+    body.resize(header->size + 1);
+    body[header->size] = '\0';
+    received = co_await async_recv_all(loop, socket_fd, body.data(), header->size);
+    co_return received;
+}
+
+Async async_send_frame(struct Event_Loop* loop, int socket_fd, int operation,
+                       const char *body, int size) {
+    if(queue_frame(loop, socket_fd, operation, body, size, 0) == false) {
+        co_return false;
+    }
+
+    /* The frames waited for are not held */
+    auto held = loop->held.find(socket_fd);
+    if(held != loop->held.end()) {
+        release_held(loop, held, now_ns());
+        auto output = loop->output.find(socket_fd);
+        flush_output(loop, socket_fd, output->second);
+    }
+    co_await Wait_Flushed{loop, socket_fd};
+
+    /* The output is dropped when the socket fails */
+    co_return loop->output.count(socket_fd) != 0 || loop->rings.count(socket_fd) != 0;
+}
+
+/**
+ * @brief Writes the frame in the ring of the socket if nothing waits
+ * before it and the ring has space, otherwise the frame waits in the
+ * queue of its class.
+ *
+ * @return false - the frame is larger than the ring, or the client
+ * exceeded MAX_CLIENT_OUTPUT
+ */
+static bool queue_ring_frame(struct Event_Loop* loop, int socket_fd, struct Shared_Ring* ring,
+                             struct Send_Header *header, const char *body, int size,
+                             int priority, const struct Egress_Mark *marks, int mark_count) {
+    if(sizeof(struct Send_Header) + size > ring->header->capacity) {
+        return false;
+    }
+    if(loop->pending.empty() || loop->pending.count(socket_fd) == 0) {
+        struct iovec parts[2];
+        parts[0].iov_base = header;
+        parts[0].iov_len  = sizeof(struct Send_Header);
+        parts[1].iov_base = (void *) body;
+        parts[1].iov_len  = size;
+        if(ring_try_write(ring, parts, 2)) {
+            add_latency(&loop->delays[priority], 0);
+            mark_written(loop, socket_fd, marks, mark_count);
+            return true;
+        }
+    }
+    return pend_frame(loop, socket_fd, header, body, size, priority, marks, mark_count);
+}
+
+bool queue_frame(struct Event_Loop* loop, int socket_fd, int operation,
+                 const char *body, int size, uint64_t sequence, int priority,
+                 const struct Egress_Mark *marks, int mark_count) {
+    struct Send_Header header;
+    header.operation    = operation;
+    header.size         = size;
+    header.sequence     = sequence;
+
+    loop->frames ++;
+    if(!loop->rings.empty()) {
+        auto ring = loop->rings.find(socket_fd);
+        if(ring != loop->rings.end()) {
+            return queue_ring_frame(loop, socket_fd, ring->second, &header, body, size,
+                                    priority, marks, mark_count);
+        }
+    }
+
+    string &output = loop->output[socket_fd];
+    if(!loop->pending.empty() && loop->pending.count(socket_fd) != 0) {
+        /*
+            Backlogged client - the frame waits behind the ones of its
+            class only
+        */
+        return pend_frame(loop, socket_fd, &header, body, size, priority, marks, mark_count);
+    }
+    if(loop->coalesce_ns != 0 && (output.empty() || loop->held.count(socket_fd) != 0)) {
+        /*
+            Write coalescing - the frame waits for the next ones
+        */
+        uint64_t now = now_ns();
+        struct Held_Output &held = loop->held[socket_fd];
+        if(output.empty()) {
+            held.deadline = now + loop->coalesce_ns;
+            held.frames.clear();
+        }
+        held.frames.push_back(Held_Frame{priority, now});
+        output.append((const char *) &header, sizeof(struct Send_Header));
+        output.append(body, size);
+        mark_queued(loop, socket_fd, marks, mark_count, output.size());
+        if(output.size() >= COALESCE_MAX_BYTES) {
+            release_held(loop, loop->held.find(socket_fd), now);
+            flush_output(loop, socket_fd, output);
+            return loop->output.count(socket_fd) != 0;
+        }
+        return true;
+    } else if(!output.empty()) {
+        return pend_frame(loop, socket_fd, &header, body, size, priority, marks, mark_count);
+    } else {
+        /*
+            Nothing queued before it: try the socket first, only the part
+            it does not accept is copied.
+        */
+        add_latency(&loop->delays[priority], 0);
+        struct iovec parts[2];
+        parts[0].iov_base = &header;
+        parts[0].iov_len  = sizeof(struct Send_Header);
+        parts[1].iov_base = (void *) body;
+        parts[1].iov_len  = size;
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(struct msghdr));
+        message.msg_iov     = parts;
+        message.msg_iovlen  = 2;
+
+        ssize_t sent = sendmsg(socket_fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+        loop->writes ++;
+        if(sent < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                return false;
+            }
+            sent = 0;
+        }
+        mark_queued(loop, socket_fd, marks, mark_count, sizeof(struct Send_Header) + size);
+        if(sent > 0) {
+            loop->written += sent;
+            mark_sent(loop, socket_fd, sent);
+        }
+        if((size_t) sent < sizeof(struct Send_Header)) {
+            output.append((const char *) &header + sent, sizeof(struct Send_Header) - sent);
+            output.append(body, size);
+        } else {
+            sent -= sizeof(struct Send_Header);
+            output.append(body + sent, size - sent);
+        }
+    }
+
+    if(output.size() > MAX_CLIENT_OUTPUT) {
+        shut_down_client(loop, socket_fd);
+        return false;
+    }
+    return true;
+}
+
+bool schedule_output(struct Event_Loop* loop) {
+    if(loop->pending.empty()) {
+        return false;
+    }
+
+    uint64_t now = now_ns();
+    uint64_t budget = SCHEDULE_BUDGET;
+    vector<coroutine_handle<>> ready;
+
+    /*
+        A round gives every active socket of a class its quantum, the
+        classes in order; the rounds go on while a socket can take frames
+    */
+    bool served = true;
+    while(served && budget > 0 && !loop->pending.empty()) {
+        served = false;
+        for(int priority = 0; priority < PRIORITY_CLASSES && budget > 0; priority++) {
+            deque<int> &active = loop->active[priority];
+            for(size_t turns = active.size(); turns > 0 && budget > 0; turns--) {
+                int socket_fd = active.front();
+                active.pop_front();
+
+                struct Pending_Output &pending = loop->pending[socket_fd];
+                struct Class_Queue &queue = pending.classes[priority];
+                string &output = loop->output[socket_fd];
+                bool idle = output.empty();
+
+                /*
+                    The frames of a ring go in the ring while it has space,
+                    the others in the output while it is below the low
+                    water
+                */
+                struct Shared_Ring *ring = NULL;
+                if(!loop->rings.empty()) {
+                    auto found = loop->rings.find(socket_fd);
+                    ring = (found == loop->rings.end()) ? NULL : found->second;
+                }
+
+                /*
+                    A socket that did not send its output keeps its turn
+                    but gains no deficit
+                */
+                if((ring == NULL) ? output.size() < SCHEDULE_LOW_WATER
+                                  : ring_free_space(ring) >= queue.frames.front().bytes.size()) {
+                    served = true;
+                    queue.deficit += SCHEDULE_QUANTUM * class_weights[priority];
+                }
+                while(!queue.frames.empty() && queue.frames.front().bytes.size() <= queue.deficit) {
+                    struct Pending_Frame &frame = queue.frames.front();
+                    uint64_t size = frame.bytes.size();
+                    if(ring != NULL) {
+                        struct iovec part = {frame.bytes.data(), size};
+                        if(ring_try_write(ring, &part, 1) == false) {
+                            break;
+                        }
+                        mark_written(loop, socket_fd, frame.marks.data(), frame.marks.size());
+                    } else if(output.size() < SCHEDULE_LOW_WATER) {
+                        output.append(frame.bytes);
+                        mark_queued(loop, socket_fd, frame.marks.data(), frame.marks.size(),
+                                    output.size());
+                    } else {
+                        break;
+                    }
+                    add_latency(&loop->delays[priority],
+                                (now > frame.queued_ns) ? now - frame.queued_ns : 0);
+                    queue.deficit -= size;
+                    pending.bytes -= size;
+                    budget -= min(budget, size);
+                    queue.frames.pop_front();
+                }
+
+                if(queue.frames.empty()) {
+                    queue.deficit = 0;
+                } else {
+                    active.push_back(socket_fd);
+                }
+                if(pending.bytes == 0) {
+                    loop->pending.erase(socket_fd);
+                }
+
+                if(idle && (ring != NULL || !output.empty())) {
+                    if(ring == NULL) {
+                        flush_output(loop, socket_fd, output);
+                    }
+                    auto left = loop->output.find(socket_fd);
+                    auto waiting = loop->flushed.find(socket_fd);
+                    if((left == loop->output.end() || left->second.empty()) &&
+                       waiting != loop->flushed.end() && loop->pending.count(socket_fd) == 0) {
+                        ready.push_back(waiting->second);
+                        loop->flushed.erase(waiting);
+                    }
+                }
+            }
+        }
+    }
+
+    for(auto &coroutine : ready) {
+        coroutine.resume();
+    }
+    return budget == 0 && !loop->pending.empty();
+}
+
+bool rings_backlogged(struct Event_Loop* loop) {
+    if(loop->rings.empty() || loop->pending.empty()) {
+        return false;
+    }
+    for(auto &ring : loop->rings) {
+        if(loop->pending.count(ring.first) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int parse_priority_class(const char *name) {
+    for(int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        if(strcmp(name, class_names[priority]) == 0) {
+            return priority;
+        }
+    }
+    return -1;
+}
+
+void watch_events(struct Event_Loop* loop, fd_set *read_fds, fd_set *write_fds,
+                  int *max_fds) {
+    for(auto &reader : loop->readers) {
+        FD_SET(reader.first, read_fds);
+        *max_fds = max(*max_fds, reader.first);
+    }
+    for(auto &output : loop->output) {
+        if(!output.second.empty() && loop->held.count(output.first) == 0) {
+            FD_SET(output.first, write_fds);
+            *max_fds = max(*max_fds, output.first);
+        }
+    }
+}
+
+void resume_ready(struct Event_Loop* loop, fd_set *read_fds, fd_set *write_fds) {
+    /*
+        The resumed coroutines change the maps, so the ready ones are
+        collected first
+    */
+    vector<coroutine_handle<>> ready;
+
+    for(auto output = loop->output.begin(); output != loop->output.end();) {
+        int socket_fd = output->first;
+        if(output->second.empty() || !FD_ISSET(socket_fd, write_fds)) {
+            output ++;
+            continue;
+        }
+        FD_CLR(socket_fd, write_fds);
+
+        auto next = std::next(output);
+        flush_output(loop, socket_fd, output->second);
+        auto left = loop->output.find(socket_fd);
+        if((left == loop->output.end() || left->second.empty()) &&
+           loop->pending.count(socket_fd) == 0) {
+            auto waiting = loop->flushed.find(socket_fd);
+            if(waiting != loop->flushed.end()) {
+                ready.push_back(waiting->second);
+                loop->flushed.erase(waiting);
+            }
+        }
+        output = next;
+    }
+
+    for(auto reader = loop->readers.begin(); reader != loop->readers.end();) {
+        if(FD_ISSET(reader->first, read_fds)) {
+            FD_CLR(reader->first, read_fds);
+            ready.push_back(reader->second);
+            reader = loop->readers.erase(reader);
+        } else {
+            reader ++;
+        }
+    }
+
+    for(auto &coroutine : ready) {
+        coroutine.resume();
+    }
+}
+
+void flush_held(struct Event_Loop* loop, uint64_t now) {
+    uint64_t released = (now == UINT64_MAX) ? now_ns() : now;
+    for(auto held = loop->held.begin(); held != loop->held.end();) {
+        if(held->second.deadline > now) {
+            held ++;
+            continue;
+        }
+        int socket_fd = held->first;
+        held = release_held(loop, held, released);
+
+        auto output = loop->output.find(socket_fd);
+        if(output != loop->output.end() && !output->second.empty()) {
+            flush_output(loop, socket_fd, output->second);
+        }
+    }
+}
+
+void print_output_stats(struct Event_Loop* loop) {
+    cout << "Output: " << loop->frames << " frames in " << loop->writes << " writes";
+    if(loop->writes != 0) {
+        cout << " (" << loop->written / loop->writes << " bytes per write)";
+    }
+    cout << "." << endl;
+
+    for(int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        struct Latency_Histogram *delays = &loop->delays[priority];
+        if(delays->count == 0) {
+            continue;
+        }
+        cout << "Delay " << class_names[priority] << ": " << delays->count << " frames, avg "
+             << delays->total / delays->count / 1000 << "us, p50 "
+             << histogram_percentile(delays, 50) / 1000 << "us, p99 "
+             << histogram_percentile(delays, 99) / 1000 << "us, max "
+             << delays->max / 1000 << "us" << endl;
+    }
+}
+
+/**
+ * @brief Writes the pending frames of a ring, waiting for the subscriber
+ * until <deadline> (ms, CLOCK_MONOTONIC). A subscriber that does not
+ * free space in time is shut down.
+ */
+static void drain_ring(struct Event_Loop* loop, int socket_fd, struct Shared_Ring* ring,
+                       struct Pending_Output &pending, int64_t deadline) {
+    for(int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        for(struct Pending_Frame &frame : pending.classes[priority].frames) {
+            struct iovec part = {frame.bytes.data(), frame.bytes.size()};
+            while(ring_try_write(ring, &part, 1) == false) {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if(now.tv_sec * 1000LL + now.tv_nsec / 1000000 >= deadline) {
+                    shutdown(socket_fd, SHUT_RDWR);
+                    return;
+                }
+                struct timespec pause = {0, RING_RETRY_NS};
+                nanosleep(&pause, NULL);
+            }
+            mark_written(loop, socket_fd, frame.marks.data(), frame.marks.size());
+        }
+    }
+}
+
+void drain_output(struct Event_Loop* loop) {
+    uint64_t released = now_ns();
+    for(auto held = loop->held.begin(); held != loop->held.end();) {
+        held = release_held(loop, held, released);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t deadline = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + DRAIN_TIMEOUT_MS;
+
+    /*
+        The pending frames follow the output, the high class first. The
+        frames of a ring are written as the subscriber frees space.
+    */
+    for(auto &pending : loop->pending) {
+        auto ring = loop->rings.find(pending.first);
+        if(ring != loop->rings.end()) {
+            drain_ring(loop, pending.first, ring->second, pending.second, deadline);
+            continue;
+        }
+        string &output = loop->output[pending.first];
+        for(int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+            for(struct Pending_Frame &frame : pending.second.classes[priority].frames) {
+                output.append(frame.bytes);
+                mark_queued(loop, pending.first, frame.marks.data(), frame.marks.size(),
+                            output.size());
+            }
+        }
+    }
+    loop->pending.clear();
+    for(int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        loop->active[priority].clear();
+    }
+
+    for(auto &output : loop->output) {
+        string &pending = output.second;
+        while(!pending.empty()) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t left = deadline - (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+            struct pollfd writable = {output.first, POLLOUT, 0};
+            if(left <= 0 || poll(&writable, 1, left) <= 0) {
+                break;
+            }
+            ssize_t sent = send(output.first, pending.data(), pending.size(),
+                                MSG_DONTWAIT | MSG_NOSIGNAL);
+            if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                break;
+            }
+            if(sent > 0) {
+                pending.erase(0, sent);
+                mark_sent(loop, output.first, sent);
+            }
+        }
+
+        /*
+            A client that does not take its frames in time may have
+            received half of a frame: it is disconnected (and may resume
+            from its sequences)
+        */
+        if(!pending.empty()) {
+            shutdown(output.first, SHUT_RDWR);
+        }
+    }
+    loop->output.clear();
+    loop->egress.clear();
+}
+
+void forget_socket(struct Event_Loop* loop, int socket_fd) {
+    loop->readers.erase(socket_fd);
+    loop->partial.erase(socket_fd);
+    loop->flushed.erase(socket_fd);
+    loop->output.erase(socket_fd);
+    loop->held.erase(socket_fd);
+    loop->egress.erase(socket_fd);
+    loop->rings.erase(socket_fd);
+    drop_pending(loop, socket_fd);
+}
@@ -0,0 +1,469 @@
+/**
+ * @file federation.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Links between servers. Every server tells its peers for which
+ * topics it has subscribers and forwards the posts received from its UDP
+ * clients only to the interested peers, in one batch per peer and per
+ * iteration of the loop, sent without waiting for the peer.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/federation.h"
+#include "../include/database.h"
+#include "../include/network.h"
+#include "../include/command_parser.h"
+#include "../include/admission.h"
+#include "../include/event_loop.h"
+#include <errno.h>
+#include <poll.h>
+
+using namespace std;
+
+/*
+    | LENGTH | IP | PORT | INGRESS |  - header of a forwarded post in a batch
+
+    <INGRESS> = receive time of the datagram on the first server (ns)
+*/
+#define PEER_RECORD_LEN     16
+
+void init_federation(struct Federation* federation, int port,
+                     const vector<string> &addresses) {
+    federation->port        = port;
+    federation->forwarded   = 0;
+    federation->received    = 0;
+    federation->malformed   = 0;
+    federation->loop        = NULL;
+
+    for(auto &address : addresses) {
+        struct Peer peer;
+        peer.socket_fd  = -1;
+        peer.connecting = false;
+        peer.address    = address;
+        peer.name       = address;
+        peer.next_retry = 0;
+        federation->peers.push_back(peer);
+    }
+}
+
+/**
+ * @brief Queues the whole interest of this server for a new link: every
+ * topic having at least one subscriber.
+ */
+static void announce_all_topics(struct Peer* peer, struct Database* database) {
+    for(auto &topic : (*database).subscription) {
+        peer->interest += '+';
+        peer->interest += topic.first;
+        peer->interest += '\n';
+    }
+}
+
+/**
+ * @brief Closes the link. Configured peers are reconnected later, peers
+ * that connected to this server are forgotten.
+ */
+static void close_peer(struct Federation* federation, struct Peer* peer) {
+    cout << "Peer " << peer->name << " disconnected." << endl;
+
+    close(peer->socket_fd);
+    peer->socket_fd = -1;
+    peer->topics.clear();
+    peer->output.clear();
+    peer->batch.clear();
+    peer->interest.clear();
+    peer->next_retry = time(NULL) + PEER_RETRY_INTERVAL;
+
+    if(peer->address.empty()) {
+        federation->peers.erase(federation->peers.begin() + (peer - federation->peers.data()));
+    }
+}
+
+/*
+    Frames of the peer protocol (defined below)
+*/
+static void receive_interest(struct Peer* peer, const char *body, int size);
+static void receive_posts(struct Federation* federation, struct Database* database,
+                          const char *body, int size);
+static void append_frame(struct Peer* peer, int operation, const char *body, int size);
+
+/**
+ * @brief Coroutine of a link: receives the frames of the peer, suspending
+ * while its socket has no data, until the link is closed. The peer is
+ * looked up by socket for every frame, the links accepted meanwhile may
+ * move the peers.
+ */
+static Task peer_link(struct Federation* federation, struct Database* database, int socket_fd) {
+    struct Send_Header header;
+    vector<char> body;
+
+    while(1) {
+        bool received = co_await async_recv_frame(federation->loop, socket_fd, &header, body,
+                                                  MAX_BULK_LEN);
+        if(received == false) {
+            break;
+        }
+        struct Peer* peer = find_peer(federation, socket_fd);
+        if(header.operation == PEER_INTEREST_CODE) {
+            receive_interest(peer, body.data(), header.size);
+        } else if(header.operation == PEER_POSTS_CODE) {
+            receive_posts(federation, database, body.data(), header.size);
+        }
+    }
+    forget_socket(federation->loop, socket_fd);
+    close_peer(federation, find_peer(federation, socket_fd));
+}
+
+/**
+ * @brief Checks the connect() in progress of a peer. Once the socket is
+ * writable the link is open: the PEER_HELLO and the interest of this
+ * server go first in its output and its frames are received by a
+ * coroutine.
+ *
+ * @return false - the peer could not be reached
+ */
+static bool finish_connect(struct Federation* federation, struct Database* database,
+                           struct Peer* peer) {
+    struct pollfd writable = {peer->socket_fd, POLLOUT, 0};
+    if(poll(&writable, 1, 0) <= 0) {
+        return true;
+    }
+    int error = 0;
+    socklen_t length = sizeof(int);
+    if(getsockopt(peer->socket_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        return false;
+    }
+
+    int neagle = 1;
+    setsockopt(peer->socket_fd, IPPROTO_TCP, TCP_NODELAY, &neagle, sizeof(int));
+
+    peer->connecting = false;
+    string hello = to_string(federation->port);
+    append_frame(peer, PEER_HELLO_CODE, hello.c_str(), hello.size() + 1);
+    peer->interest.clear();
+    announce_all_topics(peer, database);
+    cout << "Connected to peer " << peer->name << "." << endl;
+    peer_link(federation, database, peer->socket_fd);
+    return true;
+}
+
+/**
+ * @brief Opens the links with the configured peers that are not connected,
+ * without blocking: connect() goes on in the kernel and the peers whose
+ * connect is in progress are added to <write_fds>, they are checked at the
+ * next call. A peer that cannot be reached is retried after
+ * PEER_RETRY_INTERVAL.
+ * 
+ * @param federation federation
+ * @param database database
+ * @param write_fds set of the select
+ * @param max_fds maximum descriptor in the set
+ * @return the time of the next retry, 0 if there is nothing to retry
+ */
+time_t connect_peers(struct Federation* federation, struct Database* database,
+                     fd_set *write_fds, int *max_fds) {
+    time_t now = time(NULL);
+    time_t next_retry = 0;
+
+    for(auto &peer : federation->peers) {
+        if(peer.connecting) {
+            if(finish_connect(federation, database, &peer) == false) {
+                close(peer.socket_fd);
+                peer.socket_fd  = -1;
+                peer.connecting = false;
+                peer.next_retry = now + PEER_RETRY_INTERVAL;
+                next_retry = (next_retry == 0) ? peer.next_retry : min(next_retry, peer.next_retry);
+            } else if(peer.connecting) {
+                FD_SET(peer.socket_fd, write_fds);
+                *max_fds = max(*max_fds, peer.socket_fd);
+            }
+            continue;
+        }
+        if(peer.socket_fd >= 0 || peer.address.empty()) {
+            continue;
+        }
+        if(peer.next_retry > now) {
+            next_retry = (next_retry == 0) ? peer.next_retry : min(next_retry, peer.next_retry);
+            continue;
+        }
+
+        /*
+            Parse IP:PORT
+        */
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(struct sockaddr_in));
+        address.sin_family = AF_INET;
+        size_t separator = peer.address.find(':');
+        string IP = peer.address.substr(0, separator);
+        if(separator == string::npos || inet_aton(IP.c_str(), &address.sin_addr) == 0) {
+            continue;
+        }
+        address.sin_port = htons(atoi(peer.address.c_str() + separator + 1));
+
+        /*
+            The socket stays non-blocking, the loop and flush_peers never
+            wait on it
+        */
+        int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        DIE(socket_fd < 0, "Cannot open socket for peer.");
+        if(connect(socket_fd, (struct sockaddr *) &address, sizeof(struct sockaddr_in)) < 0 &&
+           errno != EINPROGRESS) {
+            close(socket_fd);
+            peer.next_retry = now + PEER_RETRY_INTERVAL;
+            next_retry = (next_retry == 0) ? peer.next_retry : min(next_retry, peer.next_retry);
+            continue;
+        }
+        peer.socket_fd  = socket_fd;
+        peer.connecting = true;
+        FD_SET(socket_fd, write_fds);
+        *max_fds = max(*max_fds, socket_fd);
+    }
+    return next_retry;
+}
+
+/**
+ * @brief Registers a link opened by another server. A second link with the
+ * same server is refused, a configured peer adopts the link instead of
+ * connecting itself.
+ * 
+ * @param federation federation
+ * @param database database
+ * @param socket_fd accepted socket
+ * @param address address of the other server
+ * @param port body of its PEER_HELLO - port of the other server
+ */
+void accept_peer(struct Federation* federation, struct Database* database,
+                 int socket_fd, struct sockaddr_in address, const char *port) {
+    char IP[IP_LEN];
+    inet_ntop(AF_INET, &address.sin_addr, IP, IP_LEN);
+    string name = string(IP) + ":" + port;
+
+    struct Peer* peer = NULL;
+    for(auto &other : federation->peers) {
+        if(other.name == name) {
+            peer = &other;
+        }
+    }
+    if(peer != NULL && peer->socket_fd >= 0) {
+        cout << "Peer " << name << " already connected." << endl;
+        close(socket_fd);
+        return;
+    }
+    if(peer == NULL) {
+        struct Peer new_peer;
+        new_peer.socket_fd  = -1;
+        new_peer.connecting = false;
+        new_peer.name       = name;
+        new_peer.next_retry = 0;
+        federation->peers.push_back(new_peer);
+        peer = &federation->peers.back();
+    }
+
+    peer->socket_fd = socket_fd;
+    announce_all_topics(peer, database);
+    cout << "New peer " << name << " connected." << endl;
+    peer_link(federation, database, socket_fd);
+}
+
+struct Peer* find_peer(struct Federation* federation, int socket_fd) {
+    for(auto &peer : federation->peers) {
+        if(peer.socket_fd == socket_fd && peer.connecting == false) {
+            return &peer;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Updates the interest of the peer from "+topic" / "-topic" lines.
+ */
+static void receive_interest(struct Peer* peer, const char *body, int size) {
+    const char *cursor = body;
+    struct Token line;
+
+    while(next_line(&cursor, body + size, &line) == true) {
+        if(line.length < 2) {
+            continue;
+        }
+        string topic(line.start + 1, line.length - 1);
+        if(line.start[0] == '+') {
+            peer->topics.insert(topic);
+        } else if(line.start[0] == '-') {
+            peer->topics.erase(topic);
+        }
+    }
+}
+
+/**
+ * @brief Delivers every valid post of a batch to the local subscribers,
+ * with the address of the UDP client that published it.
+ */
+static void receive_posts(struct Federation* federation, struct Database* database,
+                          const char *body, int size) {
+    const char *p = body;
+    const char *end = body + size;
+
+    while(end - p >= PEER_RECORD_LEN) {
+        uint16_t length;
+        uint64_t ingress_ns;
+        struct sockaddr_in source;
+        memset(&source, 0, sizeof(struct sockaddr_in));
+        source.sin_family = AF_INET;
+
+        memcpy(&length, p, sizeof(uint16_t));
+        memcpy(&source.sin_addr.s_addr, p + 2, sizeof(uint32_t));
+        memcpy(&source.sin_port, p + 6, sizeof(uint16_t));
+        memcpy(&ingress_ns, p + 8, sizeof(uint64_t));
+        p += PEER_RECORD_LEN;
+        if(length > end - p || length > sizeof(struct Subscription_Post)) {
+            return;
+        }
+
+        struct Subscription_Post post;
+        memset(&post, 0, sizeof(struct Subscription_Post));
+        memcpy(&post, p, length);
+        p += length;
+
+        /* A peer is checked like any UDP client */
+        if(valid_datagram(&post, length) == false) {
+            federation->malformed ++;
+            continue;
+        }
+        federation->received ++;
+        publish_post(database, &post, source, ingress_ns);
+    }
+}
+
+void federation_topic_added(struct Federation* federation, const string &topic) {
+    if(federation == NULL) {
+        return;
+    }
+    for(auto &peer : federation->peers) {
+        if(peer.socket_fd >= 0 && peer.connecting == false) {
+            peer.interest += '+';
+            peer.interest += topic;
+            peer.interest += '\n';
+        }
+    }
+}
+
+void federation_topic_removed(struct Federation* federation, const string &topic) {
+    if(federation == NULL) {
+        return;
+    }
+    for(auto &peer : federation->peers) {
+        if(peer.socket_fd >= 0 && peer.connecting == false) {
+            peer.interest += '-';
+            peer.interest += topic;
+            peer.interest += '\n';
+        }
+    }
+}
+
+/**
+ * @brief Appends a frame (header + body) to the output of the peer.
+ */
+static void append_frame(struct Peer* peer, int operation, const char *body, int size) {
+    struct Send_Header header;
+    header.operation    = operation;
+    header.size         = size;
+    header.sequence     = 0;
+
+    const char *p = (const char *) &header;
+    peer->output.insert(peer->output.end(), p, p + sizeof(struct Send_Header));
+    peer->output.insert(peer->output.end(), body, body + size);
+}
+
+/**
+ * @brief Appends the post to the batches of the interested peers. The
+ * topic is only looked up in the interest of each peer, the post is
+ * forwarded as it was received, the peer formats it for its subscribers.
+ * 
+ * @param federation federation
+ * @param post post from the UDP client
+ * @param length received bytes
+ * @param source address of the UDP client
+ * @param ingress_ns receive time of the datagram
+ */
+void forward_post(struct Federation* federation, struct Subscription_Post* post,
+                  int length, struct sockaddr_in source, uint64_t ingress_ns) {
+    if(federation->peers.empty() || length <= 0) {
+        return;
+    }
+
+    string topic(post->topic, strnlen(post->topic, TOPIC_LEN));
+    uint16_t record_length = length;
+
+    for(auto &peer : federation->peers) {
+        if(peer.socket_fd < 0 || peer.topics.find(topic) == peer.topics.end()) {
+            continue;
+        }
+
+        char record[PEER_RECORD_LEN];
+        memcpy(record, &record_length, sizeof(uint16_t));
+        memcpy(record + 2, &source.sin_addr.s_addr, sizeof(uint32_t));
+        memcpy(record + 6, &source.sin_port, sizeof(uint16_t));
+        memcpy(record + 8, &ingress_ns, sizeof(uint64_t));
+        peer.batch.insert(peer.batch.end(), record, record + PEER_RECORD_LEN);
+        peer.batch.insert(peer.batch.end(), (char *) post, (char *) post + length);
+        federation->forwarded ++;
+
+        if(peer.batch.size() >= MAX_PEER_BATCH) {
+            append_frame(&peer, PEER_POSTS_CODE, peer.batch.data(), peer.batch.size());
+            peer.batch.clear();
+        }
+    }
+}
+
+/**
+ * @brief Packs the interest changes and the batch of each peer in one frame
+ * each and sends as much of the output as the socket accepts. The server
+ * goes on with the next iteration instead of waiting for a slow peer; a
+ * peer whose output exceeds MAX_PEER_OUTPUT is shut down, its coroutine
+ * then sees the end of the link and closes it.
+ * 
+ * @param federation federation
+ * @param write_fds result - peers with output left
+ * @param max_fds maximum descriptor in the set
+ */
+void flush_peers(struct Federation* federation, fd_set *write_fds, int *max_fds) {
+    for(auto &peer : federation->peers) {
+        if(peer.socket_fd < 0 || peer.connecting) {
+            continue;
+        }
+
+        if(!peer.interest.empty()) {
+            append_frame(&peer, PEER_INTEREST_CODE, peer.interest.data(), peer.interest.size());
+            peer.interest.clear();
+        }
+        if(!peer.batch.empty()) {
+            append_frame(&peer, PEER_POSTS_CODE, peer.batch.data(), peer.batch.size());
+            peer.batch.clear();
+        }
+        if(peer.output.empty()) {
+            continue;
+        }
+
+        ssize_t sent = send(peer.socket_fd, peer.output.data(), peer.output.size(),
+                            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            peer.output.clear();
+            shutdown(peer.socket_fd, SHUT_RDWR);
+            continue;
+        }
+        if(sent > 0) {
+            peer.output.erase(peer.output.begin(), peer.output.begin() + sent);
+        }
+
+        if(peer.output.size() > MAX_PEER_OUTPUT) {
+            peer.output.clear();
+            shutdown(peer.socket_fd, SHUT_RDWR);
+            continue;
+        }
+        if(!peer.output.empty()) {
+            FD_SET(peer.socket_fd, write_fds);
+            *max_fds = max(*max_fds, peer.socket_fd);
+        }
+    }
+}
@@ -0,0 +1,208 @@
+/**
+ * @file handover.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Hot restart: the running server passes its UDP socket, TCP
+ * listener, the sockets of the connected clients and the serialized
+ * Database to a new server process over a Unix domain socket.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/handover.h"
+#include "../include/snapshot.h"
+#include "../include/network.h"
+#include "../include/command_parser.h"
+#include "../include/constants.h"
+
+using namespace std;
+
+/*
+    The login flags of a connection (ID_BATCH_FLAG, ID_MULTICAST_FLAG,
+    ID_HEARTBEAT_FLAG) are handed over with the ID of the client
+    ("<flags> <ID>" lines): they belong to the connection, not to the
+    snapshot of the Database. HANDOVER_RING_FLAG - the client has a shared
+    memory ring, its memfd and eventfd follow the client sockets.
+*/
+#define HANDOVER_RING_FLAG  0x10000
+
+/**
+ * @brief Sends the Database, the IDs of the connected clients (with their
+ * login flags) and then all the descriptors, in the order UDP, TCP, Unix
+ * listener, clients, rings. The server may exit only after the new server
+ * confirmed that it received everything.
+ * 
+ * @param channel_fd connection with the new server
+ * @param database database
+ * @param socket_fd_UDP UDP socket
+ * @param socket_fd_TCP TCP listener
+ * @param socket_fd_unix Unix listener (-1 - none)
+ * @return true - the new server took over
+ * @return false - the handover failed
+ */
+bool hand_over(int channel_fd, struct Database* database,
+               int socket_fd_UDP, int socket_fd_TCP, int socket_fd_unix) {
+    vector<char> state;
+    settle_sequences(database);
+    serialize_database(database, state);
+
+    string IDs = (socket_fd_unix >= 0) ? "1\n" : "0\n";
+    vector<int> fds, ring_fds;
+    fds.push_back(socket_fd_UDP);
+    fds.push_back(socket_fd_TCP);
+    if(socket_fd_unix >= 0) {
+        fds.push_back(socket_fd_unix);
+    }
+    for(auto &user_data : (*database).online) {
+        if(user_data.second.online == true) {
+            int flags = (user_data.second.batch_frames ? ID_BATCH_FLAG : 0) |
+                        (user_data.second.multicast ? ID_MULTICAST_FLAG : 0) |
+                        (user_data.second.heartbeats ? ID_HEARTBEAT_FLAG : 0);
+            auto connection = (*database).connections.find(user_data.second.socket_fd);
+            if(connection != (*database).connections.end() &&
+               connection->second.transport == TRANSPORT_SHM) {
+                flags |= HANDOVER_RING_FLAG;
+                ring_fds.push_back(connection->second.ring.memory_fd);
+                ring_fds.push_back(connection->second.ring.event_fd);
+            }
+            IDs += to_string(flags);
+            IDs += ' ';
+            IDs += user_data.second.ID;
+            IDs += '\n';
+            fds.push_back(user_data.second.socket_fd);
+        }
+    }
+    fds.insert(fds.end(), ring_fds.begin(), ring_fds.end());
+
+    if(send_frame(channel_fd, HANDOVER_STATE_CODE, state.data(), state.size()) == false ||
+       send_frame(channel_fd, HANDOVER_CLIENTS_CODE, IDs.data(), IDs.size()) == false ||
+       send_fds(channel_fd, fds.data(), fds.size()) == false) {
+        return false;
+    }
+
+    struct Send_Header header;
+    vector<char> body;
+    return recv_frame(channel_fd, &header, body, 0) == true &&
+           header.operation == HANDOVER_DONE_CODE;
+}
+
+/**
+ * @brief Receives the state of the old server and marks the clients whose
+ * sockets were handed over as online, on their new descriptors, with the
+ * login flags of their connections. The multicast clients keep the group
+ * and the topics they joined, the new server has to publish on the same
+ * group (-M).
+ * 
+ * @param path handover socket of the old server
+ * @param database database
+ * @param socket_fd_UDP result - UDP socket
+ * @param socket_fd_TCP result - TCP listener
+ * @param socket_fd_unix result - Unix listener (-1 - none)
+ * @param client_fds result - sockets of the connected clients
+ * @return true - success
+ * @return false - the handover failed
+ */
+bool take_over(const char *path, struct Database* database, int *socket_fd_UDP,
+               int *socket_fd_TCP, int *socket_fd_unix, vector<int> &client_fds) {
+    int channel_fd = connect_unix(path);
+    if(channel_fd < 0) {
+        return false;
+    }
+
+    struct Send_Header header;
+    vector<char> state, IDs;
+    if(recv_frame(channel_fd, &header, state, INT32_MAX - 1) == false ||
+       header.operation != HANDOVER_STATE_CODE ||
+       deserialize_database(database, state.data(), header.size) == false) {
+        close(channel_fd);
+        return false;
+    }
+    state = vector<char>();
+
+    if(recv_frame(channel_fd, &header, IDs, INT32_MAX - 1) == false ||
+       header.operation != HANDOVER_CLIENTS_CODE) {
+        close(channel_fd);
+        return false;
+    }
+
+    /*
+        The first line tells if the Unix listener follows the TCP one
+    */
+    vector<struct Token> clients;
+    const char *cursor = IDs.data();
+    struct Token line;
+    bool unix_listener = next_line(&cursor, IDs.data() + header.size, &line) == true &&
+                         line.length == 1 && line.start[0] == '1';
+    int rings = 0;
+    while(next_line(&cursor, IDs.data() + header.size, &line) == true) {
+        clients.push_back(line);
+        rings += (strtol(line.start, NULL, 10) & HANDOVER_RING_FLAG) != 0;
+    }
+
+    int listeners = unix_listener ? 3 : 2;
+    vector<int> fds(listeners + clients.size() + 2 * rings);
+    if(recv_fds(channel_fd, fds.data(), fds.size()) == false) {
+        close(channel_fd);
+        return false;
+    }
+    *socket_fd_UDP  = fds[0];
+    *socket_fd_TCP  = fds[1];
+    *socket_fd_unix = unix_listener ? fds[2] : -1;
+
+    int *ring_fds = fds.data() + listeners + clients.size();
+    for(unsigned int i = 0; i < clients.size(); i++) {
+        char *separator = NULL;
+        string line(clients[i].start, clients[i].length);
+        long flags = strtol(line.c_str(), &separator, 10);
+        string ID = (*separator == ' ') ? string(separator + 1) : string();
+        int socket = fds[listeners + i];
+
+        /*
+            The ring keeps its head and tail, the subscriber goes on
+            reading it where it stopped
+        */
+        struct Connection connection;
+        connection.socket_fd = socket;
+        connection.transport = TRANSPORT_SHM;
+        bool ring = (flags & HANDOVER_RING_FLAG) != 0;
+        bool attached = ring && attach_ring(&connection.ring, ring_fds[0], ring_fds[1]);
+        if(ring && attached == false) {
+            close(ring_fds[0]);
+            close(ring_fds[1]);
+        }
+        ring_fds += ring ? 2 : 0;
+
+        auto find_user = (*database).online.find(ID);
+        if(find_user == (*database).online.end() || ring != attached) {
+            if(attached) {
+                destroy_ring(&connection.ring);
+            }
+            close(socket);
+            continue;
+        }
+        if(attached) {
+            (*database).connections[socket] = connection;
+        }
+        find_user->second.socket_fd     = socket;
+        find_user->second.online        = true;
+        find_user->second.batch_frames  = (flags & ID_BATCH_FLAG) != 0;
+        find_user->second.multicast     = (flags & ID_MULTICAST_FLAG) != 0;
+        find_user->second.heartbeats    = (flags & ID_HEARTBEAT_FLAG) != 0;
+
+        struct Subscriber location;
+        strcpy(location.ID, ID.c_str());
+        location.socket_fd  = socket;
+        location.online     = true;
+        (*database).locations[socket] = location;
+
+        struct Login_Key key;
+        make_login_key(location.ID, &key);
+        set_session(&(*database).sessions, &key, socket, SESSION_ONLINE);
+        client_fds.push_back(socket);
+    }
+
+    bool result = send_frame(channel_fd, HANDOVER_DONE_CODE, NULL, 0);
+    close(channel_fd);
+    return result;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file heartbeat.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Detection of the dead clients: the silent clients are sent
+ * heartbeats from a timer wheel, the ones that stop answering are reset
+ * so that their sessions end and their resources are reclaimed.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#include "../include/heartbeat.h"
+#include "../include/event_loop.h"
+#include <netinet/tcp.h>
+#include <time.h>
+
+using namespace std;
+
+/**
+ * @brief Current tick (CLOCK_MONOTONIC, so a change of the time of day
+ * does not kill or spare the clients).
+ */
+static uint64_t current_tick() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000) / HEARTBEAT_TICK_MS;
+}
+
+void init_heartbeat(struct Heartbeat* heartbeat, uint64_t interval_ms, int misses) {
+    heartbeat->interval = (interval_ms + HEARTBEAT_TICK_MS - 1) / HEARTBEAT_TICK_MS;
+    heartbeat->misses   = misses;
+    init_timer_wheel(&heartbeat->wheel, current_tick());
+}
+
+/**
+ * @brief Key of the timer of a connection: the bytes of its socket (kept
+ * in the string itself).
+ */
+static string timer_key(int socket_fd) {
+    return string((const char *) &socket_fd, sizeof(int));
+}
+
+/**
+ * @brief The same limits from the kernel for a client that does not
+ * answer the heartbeats: keepalive probes after <interval> of silence,
+ * every <interval>, <misses> of them. No TCP_USER_TIMEOUT: a client
+ * that is alive but stops reading for a while is not closed. Only for
+ * TCP, the errors of a Unix socket are ignored.
+ */
+static void set_keepalive(struct Heartbeat* heartbeat, int socket_fd) {
+    int enable = 1;
+    int seconds = max(1, (int) (heartbeat->interval * HEARTBEAT_TICK_MS / 1000));
+    setsockopt(socket_fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(int));
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_KEEPIDLE, &seconds, sizeof(int));
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_KEEPINTVL, &seconds, sizeof(int));
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_KEEPCNT, &heartbeat->misses, sizeof(int));
+}
+
+void watch_peer(struct Heartbeat* heartbeat, int socket_fd, bool answers) {
+    if(heartbeat == NULL || heartbeat->interval == 0) {
+        return;
+    }
+    if(answers == false) {
+        set_keepalive(heartbeat, socket_fd);
+        return;
+    }
+
+    struct Peer_Liveness &peer = heartbeat->peers[socket_fd];
+    peer.heard  = heartbeat->wheel.now;
+    peer.timer  = heartbeat->next_timer ++;
+    peer.missed = 0;
+    add_timer(&heartbeat->wheel, peer.heard + heartbeat->interval, peer.timer,
+              timer_key(socket_fd));
+}
+
+void heard_from(struct Heartbeat* heartbeat, int socket_fd, int operation) {
+    if(heartbeat == NULL) {
+        return;
+    }
+    auto peer = heartbeat->peers.find(socket_fd);
+    if(peer == heartbeat->peers.end()) {
+        return;
+    }
+    peer->second.heard = heartbeat->wheel.now;
+    peer->second.missed = 0;
+    heartbeat->answered += (operation == HEARTBEAT_CODE);
+}
+
+void forget_peer(struct Heartbeat* heartbeat, int socket_fd) {
+    if(heartbeat != NULL) {
+        heartbeat->peers.erase(socket_fd);
+    }
+}
+
+/**
+ * @brief The client is dead: the connection is reset (its unsent data
+ * is dropped at once instead of being sent to nobody) and its reader
+ * sees the end of the connection, which ends the session.
+ */
+static void reclaim_peer(struct Database* database, int socket_fd) {
+    struct linger reset = {1, 0};
+    setsockopt(socket_fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(struct linger));
+    if((*database).loop != NULL) {
+        shut_down_client((*database).loop, socket_fd);
+    } else {
+        shutdown(socket_fd, SHUT_RDWR);
+    }
+}
+
+void check_heartbeats(struct Database* database) {
+    struct Heartbeat *heartbeat = (*database).heartbeat;
+    if(heartbeat == NULL || heartbeat->interval == 0) {
+        return;
+    }
+
+    uint64_t now = current_tick();
+    vector<struct Timer> expired;
+    advance_timers(&heartbeat->wheel, now, expired);
+
+    for(auto &timer : expired) {
+        int socket_fd;
+        memcpy(&socket_fd, timer.key.data(), sizeof(int));
+        auto found = heartbeat->peers.find(socket_fd);
+        if(found == heartbeat->peers.end() || found->second.timer != timer.id) {
+            continue;
+        }
+        struct Peer_Liveness &peer = found->second;
+
+        /*
+            Heard less than an interval ago: the timer starts again from
+            then. A client that answered was heard after the heartbeat,
+            so it is pinged again once it has been silent that long.
+        */
+        if(peer.missed == 0 && peer.heard + heartbeat->interval > now) {
+            add_timer(&heartbeat->wheel, peer.heard + heartbeat->interval, peer.timer, timer.key);
+            continue;
+        }
+
+        if(peer.missed >= heartbeat->misses) {
+            auto location = (*database).locations.find(socket_fd);
+            if(location != (*database).locations.end()) {
+                cout << "Client " << location->second.ID << " stopped answering." << endl;
+            }
+            reclaim_peer(database, socket_fd);
+            heartbeat->peers.erase(found);
+            heartbeat->reclaimed ++;
+            continue;
+        }
+
+        /*
+            Ahead of the posts queued for the client, which only wait for
+            it to read them
+        */
+        deliver_frame(database, socket_fd, HEARTBEAT_CODE, "", 1, 0, PRIORITY_HIGH);
+        heartbeat->sent ++;
+        peer.missed ++;
+        add_timer(&heartbeat->wheel, now + heartbeat->interval, peer.timer, timer.key);
+    }
+}
+
+int64_t heartbeat_timeout(struct Database* database) {
+    struct Heartbeat *heartbeat = (*database).heartbeat;
+    if(heartbeat == NULL) {
+        return -1;
+    }
+    uint64_t tick = next_timer_tick(&heartbeat->wheel);
+    if(tick == 0) {
+        return -1;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t now_usec = (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    uint64_t tick_usec = tick * HEARTBEAT_TICK_MS * 1000;
+    return (tick_usec > now_usec) ? tick_usec - now_usec : 0;
+}
+
+void print_heartbeat_stats(struct Heartbeat* heartbeat) {
+    if(heartbeat == NULL || heartbeat->interval == 0) {
+        return;
+    }
+    cout << "Heartbeats: " << heartbeat->peers.size() << " clients watched, "
+         << heartbeat->sent << " sent, " << heartbeat->answered << " answered, "
+         << heartbeat->reclaimed << " dead clients closed." << endl;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file latency.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Latency of the posts from the kernel receive time of the UDP
+ * datagram to the moment each subscriber's frame is handed to its
+ * transport, in per-topic histograms and a sampled trace ring.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/latency.h"
+#include <time.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+using namespace std;
+
+void init_tracer(struct Latency_Tracer* tracer, unsigned int sample_rate) {
+    memset(&tracer->replay, 0, sizeof(struct Latency_Histogram));
+    tracer->trace.assign(TRACE_RING_LEN, Trace_Record());
+    tracer->traced      = 0;
+    tracer->deliveries  = 0;
+    tracer->sample_rate = sample_rate == 0 ? 1 : sample_rate;
+}
+
+bool enable_rx_timestamps(int socket_fd) {
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    return setsockopt(socket_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(int)) == 0;
+}
+
+uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief recvmsg with a control buffer for SCM_TIMESTAMPING. The software
+ * timestamp is the first of the three in scm_timestamping.
+ * 
+ * @param socket_fd UDP socket
+ * @param buffer result - datagram
+ * @param length size of the buffer
+ * @param source result - address of the sender
+ * @param ingress_ns result - receive time
+ * @return the size of the datagram or -1
+ */
+ssize_t recv_timestamped(int socket_fd, void *buffer, size_t length,
+                         struct sockaddr_in *source, uint64_t *ingress_ns, int flags) {
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct iovec io = {buffer, length};
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(struct msghdr));
+    message.msg_name        = source;
+    message.msg_namelen     = sizeof(struct sockaddr_in);
+    message.msg_iov         = &io;
+    message.msg_iovlen      = 1;
+    message.msg_control     = control;
+    message.msg_controllen  = sizeof(control);
+
+    ssize_t received = recvmsg(socket_fd, &message, flags);
+    if(received < 0) {
+        return received;
+    }
+
+    *ingress_ns = 0;
+    for(struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL;
+        header = CMSG_NXTHDR(&message, header)) {
+        if(header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping timestamps;
+            memcpy(&timestamps, CMSG_DATA(header), sizeof(struct scm_timestamping));
+            *ingress_ns = (uint64_t) timestamps.ts[0].tv_sec * 1000000000ULL +
+                          timestamps.ts[0].tv_nsec;
+        }
+    }
+    if(*ingress_ns == 0) {
+        *ingress_ns = now_ns();
+    }
+    return received;
+}
+
+/**
+ * @brief Index of the bucket: the position of the most significant bit
+ * gives the power of 2, the next LATENCY_SUB_BITS bits the linear bucket.
+ */
+static unsigned int bucket_index(uint64_t value) {
+    if(value < LATENCY_SUB_BUCKETS) {
+        return value;
+    }
+    unsigned int power = 63 - __builtin_clzll(value);
+    unsigned int sub = (value >> (power - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+    return (power - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief Largest value falling in the bucket.
+ */
+static uint64_t bucket_limit(unsigned int index) {
+    if(index < LATENCY_SUB_BUCKETS) {
+        return index;
+    }
+    unsigned int power = index / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+    unsigned int sub = index % LATENCY_SUB_BUCKETS;
+    uint64_t base = (1ULL << power) + ((uint64_t) sub << (power - LATENCY_SUB_BITS));
+    return base + (1ULL << (power - LATENCY_SUB_BITS)) - 1;
+}
+
+struct Latency_Histogram* topic_histogram(struct Latency_Tracer* tracer,
+                                          const char *topic) {
+    auto entry = tracer->topics.find(topic);
+    if(entry == tracer->topics.end()) {
+        struct Latency_Histogram empty;
+        memset(&empty, 0, sizeof(struct Latency_Histogram));
+        entry = tracer->topics.emplace(topic, empty).first;
+    }
+    return &entry->second;
+}
+
+void add_latency(struct Latency_Histogram* histogram, uint64_t latency) {
+    histogram->count ++;
+    histogram->total += latency;
+    histogram->max = max(histogram->max, latency);
+    histogram->buckets[bucket_index(latency)] ++;
+}
+
+/**
+ * @brief Adds the latency in the histogram and traces one delivery in
+ * <sample_rate>. Clock steps backwards are counted as 0.
+ * 
+ * @param tracer tracer
+ * @param histogram histogram of the topic (or the replay histogram)
+ * @param topic topic of the post
+ * @param ingress_ns receive time
+ * @param egress_ns delivery time
+ * @param socket_fd subscriber
+ * @param kind TRACE_LIVE / TRACE_REPLAY
+ */
+void record_latency(struct Latency_Tracer* tracer, struct Latency_Histogram* histogram,
+                    const char *topic, uint64_t ingress_ns, uint64_t egress_ns,
+                    int socket_fd, int kind) {
+    uint64_t latency = (egress_ns > ingress_ns) ? egress_ns - ingress_ns : 0;
+    add_latency(histogram, latency);
+
+    if(tracer->deliveries++ % tracer->sample_rate != 0) {
+        return;
+    }
+
+    struct Trace_Record &record = tracer->trace[tracer->traced % tracer->trace.size()];
+    record.ingress_ns   = ingress_ns;
+    record.egress_ns    = egress_ns;
+    record.topic_hash   = hash<string>()(topic);
+    record.socket_fd    = socket_fd;
+    record.kind         = kind;
+    record.reserved     = 0;
+    tracer->traced ++;
+}
+
+uint64_t histogram_percentile(struct Latency_Histogram* histogram, double percentile) {
+    if(histogram->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = ceil(histogram->count * percentile / 100.0);
+    uint64_t seen = 0;
+    for(unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if(seen >= rank && seen > 0) {
+            return min(bucket_limit(i), histogram->max);
+        }
+    }
+    return histogram->max;
+}
+
+static void print_histogram(const string &name, struct Latency_Histogram* histogram) {
+    cout << name << ": " << histogram->count << " deliveries, avg "
+         << (histogram->count ? histogram->total / histogram->count / 1000 : 0) << "us, p50 "
+         << histogram_percentile(histogram, 50) / 1000 << "us, p99 "
+         << histogram_percentile(histogram, 99) / 1000 << "us, max "
+         << histogram->max / 1000 << "us" << endl;
+}
+
+void print_latency_stats(struct Latency_Tracer* tracer) {
+    for(auto &topic : tracer->topics) {
+        print_histogram("latency " + topic.first, &topic.second);
+    }
+    print_histogram("latency SF replay", &tracer->replay);
+}
+
+/**
+ * @brief Writes the records of the trace ring, from the oldest one.
+ * 
+ * @param tracer tracer
+ * @param path file
+ * @return true - the trace was written
+ * @return false - error in writing
+ */
+bool dump_trace(struct Latency_Tracer* tracer, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) {
+        return false;
+    }
+
+    uint64_t capacity = tracer->trace.size();
+    uint64_t count = min(tracer->traced, capacity);
+    uint64_t first = tracer->traced - count;
+
+    bool result = fwrite(TRACE_MAGIC, 8, 1, file) == 1 &&
+                  fwrite(&count, sizeof(uint64_t), 1, file) == 1;
+    for(uint64_t i = first; i < tracer->traced && result; i++) {
+        result = fwrite(&tracer->trace[i % capacity], sizeof(struct Trace_Record), 1, file) == 1;
+    }
+    return fclose(file) == 0 && result;
+}
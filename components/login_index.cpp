@@ -0,0 +1,105 @@
+/**
+ * @file login_index.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Index of the client IDs: an open addressing table of fixed size
+ * keys, so that checking the ID of a new connection costs one hash and
+ * a few word compares, whatever the number of clients.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/login_index.h"
+#include "../include/topic_kernels.h"
+#include <cstring>
+
+using namespace std;
+
+void make_login_key(const char *ID, struct Login_Key* key) {
+    memset(key->ID, 0, ID_MAX_LEN);
+    strncpy(key->ID, ID, ID_MAX_LEN - 1);
+
+    /* The padded ID is hashed and compared as blocks (see topic_kernels.h) */
+    key->hash = kernels.hash(key->ID, ID_MAX_LEN);
+}
+
+static bool same_key(const struct Login_Key* first, const struct Login_Key* second) {
+    return first->hash == second->hash && kernels.equal(first->ID, second->ID, ID_MAX_LEN);
+}
+
+/**
+ * @brief Finds the slot of the key: its session or the free slot where
+ * it would be added. The table must not be empty.
+ */
+static size_t key_slot(struct Login_Index* index, const struct Login_Key* key) {
+    size_t mask = index->slots.size() - 1;
+    size_t slot = key->hash & mask;
+    while(index->slots[slot].state != SESSION_FREE &&
+          same_key(&index->slots[slot].key, key) == false) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Doubles the table (or creates it) and places the sessions again.
+ */
+static void grow_index(struct Login_Index* index) {
+    vector<struct Session> old;
+    old.swap(index->slots);
+
+    struct Session free_slot;
+    memset(&free_slot, 0, sizeof(struct Session));
+    free_slot.state = SESSION_FREE;
+    index->slots.assign(old.empty() ? LOGIN_INDEX_LEN : 2 * old.size(), free_slot);
+
+    for(auto &session : old) {
+        if(session.state != SESSION_FREE) {
+            index->slots[key_slot(index, &session.key)] = session;
+        }
+    }
+}
+
+struct Session* find_session(struct Login_Index* index, const struct Login_Key* key) {
+    if(index->slots.empty()) {
+        return NULL;
+    }
+    struct Session* session = &index->slots[key_slot(index, key)];
+    return session->state == SESSION_FREE ? NULL : session;
+}
+
+/**
+ * @brief Finds the session of the key, adding it as offline if needed.
+ */
+static struct Session* open_session(struct Login_Index* index, const struct Login_Key* key) {
+    if(2 * (index->used + 1) > index->slots.size()) {
+        grow_index(index);
+    }
+
+    struct Session* session = &index->slots[key_slot(index, key)];
+    if(session->state == SESSION_FREE) {
+        session->key        = *key;
+        session->socket_fd  = -1;
+        session->state      = SESSION_OFFLINE;
+        index->used ++;
+    }
+    return session;
+}
+
+bool begin_login(struct Login_Index* index, const struct Login_Key* key, int socket_fd) {
+    struct Session* session = open_session(index, key);
+    if(session->state != SESSION_OFFLINE) {
+        return false;
+    }
+    session->socket_fd  = socket_fd;
+    session->state      = SESSION_CONNECTING;
+    return true;
+}
+
+void set_session(struct Login_Index* index, const struct Login_Key* key,
+                 int socket_fd, int state) {
+    struct Session* session = open_session(index, key);
+    session->socket_fd  = socket_fd;
+    session->state      = state;
+}
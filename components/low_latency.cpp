@@ -0,0 +1,57 @@
+/**
+ * @file low_latency.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Busy polling, CPU pinning and memory locking for the
+ * latency-optimized run mode of the server.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/low_latency.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+bool set_nonblocking(int socket_fd) {
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+ * @brief Busy polling and non-blocking reads on the UDP socket, pinning
+ * of the server thread and locking of the pages mapped so far. Locking
+ * only the current pages (not MCL_FUTURE) keeps the growth of the
+ * Database subject to the usual limits instead of failing allocations.
+ * 
+ * @param config options of the server
+ * @param socket_fd_UDP UDP socket
+ */
+void enter_low_latency_mode(struct Server_Config* config, int socket_fd_UDP) {
+    if(config->busy_poll_usec > 0) {
+        DIE(set_nonblocking(socket_fd_UDP) == false, "Error in setting O_NONBLOCK.");
+
+        if(setsockopt(socket_fd_UDP, SOL_SOCKET, SO_BUSY_POLL, &config->busy_poll_usec,
+                      sizeof(int)) < 0) {
+            perror("SO_BUSY_POLL (polling in user space only)");
+        }
+    }
+
+    if(config->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu, &cpus);
+        if(sched_setaffinity(0, sizeof(cpu_set_t), &cpus) < 0) {
+            perror("sched_setaffinity");
+        }
+    }
+
+    if(config->busy_poll_usec > 0 || config->cpu >= 0) {
+        if(mlockall(MCL_CURRENT) < 0) {
+            perror("mlockall");
+        }
+    }
+}
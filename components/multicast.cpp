@@ -0,0 +1,152 @@
+/**
+ * @file multicast.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Multicast egress of the topics with large audiences: one
+ * datagram per post for all the multicast clients, the TCP connections
+ * only carry the control frames and the posts sent again after a NAK.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/multicast.h"
+#include "../include/network.h"
+#include <sys/uio.h>
+
+using namespace std;
+
+bool open_multicast(struct Multicast* multicast, const char *group,
+                    const vector<string> &topics) {
+    if(parse_multicast_group(group, &multicast->group) == false) {
+        return false;
+    }
+    multicast->socket_fd = open_multicast_sender();
+    multicast->topics.insert(topics.begin(), topics.end());
+    return multicast->socket_fd >= 0;
+}
+
+bool multicast_topic(struct Multicast* multicast, const string &topic) {
+    return multicast != NULL && multicast->topics.count(topic) != 0;
+}
+
+void multicast_post(struct Multicast* multicast, const char *content, int size,
+                    uint64_t sequence) {
+    struct Send_Header header;
+    header.size         = size;
+    header.operation    = SUBSCRIPTION_SEND;
+    header.sequence     = sequence;
+
+    struct iovec parts[2];
+    parts[0].iov_base = &header;
+    parts[0].iov_len  = sizeof(struct Send_Header);
+    parts[1].iov_base = (void *) content;
+    parts[1].iov_len  = size;
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(struct msghdr));
+    message.msg_name    = &multicast->group;
+    message.msg_namelen = sizeof(struct sockaddr_in);
+    message.msg_iov     = parts;
+    message.msg_iovlen  = 2;
+
+    /*
+        A datagram lost here is found by the sequences of the clients
+    */
+    if(sendmsg(multicast->socket_fd, &message, MSG_DONTWAIT) >= 0) {
+        multicast->published ++;
+    }
+}
+
+/**
+ * @brief Sends a MULTICAST_JOIN/LEAVE frame for the topic, the JOIN with
+ * the last sequence of the topic: the client takes the next posts from
+ * the group.
+ */
+static void send_membership(struct Database* database, struct Subscriber* subscriber,
+                            const string &topic, bool joined) {
+    uint64_t sequence = 0;
+    auto log = (*database).topic_logs.find(topic);
+    if(log != (*database).topic_logs.end()) {
+        sequence = log->second.sequence;
+    }
+    deliver_frame(database, subscriber->socket_fd,
+                  joined ? MULTICAST_JOIN_CODE : MULTICAST_LEAVE_CODE,
+                  topic.c_str(), topic.size() + 1, joined ? sequence : 0,
+                  topic_priority(database, topic));
+}
+
+void multicast_login(struct Database* database, struct Subscriber* subscriber) {
+    struct Multicast *multicast = (*database).multicast;
+    if(multicast == NULL || subscriber->multicast == false) {
+        return;
+    }
+
+    char group[INET_ADDRSTRLEN + 8];
+    inet_ntop(AF_INET, &multicast->group.sin_addr, group, INET_ADDRSTRLEN);
+    sprintf(group + strlen(group), ":%d", ntohs(multicast->group.sin_port));
+    /* Before the JOIN frames of any class */
+    deliver_frame(database, subscriber->socket_fd, MULTICAST_SETUP_CODE,
+                  group, strlen(group) + 1, 0, PRIORITY_HIGH);
+
+    for(auto &topic : subscriber->subscription_types) {
+        if(multicast->topics.count(topic.first) != 0) {
+            send_membership(database, subscriber, topic.first, true);
+        }
+    }
+}
+
+void multicast_subscribed(struct Database* database, struct Subscriber* subscriber,
+                          const string &topic, bool joined) {
+    if(subscriber->online == false || subscriber->multicast == false ||
+       multicast_topic((*database).multicast, topic) == false) {
+        return;
+    }
+    send_membership(database, subscriber, topic, joined);
+}
+
+void answer_nak(struct Database* database, int socket_fd, const char *body) {
+    struct Multicast *multicast = (*database).multicast;
+    unsigned long long first, last;
+    int topic_start = 0;
+    if(multicast == NULL || sscanf(body, "%llu %llu %n", &first, &last, &topic_start) != 2 ||
+       topic_start == 0 || first > last || strlen(body + topic_start) >= TOPIC_LEN) {
+        return;
+    }
+    const char *topic = body + topic_start;
+
+    /* Only the posts of a topic the client is subscribed to */
+    struct Subscriber *subscriber = find_subscriber(database, socket_fd);
+    if(subscriber == NULL ||
+       subscriber->subscription_types.find(topic) == subscriber->subscription_types.end()) {
+        return;
+    }
+    int priority = topic_priority(database, topic);
+    multicast->naks ++;
+
+    /*
+        The retained sequences are consecutive (see replay_posts)
+    */
+    auto log = (*database).topic_logs.find(topic);
+    if(log != (*database).topic_logs.end() && log->second.retained.count != 0) {
+        struct Log_Cursor cursor;
+        struct Send_Post transform;
+        uint64_t sequence;
+        seek_log(&log->second.retained, log->first, first, &cursor);
+        while(next_logged(&cursor, &sequence) && sequence <= last) {
+            format_post(&cursor.post, cursor.source, &transform);
+            deliver_frame(database, socket_fd, SUBSCRIPTION_SEND, transform.content,
+                          strlen(transform.content) + 1, sequence, priority);
+            multicast->resent ++;
+        }
+    }
+    deliver_frame(database, socket_fd, NAK_CODE, topic, strlen(topic) + 1, last, priority);
+}
+
+void print_multicast_stats(struct Multicast* multicast) {
+    if(multicast == NULL) {
+        return;
+    }
+    cout << "Multicast: " << multicast->published << " datagrams, " << multicast->naks
+         << " NAKs, " << multicast->resent << " posts sent again." << endl;
+}
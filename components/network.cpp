@@ -0,0 +1,282 @@
+/**
+ * @file network.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Functions that send and receive whole frames. A single
+ * recv/send on a stream socket may transfer fewer bytes than
+ * requested, which matters once the frames (bulk subscriptions)
+ * grow beyond a few segments.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/network.h"
+#include "../include/constants.h"
+#include <errno.h>
+#include <algorithm>
+#include <sys/un.h>
+
+bool recv_all(int socket_fd, void *buffer, size_t length) {
+    char *p = (char *) buffer;
+
+    while(length > 0) {
+        ssize_t return_value = recv(socket_fd, p, length, 0);
+        if(return_value < 0 && errno == EINTR) {
+            continue;
+        }
+        if(return_value <= 0) {
+            return false;
+        }
+        p       += return_value;
+        length  -= return_value;
+    }
+    return true;
+}
+
+bool send_all(int socket_fd, const void *buffer, size_t length) {
+    const char *p = (const char *) buffer;
+
+    while(length > 0) {
+        ssize_t return_value = send(socket_fd, p, length, MSG_NOSIGNAL);
+        if(return_value < 0 && errno == EINTR) {
+            continue;
+        }
+        if(return_value <= 0) {
+            return false;
+        }
+        p       += return_value;
+        length  -= return_value;
+    }
+    return true;
+}
+
+bool send_frame(int socket_fd, int operation, const char *body, int size,
+                uint64_t sequence) {
+    struct Send_Header header;
+    header.operation    = operation;
+    header.size         = size;
+    header.sequence     = sequence;
+
+    if(send_all(socket_fd, &header, sizeof(struct Send_Header)) == false) {
+        return false;
+    }
+    return send_all(socket_fd, body, size);
+}
+
+bool recv_frame(int socket_fd, struct Send_Header *header,
+                vector<char> &body, int max_size) {
+    if(recv_all(socket_fd, header, sizeof(struct Send_Header)) == false) {
+        return false;
+    }
+    if(header->size < 0 || header->size > max_size) {
+        return false;
+    }
+
+    /*
+        Keep one extra byte so that text bodies can always be
+        treated as C strings.
+    */
+    body.resize(header->size + 1);
+    body[header->size] = '\0';
+    return recv_all(socket_fd, body.data(), header->size);
+}
+
+
+/**
+ * @brief Fills the address of the Unix domain socket at <path>.
+ */
+static bool unix_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+/**
+ * @brief Binds a Unix domain stream socket at <path>.
+ * 
+ * @param path path of the socket
+ * @param backlog backlog of listen
+ * @return the listening socket
+ */
+int open_unix_listener(const char *path, int backlog) {
+    struct sockaddr_un address;
+    DIE(unix_address(path, &address) == false, "Unix socket path is too long.");
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    DIE(listener < 0, "Cannot open Unix socket.");
+
+    unlink(path);
+    int return_value = bind(listener, (struct sockaddr *) &address, sizeof(struct sockaddr_un));
+    DIE(return_value < 0, "Error in binding Unix socket.");
+
+    return_value = listen(listener, backlog);
+    DIE(return_value < 0, "Error in listening on Unix socket.");
+
+    return listener;
+}
+
+int connect_unix(const char *path) {
+    struct sockaddr_un address;
+    if(unix_address(path, &address) == false) {
+        return -1;
+    }
+
+    int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(socket_fd < 0) {
+        return -1;
+    }
+    if(connect(socket_fd, (struct sockaddr *) &address, sizeof(struct sockaddr_un)) < 0) {
+        close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
+
+/**
+ * @brief Sends the descriptors as ancillary data. Every group of
+ * descriptors is attached to one byte of regular data, since a
+ * message without data does not carry the ancillary part.
+ * 
+ * @param channel_fd Unix domain socket
+ * @param fds descriptors
+ * @param count number of descriptors
+ * @return true - all the descriptors were sent
+ * @return false - error in sending
+ */
+bool send_fds(int channel_fd, const int *fds, int count) {
+    char control[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+
+    while(count > 0) {
+        int group = min(count, MAX_PASSED_FDS);
+        char data = 0;
+        struct iovec io = {&data, 1};
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(struct msghdr));
+        memset(control, 0, sizeof(control));
+        message.msg_iov         = &io;
+        message.msg_iovlen      = 1;
+        message.msg_control     = control;
+        message.msg_controllen  = CMSG_SPACE(group * sizeof(int));
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level  = SOL_SOCKET;
+        header->cmsg_type   = SCM_RIGHTS;
+        header->cmsg_len    = CMSG_LEN(group * sizeof(int));
+        memcpy(CMSG_DATA(header), fds, group * sizeof(int));
+
+        if(sendmsg(channel_fd, &message, MSG_NOSIGNAL) != 1) {
+            return false;
+        }
+        fds     += group;
+        count   -= group;
+    }
+    return true;
+}
+
+/**
+ * @brief Receives the descriptors sent by send_fds, group by group.
+ * 
+ * @param channel_fd Unix domain socket
+ * @param fds result
+ * @param count number of expected descriptors
+ * @return true - all the descriptors were received
+ * @return false - error or unexpected message
+ */
+bool recv_fds(int channel_fd, int *fds, int count) {
+    char control[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+
+    while(count > 0) {
+        int group = min(count, MAX_PASSED_FDS);
+        char data;
+        struct iovec io = {&data, 1};
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(struct msghdr));
+        message.msg_iov         = &io;
+        message.msg_iovlen      = 1;
+        message.msg_control     = control;
+        message.msg_controllen  = sizeof(control);
+
+        if(recvmsg(channel_fd, &message, MSG_CMSG_CLOEXEC) != 1) {
+            return false;
+        }
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        if(header == NULL || header->cmsg_level != SOL_SOCKET ||
+           header->cmsg_type != SCM_RIGHTS ||
+           header->cmsg_len != CMSG_LEN(group * sizeof(int))) {
+            return false;
+        }
+        memcpy(fds, CMSG_DATA(header), group * sizeof(int));
+
+        fds     += group;
+        count   -= group;
+    }
+    return true;
+}
+
+bool parse_multicast_group(const char *text, struct sockaddr_in *group) {
+    const char *colon = strrchr(text, ':');
+    if(colon == NULL || colon - text >= INET_ADDRSTRLEN) {
+        return false;
+    }
+    char IP[INET_ADDRSTRLEN];
+    memcpy(IP, text, colon - text);
+    IP[colon - text] = '\0';
+
+    int port = atoi(colon + 1);
+    memset(group, 0, sizeof(struct sockaddr_in));
+    group->sin_family = AF_INET;
+    group->sin_port = htons(port);
+    if(port <= 0 || port > 65535 || inet_pton(AF_INET, IP, &group->sin_addr) != 1) {
+        return false;
+    }
+    return IN_MULTICAST(ntohl(group->sin_addr.s_addr));
+}
+
+int open_multicast_sender() {
+    int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(socket_fd < 0) {
+        return -1;
+    }
+
+    unsigned char loop = 1, ttl = 1;
+    if(setsockopt(socket_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0 ||
+       setsockopt(socket_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+        close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
+
+int join_multicast_group(const struct sockaddr_in *group) {
+    int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(socket_fd < 0) {
+        return -1;
+    }
+
+    int enable = 1;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(struct sockaddr_in));
+    address.sin_family      = AF_INET;
+    address.sin_port        = group->sin_port;
+    address.sin_addr        = group->sin_addr;
+
+    struct ip_mreq membership;
+    membership.imr_multiaddr        = group->sin_addr;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+
+    if(setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0 ||
+       bind(socket_fd, (struct sockaddr *) &address, sizeof(struct sockaddr_in)) < 0 ||
+       setsockopt(socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+        close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
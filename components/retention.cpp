@@ -0,0 +1,285 @@
+/**
+ * @file retention.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Retention policies of the SF queues: the posts of a topic in the
+ * queue of a client are evicted, oldest first, once they are too old, too
+ * many or too large.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/retention.h"
+#include <time.h>
+
+using namespace std;
+
+bool parse_retention_policy(const char *text, string &topic, struct Retention_Policy* policy) {
+    const char *equal = strrchr(text, '=');
+    if(equal == NULL || equal == text || equal - text >= TOPIC_LEN) {
+        return false;
+    }
+    topic.assign(text, equal - text);
+
+    uint64_t *limits[3] = {&policy->max_age, &policy->max_count, &policy->max_bytes};
+    const char *position = equal + 1;
+    for(int i = 0; i < 3; i++) {
+        *limits[i] = 0;
+    }
+    for(int i = 0; i < 3; i++) {
+        char *end;
+        *limits[i] = strtoull(position, &end, 10);
+        if(end == position) {
+            return false;
+        }
+        if(*end == '\0') {
+            break;
+        }
+        if(*end != ':' || i == 2) {
+            return false;
+        }
+        position = end + 1;
+    }
+    return policy->max_age != 0 || policy->max_count != 0 || policy->max_bytes != 0;
+}
+
+void set_retention_policy(struct Retention* retention, const string &topic,
+                          const struct Retention_Policy* policy) {
+    if(topic == "*") {
+        retention->fallback.policy  = *policy;
+        retention->has_fallback     = true;
+    } else {
+        retention->topics[topic].policy = *policy;
+    }
+    if(retention->wheel.count == 0) {
+        init_timer_wheel(&retention->wheel, time(NULL));
+    }
+}
+
+/**
+ * @brief Policy of the topic, NULL if it has none.
+ */
+static struct Topic_Retention* find_retention(struct Retention* retention, const string &topic) {
+    auto found = retention->topics.find(topic);
+    if(found != retention->topics.end()) {
+        return &found->second;
+    }
+    return retention->has_fallback ? &retention->fallback : NULL;
+}
+
+/**
+ * @brief Removes the evicted posts from the whole SF queue. The posts
+ * kept are numbered again from <SF_first>, in the same order, and the
+ * topic queues are given their new numbers.
+ */
+static void compact_queue(struct Subscriber* subscriber) {
+    deque<struct Stored_Post> kept;
+    vector<uint64_t> numbers(subscriber->SF_queue.size());
+    for(size_t i = 0; i < subscriber->SF_queue.size(); i++) {
+        struct Stored_Post &post = subscriber->SF_queue[i];
+        if(post.operation == EVICTED_POST) {
+            continue;
+        }
+        numbers[i] = subscriber->SF_first + kept.size();
+        kept.push_back(move(post));
+    }
+    for(auto &queued : subscriber->SF_topics) {
+        for(uint64_t &number : queued.second.posts) {
+            number = numbers[number - subscriber->SF_first];
+        }
+    }
+    subscriber->SF_queue.swap(kept);
+    subscriber->SF_evicted = 0;
+}
+
+/**
+ * @brief Pops the evicted posts at the front of the SF queue and
+ * compacts it once they are more than half of it, so the evicted posts
+ * behind an older post that stays (of a topic without limits) do not
+ * pile up: the queue holds at most twice the posts still queued, for
+ * O(1) amortized per eviction.
+ */
+static void trim_queue(struct Subscriber* subscriber) {
+    while(!subscriber->SF_queue.empty() &&
+          subscriber->SF_queue.front().operation == EVICTED_POST) {
+        subscriber->SF_queue.pop_front();
+        subscriber->SF_first ++;
+        subscriber->SF_evicted --;
+    }
+    if(subscriber->SF_evicted * 2 > subscriber->SF_queue.size()) {
+        compact_queue(subscriber);
+    }
+}
+
+/**
+ * @brief Evicts the oldest post of the topic queue. It stays in the SF
+ * queue as EVICTED_POST until it reaches the front or the queue is
+ * compacted.
+ * 
+ * @return bytes of the evicted post
+ */
+static uint64_t evict_oldest(struct Subscriber* subscriber, struct SF_Topic* queued) {
+    struct Stored_Post &post = subscriber->SF_queue[queued->posts.front() - subscriber->SF_first];
+    uint64_t bytes = stored_post_bytes(&post);
+
+    /* The place of the post is kept, not its payload */
+    post.operation = EVICTED_POST;
+    string().swap(post.value);
+    subscriber->SF_evicted ++;
+    queued->posts.pop_front();
+    queued->bytes -= bytes;
+    return bytes;
+}
+
+/**
+ * @brief Starts the timer of the topic queue for its oldest post.
+ */
+static void schedule_expiry(struct Retention* retention, struct Subscriber* subscriber,
+                            const string &topic, struct SF_Topic* queued, uint64_t max_age) {
+    struct Stored_Post &oldest = subscriber->SF_queue[queued->posts.front() - subscriber->SF_first];
+    queued->timer = retention->next_timer ++;
+
+    string key(subscriber->ID);
+    key.push_back('\0');
+    key.append(topic);
+    add_timer(&retention->wheel, oldest.queued_at + max_age, queued->timer, key);
+}
+
+/**
+ * @brief Applies the count and bytes limits to the post at <index> in
+ * the SF queue and starts the expiry of its topic queue.
+ */
+static void retain_index(struct Retention* retention, struct Subscriber* subscriber,
+                         size_t index) {
+    struct Stored_Post &post = subscriber->SF_queue[index];
+    const string &topic = *post.topic;
+    struct Topic_Retention *rule = find_retention(retention, topic);
+    if(rule == NULL) {
+        return;
+    }
+
+    struct SF_Topic &queued = subscriber->SF_topics[topic];
+    queued.posts.push_back(subscriber->SF_first + index);
+    queued.bytes += stored_post_bytes(&post);
+
+    const struct Retention_Policy &policy = rule->policy;
+    while(policy.max_count != 0 && queued.posts.size() > policy.max_count) {
+        rule->evicted_bytes += evict_oldest(subscriber, &queued);
+        rule->over_count ++;
+    }
+    while(policy.max_bytes != 0 && queued.bytes > policy.max_bytes) {
+        rule->evicted_bytes += evict_oldest(subscriber, &queued);
+        rule->over_bytes ++;
+    }
+
+    if(queued.posts.empty()) {
+        subscriber->SF_topics.erase(topic);
+    } else if(policy.max_age != 0 && queued.timer == 0) {
+        schedule_expiry(retention, subscriber, topic, &queued, policy.max_age);
+    }
+}
+
+void retain_post(struct Retention* retention, struct Subscriber* subscriber) {
+    if(retention == NULL) {
+        return;
+    }
+    retain_index(retention, subscriber, subscriber->SF_queue.size() - 1);
+    trim_queue(subscriber);
+}
+
+void release_queue(struct Subscriber* subscriber) {
+    subscriber->SF_first += subscriber->SF_queue.size();
+    subscriber->SF_queue.clear();
+    subscriber->SF_topics.clear();
+    subscriber->SF_evicted = 0;
+}
+
+void retain_all(struct Database* database) {
+    struct Retention *retention = (*database).retention;
+    if(retention == NULL) {
+        return;
+    }
+
+    for(auto &user : (*database).online) {
+        struct Subscriber &subscriber = user.second;
+        subscriber.SF_first = 0;
+        subscriber.SF_topics.clear();
+        subscriber.SF_evicted = 0;
+        for(size_t i = 0; i < subscriber.SF_queue.size(); i++) {
+            retain_index(retention, &subscriber, i);
+        }
+        trim_queue(&subscriber);
+    }
+}
+
+void expire_posts(struct Database* database, time_t now) {
+    struct Retention *retention = (*database).retention;
+    if(retention == NULL) {
+        return;
+    }
+
+    vector<struct Timer> expired;
+    advance_timers(&retention->wheel, now, expired);
+
+    for(auto &timer : expired) {
+        size_t separator = timer.key.find('\0');
+        auto user = (*database).online.find(timer.key.substr(0, separator));
+        if(user == (*database).online.end()) {
+            continue;
+        }
+        struct Subscriber &subscriber = user->second;
+        string topic = timer.key.substr(separator + 1);
+        auto queued = subscriber.SF_topics.find(topic);
+        if(queued == subscriber.SF_topics.end() || queued->second.timer != timer.id) {
+            continue;
+        }
+        queued->second.timer = 0;
+
+        /*
+            The posts of a topic queue are in the order of their age
+        */
+        struct Topic_Retention *rule = find_retention(retention, topic);
+        if(rule == NULL || rule->policy.max_age == 0) {
+            continue;
+        }
+        while(!queued->second.posts.empty()) {
+            uint64_t index = queued->second.posts.front() - subscriber.SF_first;
+            if((uint64_t) subscriber.SF_queue[index].queued_at + rule->policy.max_age > (uint64_t) now) {
+                break;
+            }
+            rule->evicted_bytes += evict_oldest(&subscriber, &queued->second);
+            rule->expired ++;
+        }
+
+        if(queued->second.posts.empty()) {
+            subscriber.SF_topics.erase(queued);
+        } else {
+            schedule_expiry(retention, &subscriber, topic, &queued->second, rule->policy.max_age);
+        }
+        trim_queue(&subscriber);
+    }
+}
+
+/**
+ * @brief Prints the counters of one policy.
+ */
+static void print_topic_retention(const string &topic, const struct Topic_Retention* rule) {
+    cout << "Retention " << topic << " (age " << rule->policy.max_age << "s, count "
+         << rule->policy.max_count << ", bytes " << rule->policy.max_bytes << "): "
+         << rule->expired << " expired, " << rule->over_count << " over count, "
+         << rule->over_bytes << " over bytes, " << rule->evicted_bytes
+         << " bytes evicted." << endl;
+}
+
+void print_retention_stats(struct Retention* retention) {
+    if(retention == NULL) {
+        return;
+    }
+    for(auto &topic : retention->topics) {
+        print_topic_retention(topic.first, &topic.second);
+    }
+    if(retention->has_fallback) {
+        print_topic_retention("*", &retention->fallback);
+    }
+}
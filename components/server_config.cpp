@@ -0,0 +1,163 @@
+/**
+ * @file server_config.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Parsing of the command line options of the server.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/server_config.h"
+#include "../include/constants.h"
+#include "../include/event_loop.h"
+#include <getopt.h>
+#include <sched.h>
+
+/**
+ * @brief Parses the options with getopt, the port is the first
+ * argument after the options.
+ * 
+ * @param argc number of arguments
+ * @param argv arguments
+ * @param config result
+ * @return true - valid arguments
+ * @return false - invalid arguments
+ */
+bool parse_server_arguments(int argc, char *argv[], struct Server_Config* config) {
+    config->port                = 0;
+    config->snapshot_path       = NULL;
+    config->snapshot_interval   = DEFAULT_SNAPSHOT_INTERVAL;
+    config->handover_path       = NULL;
+    config->takeover_path       = NULL;
+    config->unix_path           = NULL;
+    config->trace_sample_rate   = 0;
+    config->busy_poll_usec      = 0;
+    config->cpu                 = -1;
+    config->source_rate         = 0;
+    config->source_burst        = 0;
+    config->coalesce_usec       = DEFAULT_COALESCE_USEC;
+    config->multicast_group     = NULL;
+    config->capture_path        = NULL;
+    config->heartbeat_ms        = DEFAULT_HEARTBEAT_MS;
+    config->heartbeat_misses    = DEFAULT_HEARTBEAT_MISSES;
+
+    int option;
+    while((option = getopt(argc, argv, "s:i:H:T:P:u:L:b:c:R:Q:W:M:m:C:p:K:")) != -1) {
+        switch(option) {
+            case 's':
+                config->snapshot_path = optarg;
+                break;
+            case 'i':
+                config->snapshot_interval = atoi(optarg);
+                if(config->snapshot_interval <= 0) {
+                    return false;
+                }
+                break;
+            case 'H':
+                config->handover_path = optarg;
+                break;
+            case 'T':
+                config->takeover_path = optarg;
+                break;
+            case 'P':
+                config->peers.push_back(optarg);
+                break;
+            case 'u':
+                config->unix_path = optarg;
+                break;
+            case 'L':
+                if(atoi(optarg) <= 0) {
+                    return false;
+                }
+                config->trace_sample_rate = atoi(optarg);
+                break;
+            case 'b':
+                config->busy_poll_usec = atoi(optarg);
+                if(config->busy_poll_usec <= 0) {
+                    return false;
+                }
+                break;
+            case 'c':
+                config->cpu = atoi(optarg);
+                if(config->cpu < 0 || config->cpu >= CPU_SETSIZE) {
+                    return false;
+                }
+                break;
+            case 'R': {
+                char *burst;
+                config->source_rate = strtoull(optarg, &burst, 10);
+                config->source_burst = (*burst == ':') ? strtoull(burst + 1, NULL, 10)
+                                                       : config->source_rate;
+                if(config->source_rate == 0 || config->source_rate > 1000000000ULL ||
+                   config->source_burst == 0) {
+                    return false;
+                }
+                break;
+            }
+            case 'Q': {
+                string topic;
+                struct Retention_Policy policy;
+                if(parse_retention_policy(optarg, topic, &policy) == false) {
+                    return false;
+                }
+                config->retention.push_back(make_pair(topic, policy));
+                break;
+            }
+            case 'W':
+                config->coalesce_usec = atoi(optarg);
+                if(config->coalesce_usec < 0) {
+                    return false;
+                }
+                break;
+            case 'M':
+                config->multicast_group = optarg;
+                break;
+            case 'm':
+                if(strlen(optarg) >= TOPIC_LEN) {
+                    return false;
+                }
+                config->multicast_topics.push_back(optarg);
+                break;
+            case 'C':
+                config->capture_path = optarg;
+                break;
+            case 'p': {
+                char *name = strchr(optarg, '=');
+                if(name == NULL || name == optarg || name - optarg >= TOPIC_LEN ||
+                   parse_priority_class(name + 1) < 0) {
+                    return false;
+                }
+                config->priorities.push_back(make_pair(string(optarg, name - optarg),
+                                                       parse_priority_class(name + 1)));
+                break;
+            }
+            case 'K': {
+                char *misses;
+                config->heartbeat_ms = strtoull(optarg, &misses, 10);
+                if(*misses == ':') {
+                    config->heartbeat_misses = atoi(misses + 1);
+                }
+                if(config->heartbeat_misses <= 0) {
+                    return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    if(config->multicast_group == NULL && !config->multicast_topics.empty()) {
+        return false;
+    }
+
+    /*
+        The port is not needed when the sockets are taken over
+    */
+    if(optind >= argc) {
+        return config->takeover_path != NULL;
+    }
+    config->port = atoi(argv[optind]);
+    return config->port > 0;
+}
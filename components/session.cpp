@@ -0,0 +1,169 @@
+/**
+ * @file session.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Coroutines of the client connections. Each connection is a
+ * coroutine frame suspended on its socket, resumed by the select() loop
+ * when the socket is ready, so a slow client only delays itself.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#include "../include/session.h"
+#include "../include/federation.h"
+#include "../include/subscriber.h"
+#include "../include/multicast.h"
+#include "../include/heartbeat.h"
+
+using namespace std;
+
+/**
+ * @brief Applies the commands of a logged in client until it disconnects:
+ *      1. Subscribe request
+ *      2. Unsubscribe request
+ *      3. Bulk of subscribe/unsubscribe commands
+ *      4. NAK of the posts missed from the multicast group
+ *      5. Heartbeat, only the answer to one (every frame shows that the
+ *         client is alive)
+ *
+ * @param context - server
+ * @param socket_fd - socket of the client
+ * @return false - the client disconnected
+ */
+static Async serve_commands(struct Session_Context* context, int socket_fd) {
+    struct Database *database = context->database;
+    struct Send_Header header;
+    vector<char> body;
+
+    while(true) {
+        bool received = co_await async_recv_frame(context->loop, socket_fd, &header,
+                                                  body, MAX_BULK_LEN);
+        if(received == false) {
+            break;
+        }
+        heard_from((*database).heartbeat, socket_fd, header.operation);
+        if(header.operation == HEARTBEAT_CODE) {   /* (5) */
+            continue;
+        }
+        if(header.operation == BULK_SUBSCRIPTION_CODE) {   /* (3) */
+            apply_bulk_subscriptions(database, socket_fd, body.data(), header.size);
+            continue;
+        }
+        if(header.size > BUFLEN - 1) {
+            continue;
+        }
+
+        char command[BUFLEN];
+        memcpy(command, body.data(), header.size + 1);
+
+        if(header.operation == SUBSCRIBE_CODE) {    /* (1) */
+            add_subscription(database, socket_fd, command);
+        } else if(header.operation == UNSUBSCRIBE_CODE) { /* (2) */
+            remove_subscription(database, socket_fd, command);
+        } else if(header.operation == NAK_CODE) {   /* (4) */
+            answer_nak(database, socket_fd, command);
+        }
+    }
+    co_return false;
+}
+
+/**
+ * @brief The client disconnected: it is set offline, its socket is
+ * forgotten and closed.
+ */
+static void end_session(struct Session_Context* context, int socket_fd) {
+    auto location = (*context->database).locations.find(socket_fd);
+    if(location != (*context->database).locations.end()) {
+        cout << "Client " << location->second.ID << " disconnected." << endl;
+    }
+    disconnect_client(context->database, socket_fd);
+    forget_peer((*context->database).heartbeat, socket_fd);
+    close_connection(context->database, socket_fd);
+    forget_socket(context->loop, socket_fd);
+    close(socket_fd);
+}
+
+/**
+ * @brief Refuses the connection: ID_IN_USE is sent (without blocking)
+ * and the socket is closed.
+ */
+static Async refuse_client(struct Session_Context* context, int socket_fd) {
+    co_await async_send_frame(context->loop, socket_fd, ID_IN_USE_CODE,
+                              ID_IN_USE, strlen(ID_IN_USE) + 1);
+    forget_socket(context->loop, socket_fd);
+    close(socket_fd);
+    co_return false;
+}
+
+Task client_session(struct Session_Context* context, int socket_fd,
+                    struct sockaddr_in address) {
+    struct Database *database = context->database;
+    struct Send_Header header;
+    vector<char> body;
+
+    bool received = co_await async_recv_frame(context->loop, socket_fd, &header, body, BUFLEN);
+    if(received == false) {
+        forget_socket(context->loop, socket_fd);
+        close(socket_fd);
+        co_return;
+    }
+
+    /*
+        Another server of the mesh opens its link with a PEER_HELLO
+    */
+    if(header.operation == PEER_HELLO_CODE && context->federation != NULL) {
+        accept_peer(context->federation, database, socket_fd, address, body.data());
+        co_return;
+    }
+
+    /*
+        The ID of the client; the session of the ID stays CONNECTING until
+        the login ends, so the same ID cannot log in meanwhile
+    */
+    if(header.size <= 0 || header.size >= ID_MAX_LEN) {
+        co_await refuse_client(context, socket_fd);
+        co_return;
+    }
+    struct Login_Key key;
+    make_login_key(body.data(), &key);
+    if(begin_login(&(*database).sessions, &key, socket_fd) == false) {
+        cout << "Client " << key.ID << " already connected." << endl;
+        co_await refuse_client(context, socket_fd);
+        co_return;
+    }
+
+    /*
+        A client that keeps its sequences follows the ID with the last
+        sequence it received on each topic
+    */
+    int operation = header.operation;
+    unordered_map<string, uint64_t> resume_from;
+    if((operation & ID_RESUME_FLAG) != 0) {
+        received = co_await async_recv_frame(context->loop, socket_fd, &header, body, MAX_BULK_LEN);
+        if(received == false || header.operation != RESUME_CODE) {
+            set_session(&(*database).sessions, &key, -1, SESSION_OFFLINE);
+            co_await refuse_client(context, socket_fd);
+            co_return;
+        }
+        parse_resume(body.data(), header.size, resume_from);
+    }
+
+    /*
+        The SF queue is only appended to the output of the socket
+    */
+    login_client(database, socket_fd, address, &key, operation, resume_from);
+    watch_peer((*database).heartbeat, socket_fd, (operation & ID_HEARTBEAT_FLAG) != 0);
+
+    co_await serve_commands(context, socket_fd);
+    end_session(context, socket_fd);
+}
+
+Task client_commands(struct Session_Context* context, int socket_fd) {
+    /* Whether it answers the heartbeats was handed over with its ID */
+    struct Subscriber *subscriber = find_subscriber(context->database, socket_fd);
+    watch_peer((*context->database).heartbeat, socket_fd,
+               subscriber != NULL && subscriber->heartbeats);
+    co_await serve_commands(context, socket_fd);
+    end_session(context, socket_fd);
+}
@@ -0,0 +1,300 @@
+/**
+ * @file shared_ring.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Single producer / single consumer ring in shared memory. The
+ * server writes the frames of a co-located subscriber directly in its
+ * memory; a system call (eventfd write) is only needed when the
+ * subscriber sleeps, instead of a send and a recv for every frame.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/shared_ring.h"
+#include "../include/constants.h"
+#include <new>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+using namespace std;
+
+/*
+    The header takes the first page, the data starts page aligned.
+*/
+#define RING_HEADER_LEN     4096
+
+static void futex_wait(atomic<uint32_t> *word, uint32_t value, long timeout_ns) {
+    struct timespec timeout = {0, timeout_ns};
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static void futex_wake(atomic<uint32_t> *word) {
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/**
+ * @brief Creates a ring having <capacity> bytes for frames (rounded up to a
+ * power of 2, so positions are reduced with a mask).
+ * 
+ * @param ring result
+ * @param capacity bytes for frames
+ * @return true - success
+ * @return false - the memory or the eventfd could not be created
+ */
+bool create_ring(struct Shared_Ring* ring, size_t capacity) {
+    size_t rounded = RING_HEADER_LEN;
+    while(rounded < capacity) {
+        rounded <<= 1;
+    }
+
+    ring->memory_fd = memfd_create("subscriber_ring", MFD_CLOEXEC);
+    if(ring->memory_fd < 0) {
+        return false;
+    }
+    ring->mapped_size = RING_HEADER_LEN + rounded;
+    if(ftruncate(ring->memory_fd, ring->mapped_size) < 0) {
+        close(ring->memory_fd);
+        return false;
+    }
+
+    void *memory = mmap(NULL, ring->mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, ring->memory_fd, 0);
+    if(memory == MAP_FAILED) {
+        close(ring->memory_fd);
+        return false;
+    }
+
+    ring->header = new (memory) struct Ring_Header;
+    ring->header->head              = 0;
+    ring->header->tail              = 0;
+    ring->header->consumer_waiting  = 0;
+    ring->header->producer_waiting  = 0;
+    ring->header->capacity          = rounded;
+    ring->data = (char *) memory + RING_HEADER_LEN;
+
+    ring->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(ring->event_fd < 0) {
+        munmap(memory, ring->mapped_size);
+        close(ring->memory_fd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Maps the ring received from the server.
+ * 
+ * @param ring result
+ * @param memory_fd memfd of the ring
+ * @param event_fd eventfd of the ring
+ * @return true - success
+ * @return false - invalid ring
+ */
+bool attach_ring(struct Shared_Ring* ring, int memory_fd, int event_fd) {
+    struct stat memory_stat;
+    if(fstat(memory_fd, &memory_stat) < 0 || memory_stat.st_size <= RING_HEADER_LEN) {
+        return false;
+    }
+
+    ring->mapped_size = memory_stat.st_size;
+    void *memory = mmap(NULL, ring->mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, memory_fd, 0);
+    if(memory == MAP_FAILED) {
+        return false;
+    }
+
+    ring->header    = (struct Ring_Header *) memory;
+    ring->data      = (char *) memory + RING_HEADER_LEN;
+    ring->memory_fd = memory_fd;
+    ring->event_fd  = event_fd;
+
+    uint64_t capacity = ring->header->capacity;
+    if(capacity + RING_HEADER_LEN != ring->mapped_size || (capacity & (capacity - 1)) != 0) {
+        destroy_ring(ring);
+        return false;
+    }
+    return true;
+}
+
+void destroy_ring(struct Shared_Ring* ring) {
+    munmap(ring->header, ring->mapped_size);
+    close(ring->memory_fd);
+    close(ring->event_fd);
+}
+
+static void copy_in(struct Shared_Ring* ring, uint64_t position, const void *source, size_t length) {
+    uint64_t capacity = ring->header->capacity;
+    size_t offset = position & (capacity - 1);
+    size_t first = min(length, (size_t) (capacity - offset));
+
+    memcpy(ring->data + offset, source, first);
+    memcpy(ring->data, (const char *) source + first, length - first);
+}
+
+static void copy_out(struct Shared_Ring* ring, uint64_t position, void *destination, size_t length) {
+    uint64_t capacity = ring->header->capacity;
+    size_t offset = position & (capacity - 1);
+    size_t first = min(length, (size_t) (capacity - offset));
+
+    memcpy(destination, ring->data + offset, first);
+    memcpy((char *) destination + first, ring->data, length - first);
+}
+
+/**
+ * @brief Checks if the subscriber closed its socket while the server waits
+ * for space in its ring.
+ */
+static bool subscriber_left(int socket_fd) {
+    char byte;
+    ssize_t return_value = recv(socket_fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return return_value == 0 ||
+           (return_value < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+/**
+ * @brief Producer side, never waits: writes the parts as one frame if the
+ * ring has space for all of them and publishes it by moving the head. The
+ * eventfd is only written if the subscriber announced that it sleeps.
+ * 
+ * @param ring ring
+ * @param parts parts of the frame (header, body)
+ * @param count number of parts
+ * @return true - the frame was written
+ * @return false - no space for the frame now
+ */
+bool ring_try_write(struct Shared_Ring* ring, const struct iovec *parts, int count) {
+    struct Ring_Header *header = ring->header;
+    uint64_t total = 0;
+    for(int i = 0; i < count; i++) {
+        total += parts[i].iov_len;
+    }
+
+    uint64_t head = header->head.load(memory_order_relaxed);
+    if(header->capacity - (head - header->tail.load(memory_order_acquire)) < total) {
+        return false;
+    }
+    uint64_t position = head;
+    for(int i = 0; i < count; i++) {
+        copy_in(ring, position, parts[i].iov_base, parts[i].iov_len);
+        position += parts[i].iov_len;
+    }
+    header->head.store(head + total);
+
+    if(header->consumer_waiting.load() == 1) {
+        header->consumer_waiting.store(0);
+        uint64_t signal = 1;
+        if(write(ring->event_fd, &signal, sizeof(uint64_t)) < 0) {
+            signal = 0;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Producer side. Waits (futex) while there is no space for the frame,
+ * then writes it (see ring_try_write).
+ * 
+ * @param ring ring
+ * @param operation operation of the frame
+ * @param body body of the frame
+ * @param size size of the body
+ * @param socket_fd socket of the subscriber
+ * @param sequence sequence of the post in its topic (0 for other frames)
+ * @return true - the frame was written
+ * @return false - the subscriber left or the frame is larger than the ring
+ */
+bool ring_write_frame(struct Shared_Ring* ring, int operation,
+                      const char *body, int size, int socket_fd,
+                      uint64_t sequence) {
+    struct Ring_Header *header = ring->header;
+    uint64_t total = sizeof(struct Send_Header) + size;
+    if(total > header->capacity) {
+        return false;
+    }
+
+    struct Send_Header frame_header;
+    frame_header.operation  = operation;
+    frame_header.size       = size;
+    frame_header.sequence   = sequence;
+    struct iovec parts[2];
+    parts[0].iov_base = &frame_header;
+    parts[0].iov_len  = sizeof(struct Send_Header);
+    parts[1].iov_base = (void *) body;
+    parts[1].iov_len  = size;
+
+    while(ring_try_write(ring, parts, 2) == false) {
+        header->producer_waiting.store(1);
+        if(ring_free_space(ring) >= total) {
+            header->producer_waiting.store(0);
+            continue;
+        }
+        futex_wait(&header->producer_waiting, 1, RING_WAIT_NS);
+        if(subscriber_left(socket_fd)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t ring_free_space(struct Shared_Ring* ring) {
+    struct Ring_Header *header = ring->header;
+    return header->capacity - (header->head.load(memory_order_relaxed) -
+                               header->tail.load(memory_order_acquire));
+}
+
+/**
+ * @brief Consumer side. Copies the next frame and frees its space, waking
+ * the server if it waits for space.
+ * 
+ * @param ring ring
+ * @param header result - header of the frame
+ * @param body result - body of the frame ('\0' terminated)
+ * @return true - a frame was read
+ * @return false - the ring is empty
+ */
+bool ring_read_frame(struct Shared_Ring* ring, struct Send_Header *header,
+                     vector<char> &body) {
+    struct Ring_Header *ring_header = ring->header;
+    uint64_t tail = ring_header->tail.load(memory_order_relaxed);
+    uint64_t head = ring_header->head.load(memory_order_acquire);
+    if(head == tail) {
+        return false;
+    }
+
+    copy_out(ring, tail, header, sizeof(struct Send_Header));
+    if(header->size < 0 || (uint64_t) header->size > head - tail - sizeof(struct Send_Header)) {
+        return false;
+    }
+    body.resize(header->size + 1);
+    copy_out(ring, tail + sizeof(struct Send_Header), body.data(), header->size);
+    body[header->size] = '\0';
+
+    ring_header->tail.store(tail + sizeof(struct Send_Header) + header->size);
+    if(ring_header->producer_waiting.load() == 1) {
+        ring_header->producer_waiting.store(0);
+        futex_wake(&ring_header->producer_waiting);
+    }
+    return true;
+}
+
+bool ring_prepare_wait(struct Shared_Ring* ring) {
+    ring->header->consumer_waiting.store(1);
+    if(ring->header->head.load() != ring->header->tail.load(memory_order_relaxed)) {
+        ring->header->consumer_waiting.store(0);
+        return false;
+    }
+    return true;
+}
+
+void ring_finish_wait(struct Shared_Ring* ring) {
+    uint64_t signal;
+    if(read(ring->event_fd, &signal, sizeof(uint64_t)) < 0) {
+        signal = 0;
+    }
+    ring->header->consumer_waiting.store(0);
+}
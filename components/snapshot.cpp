@@ -0,0 +1,677 @@
+/**
+ * @file snapshot.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Snapshot and change journal of the Database, so that the
+ * subscribers, their subscriptions and their SF queues survive a
+ * restart of the server.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/snapshot.h"
+#include "../include/constants.h"
+#include "../include/latency.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/*
+    Reader over a serialized buffer. Every read checks the bounds,
+    a truncated or corrupted buffer sets <ok> to false.
+*/
+struct Reader {
+    const char *p;
+    const char *end;
+    bool ok;
+};
+
+static void put_bytes(vector<char> &buffer, const void *data, size_t length) {
+    const char *p = (const char *) data;
+    buffer.insert(buffer.end(), p, p + length);
+}
+
+static void put_u8(vector<char> &buffer, uint8_t value) {
+    buffer.push_back((char) value);
+}
+
+static void put_u32(vector<char> &buffer, uint32_t value) {
+    put_bytes(buffer, &value, sizeof(uint32_t));
+}
+
+static void put_u64(vector<char> &buffer, uint64_t value) {
+    put_bytes(buffer, &value, sizeof(uint64_t));
+}
+
+static void put_string(vector<char> &buffer, const char *data, uint32_t length) {
+    put_u32(buffer, length);
+    put_bytes(buffer, data, length);
+}
+
+static bool get_bytes(struct Reader* reader, void *data, size_t length) {
+    if(reader->ok == false || (size_t) (reader->end - reader->p) < length) {
+        reader->ok = false;
+        return false;
+    }
+    memcpy(data, reader->p, length);
+    reader->p += length;
+    return true;
+}
+
+static uint8_t get_u8(struct Reader* reader) {
+    uint8_t value = 0;
+    get_bytes(reader, &value, sizeof(uint8_t));
+    return value;
+}
+
+static uint32_t get_u32(struct Reader* reader) {
+    uint32_t value = 0;
+    get_bytes(reader, &value, sizeof(uint32_t));
+    return value;
+}
+
+static uint64_t get_u64(struct Reader* reader) {
+    uint64_t value = 0;
+    get_bytes(reader, &value, sizeof(uint64_t));
+    return value;
+}
+
+/*
+    Returns a pointer inside the buffer, the string is not copied.
+*/
+static const char* get_string(struct Reader* reader, uint32_t *length, uint32_t max_length) {
+    *length = get_u32(reader);
+    if(reader->ok == false || *length > max_length ||
+       (size_t) (reader->end - reader->p) < *length) {
+        reader->ok = false;
+        return NULL;
+    }
+    const char *data = reader->p;
+    reader->p += *length;
+    return data;
+}
+
+/*
+    Queued post: <value, sequence, topic, queued at, address, port, type>
+*/
+static void put_post(vector<char> &buffer, const struct Stored_Post *post) {
+    put_string(buffer, post->value.data(), post->value.size());
+    put_u64(buffer, post->sequence);
+    put_string(buffer, post->topic->data(), post->topic->size());
+    put_u64(buffer, post->queued_at);
+    put_u32(buffer, post->address);
+    put_bytes(buffer, &post->port, sizeof(uint16_t));
+    put_u8(buffer, post->data_type);
+}
+
+static void journal_record(struct Journal* journal, uint8_t type, const char *ID) {
+    /*
+        Do not let the pending records grow between two snapshots
+    */
+    if(journal->pending.size() >= JOURNAL_FLUSH_LEN) {
+        journal_flush(journal);
+    }
+    put_u8(journal->pending, type);
+    put_string(journal->pending, ID, strlen(ID));
+}
+
+void journal_client(struct Journal* journal, const char *ID) {
+    if(journal == NULL) {
+        return;
+    }
+    journal_record(journal, JOURNAL_CLIENT, ID);
+}
+
+void journal_subscribe(struct Journal* journal, const char *ID,
+                       const string &topic, bool SF) {
+    if(journal == NULL) {
+        return;
+    }
+    journal_record(journal, JOURNAL_SUBSCRIBE, ID);
+    put_string(journal->pending, topic.data(), topic.size());
+    put_u8(journal->pending, SF);
+}
+
+void journal_unsubscribe(struct Journal* journal, const char *ID,
+                         const string &topic) {
+    if(journal == NULL) {
+        return;
+    }
+    journal_record(journal, JOURNAL_UNSUBSCRIBE, ID);
+    put_string(journal->pending, topic.data(), topic.size());
+}
+
+void journal_enqueue(struct Journal* journal, const char *ID,
+                     const struct Stored_Post *post) {
+    if(journal == NULL) {
+        return;
+    }
+    journal_record(journal, JOURNAL_ENQUEUE, ID);
+    put_post(journal->pending, post);
+}
+
+void journal_drain(struct Journal* journal, const char *ID) {
+    if(journal == NULL) {
+        return;
+    }
+    journal_record(journal, JOURNAL_DRAIN, ID);
+}
+
+void journal_sequence(struct Journal* journal, const string &topic,
+                      uint64_t reserved) {
+    if(journal == NULL) {
+        return;
+    }
+    journal_record(journal, JOURNAL_SEQUENCE, topic.c_str());
+    put_u64(journal->pending, reserved);
+}
+
+/**
+ * @brief Starts the empty journal with its epoch.
+ */
+static bool journal_epoch(struct Journal* journal) {
+    journal_record(journal, JOURNAL_EPOCH, "");
+    put_u64(journal->pending, journal->epoch);
+    return journal_flush(journal);
+}
+
+/**
+ * @brief Appends the pending records to the journal file.
+ * 
+ * @param journal journal
+ * @return true - all the records were written
+ * @return false - error in writing
+ */
+bool journal_flush(struct Journal* journal) {
+    if(journal == NULL || journal->pending.empty()) {
+        return true;
+    }
+
+    const char *p = journal->pending.data();
+    size_t length = journal->pending.size();
+    while(length > 0) {
+        ssize_t return_value = write(journal->fd, p, length);
+        if(return_value < 0 && errno == EINTR) {
+            continue;
+        }
+        if(return_value <= 0) {
+            return false;
+        }
+        p += return_value;
+        length -= return_value;
+    }
+
+    journal->size += journal->pending.size();
+    journal->pending.clear();
+    return true;
+}
+
+/**
+ * @brief Serializes the topics (each with its number of subscribers) and
+ * then every subscriber with its subscriptions, as indexes in the topics,
+ * and its SF queue.
+ * 
+ * @param database database
+ * @param buffer result
+ * @param epoch epoch of the journal that follows the snapshot
+ */
+void serialize_database(struct Database* database, vector<char> &buffer, uint64_t epoch) {
+    unordered_map<string, uint32_t> topic_index;
+    topic_index.reserve((*database).subscription.size());
+
+    put_bytes(buffer, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
+    put_u64(buffer, epoch);
+    put_u32(buffer, (*database).online.size());
+    put_u32(buffer, (*database).subscription.size());
+
+    for(auto &topic : (*database).subscription) {
+        topic_index[topic.first] = topic_index.size();
+        put_string(buffer, topic.first.data(), topic.first.size());
+        put_u32(buffer, topic.second.IDs.size());
+    }
+
+    for(auto &user_data : (*database).online) {
+        struct Subscriber &user = user_data.second;
+        put_string(buffer, user.ID, strlen(user.ID));
+
+        put_u32(buffer, user.subscription_types.size());
+        for(auto &topic : user.subscription_types) {
+            put_u32(buffer, topic_index[topic.first]);
+            put_u8(buffer, topic.second);
+        }
+
+        /*
+            The posts evicted by the retention policies are left out
+        */
+        uint32_t posts = 0;
+        for(auto &post : user.SF_queue) {
+            posts += (post.operation != EVICTED_POST);
+        }
+        put_u32(buffer, posts);
+        for(auto &post : user.SF_queue) {
+            if(post.operation == EVICTED_POST) {
+                continue;
+            }
+            put_post(buffer, &post);
+        }
+    }
+
+    put_u32(buffer, (*database).topic_logs.size());
+    for(auto &log : (*database).topic_logs) {
+        put_string(buffer, log.first.data(), log.first.size());
+        put_u64(buffer, log.second.reserved);
+    }
+}
+
+/**
+ * @brief Continues the numbering of a topic from <sequence>, unless it
+ * already got further.
+ */
+static void restore_sequence(struct Database* database, const string &topic,
+                             uint64_t sequence) {
+    struct Topic_Log &log = (*database).topic_logs[topic];
+    log.sequence = max(log.sequence, sequence);
+    log.reserved = max(log.reserved, sequence);
+}
+
+/**
+ * @brief Reads a queued post (see put_post), its topic is interned in the
+ * <database>.
+ */
+static bool get_post(struct Reader* reader, struct Database* database, struct Stored_Post* post) {
+    uint32_t length;
+    const char *value = get_string(reader, &length, CONTENT_LEN - 1);
+    if(value == NULL) {
+        return false;
+    }
+    post->operation     = SUBSCRIPTION_SEND;
+    post->ingress_ns    = 0;
+    post->value.assign(value, length);
+
+    post->sequence = get_u64(reader);
+    const char *topic = get_string(reader, &length, TOPIC_LEN);
+    if(topic == NULL) {
+        return false;
+    }
+    post->queued_at = get_u64(reader);
+    post->address   = get_u32(reader);
+    get_bytes(reader, &post->port, sizeof(uint16_t));
+    post->data_type = get_u8(reader);
+    if(reader->ok == false) {
+        return false;
+    }
+    post->topic = intern_topic(database, string(topic, length));
+    return true;
+}
+
+/**
+ * @brief Restores the subscribers in the <database>. The subscribers are
+ * added offline, with no socket. The topic index is allocated at its final
+ * size from the topic table, then the subscriptions are appended directly
+ * to it, without hashing the topics again.
+ * 
+ * @param database database
+ * @param data serialized buffer
+ * @param size size of the buffer
+ * @param epoch result, epoch of the journal of the snapshot (if not NULL)
+ * @return true - valid buffer
+ * @return false - corrupted buffer
+ */
+bool deserialize_database(struct Database* database, const char *data, size_t size,
+                          uint64_t *epoch) {
+    struct Reader reader = {data, data + size, true};
+    char magic[SNAPSHOT_MAGIC_LEN];
+
+    if(get_bytes(&reader, magic, SNAPSHOT_MAGIC_LEN) == false ||
+       memcmp(magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) != 0) {
+        return false;
+    }
+
+    uint64_t journal_epoch  = get_u64(&reader);
+    if(epoch != NULL) {
+        *epoch = journal_epoch;
+    }
+    uint32_t subscribers    = get_u32(&reader);
+    uint32_t topics         = get_u32(&reader);
+    if(reader.ok == false || topics > size) {
+        return false;
+    }
+    (*database).online.reserve((*database).online.size() + subscribers);
+    (*database).subscription.reserve((*database).subscription.size() + topics);
+
+    vector<const string*> topic_names(topics);
+    vector<struct Topic_Subscribers*> topic_subscribers(topics);
+    for(uint32_t i = 0; i < topics; i++) {
+        uint32_t length;
+        const char *topic = get_string(&reader, &length, TOPIC_LEN - 1);
+        uint32_t count = get_u32(&reader);
+        if(reader.ok == false) {
+            return false;
+        }
+
+        auto entry = (*database).subscription.emplace(string(topic, length),
+                                                      Topic_Subscribers()).first;
+        entry->second.IDs.reserve(entry->second.IDs.size() + count);
+        entry->second.position.reserve(entry->second.position.size() + count);
+        topic_names[i]          = &entry->first;
+        topic_subscribers[i]    = &entry->second;
+    }
+
+    for(uint32_t i = 0; i < subscribers && reader.ok; i++) {
+        uint32_t length;
+        const char *ID = get_string(&reader, &length, ID_MAX_LEN - 1);
+        if(ID == NULL) {
+            return false;
+        }
+
+        string key(ID, length);
+        struct Subscriber &user = (*database).online[key];
+        strcpy(user.ID, key.c_str());
+        user.socket_fd  = -1;
+        user.online     = false;
+
+        uint32_t count = get_u32(&reader);
+        user.subscription_types.reserve(count);
+        for(uint32_t j = 0; j < count && reader.ok; j++) {
+            uint32_t topic = get_u32(&reader);
+            bool SF = get_u8(&reader);
+            if(reader.ok == false || topic >= topics) {
+                return false;
+            }
+
+            if(user.subscription_types.emplace(*topic_names[topic], SF).second == false) {
+                continue;
+            }
+            struct Topic_Subscribers* subscribers_of_topic = topic_subscribers[topic];
+            subscribers_of_topic->position.emplace(key, subscribers_of_topic->IDs.size());
+            subscribers_of_topic->IDs.push_back(key);
+        }
+
+        count = get_u32(&reader);
+        for(uint32_t j = 0; j < count && reader.ok; j++) {
+            struct Stored_Post post;
+            if(get_post(&reader, database, &post) == false) {
+                return false;
+            }
+            user.SF_queue.push_back(post);
+        }
+    }
+
+    uint32_t logs = get_u32(&reader);
+    for(uint32_t i = 0; i < logs && reader.ok; i++) {
+        uint32_t length;
+        const char *topic = get_string(&reader, &length, TOPIC_LEN);
+        uint64_t sequence = get_u64(&reader);
+        if(reader.ok == false) {
+            return false;
+        }
+        restore_sequence(database, string(topic, length), sequence);
+    }
+    return reader.ok;
+}
+
+/**
+ * @brief Returns the subscriber having the ID, creating it as an offline
+ * client if it is not in the database.
+ */
+static struct Subscriber& journal_subscriber(struct Database* database, const string &ID) {
+    auto find_user = (*database).online.find(ID);
+    if(find_user != (*database).online.end()) {
+        return find_user->second;
+    }
+
+    struct Subscriber &user = (*database).online[ID];
+    strcpy(user.ID, ID.c_str());
+    user.socket_fd  = -1;
+    user.online     = false;
+    return user;
+}
+
+/**
+ * @brief Applies the journal records in order. A record cut by a crash
+ * at the end of the journal is ignored, and so is a journal of another
+ * epoch than the snapshot (its records are already in the snapshot).
+ * 
+ * @param database database
+ * @param data journal
+ * @param size size of the journal
+ * @param epoch epoch of the snapshot
+ * @return size of the valid records
+ */
+static size_t replay_journal(struct Database* database, const char *data, size_t size,
+                             uint64_t epoch) {
+    struct Reader reader = {data, data + size, true};
+    size_t valid = 0;
+
+    uint32_t length;
+    if(get_u8(&reader) != JOURNAL_EPOCH || get_string(&reader, &length, 0) == NULL ||
+       get_u64(&reader) != epoch || reader.ok == false) {
+        return 0;
+    }
+    valid = reader.p - data;
+
+    while(reader.p < reader.end) {
+        uint32_t length;
+        uint8_t type = get_u8(&reader);
+        const char *ID = get_string(&reader, &length,
+                                    type == JOURNAL_SEQUENCE ? TOPIC_LEN : ID_MAX_LEN - 1);
+        if(ID == NULL) {
+            break;
+        }
+        string key(ID, length);
+
+        if(type == JOURNAL_CLIENT) {
+            journal_subscriber(database, key);
+        } else if(type == JOURNAL_SUBSCRIBE) {
+            const char *topic = get_string(&reader, &length, TOPIC_LEN - 1);
+            bool SF = get_u8(&reader);
+            if(reader.ok == false) {
+                break;
+            }
+            subscribe_topic(database, &journal_subscriber(database, key),
+                            string(topic, length), SF);
+        } else if(type == JOURNAL_UNSUBSCRIBE) {
+            const char *topic = get_string(&reader, &length, TOPIC_LEN - 1);
+            if(reader.ok == false) {
+                break;
+            }
+            unsubscribe_topic(database, &journal_subscriber(database, key),
+                              string(topic, length));
+        } else if(type == JOURNAL_ENQUEUE) {
+            struct Stored_Post post;
+            if(get_post(&reader, database, &post) == false) {
+                break;
+            }
+            journal_subscriber(database, key).SF_queue.push_back(post);
+        } else if(type == JOURNAL_DRAIN) {
+            journal_subscriber(database, key).SF_queue.clear();
+        } else if(type == JOURNAL_SEQUENCE) {
+            uint64_t reserved = get_u64(&reader);
+            if(reader.ok == false) {
+                break;
+            }
+            restore_sequence(database, key, reserved);
+        } else {
+            break;
+        }
+        valid = reader.p - data;
+    }
+    return valid;
+}
+
+/**
+ * @brief Maps a whole file in memory.
+ * 
+ * @param path file
+ * @param size size of the file
+ * @return the mapping, NULL if the file is missing or empty
+ */
+static char* map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) < 0 || file_stat.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    *size = file_stat.st_size;
+    void *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(data, *size, MADV_SEQUENTIAL);
+    return (char *) data;
+}
+
+/**
+ * @brief Opens <path>.journal for appending.
+ * 
+ * @param journal journal
+ * @param path snapshot file
+ */
+void open_journal(struct Journal* journal, const char *path) {
+    string journal_path = string(path) + ".journal";
+
+    journal->size           = 0;
+    journal->snapshot_size  = 0;
+    journal->epoch          = 0;
+    journal->pending.clear();
+    journal->fd = open(journal_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    DIE(journal->fd < 0, "Error in opening the journal.");
+}
+
+/**
+ * @brief Loads the snapshot and replays the journal. The journal is then
+ * kept open for appending the next changes of the database.
+ * 
+ * @param database database
+ * @param journal journal of the database
+ * @param path snapshot file
+ * @return true - the state was restored (or there was no state)
+ * @return false - corrupted snapshot
+ */
+bool load_snapshot(struct Database* database, struct Journal* journal,
+                   const char *path) {
+    size_t size = 0;
+    bool result = true;
+
+    open_journal(journal, path);
+
+    char *data = map_file(path, &size);
+    if(data != NULL) {
+        result = deserialize_database(database, data, size, &journal->epoch);
+        journal->snapshot_size = size;
+        munmap(data, size);
+    }
+
+    string journal_path = string(path) + ".journal";
+    data = map_file(journal_path.c_str(), &size);
+    if(data != NULL) {
+        journal->size = replay_journal(database, data, size, journal->epoch);
+        munmap(data, size);
+        if(journal->size != size) {
+            DIE(ftruncate(journal->fd, journal->size) < 0, "Error in truncating the journal.");
+        }
+    }
+    if(journal->size == 0) {
+        DIE(journal_epoch(journal) == false, "Error in writing the journal.");
+    }
+
+    (*database).journal = journal;
+    return result;
+}
+
+/**
+ * @brief Writes the full state in <path>.tmp with a new epoch, renames it
+ * over the previous snapshot and empties the journal, since every change
+ * is now in the snapshot. Until the journal starts again with the new
+ * epoch, its records are ignored by load_snapshot.
+ * 
+ * @param database database
+ * @param path snapshot file
+ * @return true - the snapshot was written
+ * @return false - error in writing the snapshot
+ */
+bool save_snapshot(struct Database* database, const char *path) {
+    struct Journal *journal = (*database).journal;
+    uint64_t epoch = 0;
+    if(journal != NULL) {
+        epoch = max(journal->epoch + 1, now_ns());
+    }
+
+    vector<char> buffer;
+    serialize_database(database, buffer, epoch);
+
+    string temporary_path = string(path) + ".tmp";
+    int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        return false;
+    }
+
+    const char *p = buffer.data();
+    size_t length = buffer.size();
+    while(length > 0) {
+        ssize_t return_value = write(fd, p, length);
+        if(return_value < 0 && errno == EINTR) {
+            continue;
+        }
+        if(return_value <= 0) {
+            close(fd);
+            return false;
+        }
+        p += return_value;
+        length -= return_value;
+    }
+
+    if(fsync(fd) < 0 || close(fd) < 0 ||
+       rename(temporary_path.c_str(), path) < 0) {
+        return false;
+    }
+
+    if(journal != NULL) {
+        journal->pending.clear();
+        journal->size           = 0;
+        journal->snapshot_size  = buffer.size();
+        journal->epoch          = epoch;
+        if(ftruncate(journal->fd, 0) < 0) {
+            return false;
+        }
+        return journal_epoch(journal);
+    }
+    return true;
+}
+
+/**
+ * @brief The periodic snapshot only writes the records added since the
+ * previous one. Rewriting the whole state only happens once the journal
+ * grew larger than the snapshot, so its cost stays proportional to the
+ * changes.
+ * 
+ * @param database database
+ * @param path snapshot file
+ * @return true - success
+ * @return false - error in writing
+ */
+bool checkpoint_snapshot(struct Database* database, const char *path) {
+    struct Journal *journal = (*database).journal;
+    if(journal == NULL) {
+        return save_snapshot(database, path);
+    }
+
+    if(journal_flush(journal) == false) {
+        return false;
+    }
+    if(journal->size > journal->snapshot_size) {
+        return save_snapshot(database, path);
+    }
+    return fdatasync(journal->fd) == 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * @file stored_post.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Compact forms of the stored posts: the payload as received for
+ * the SF queues, delta-encoded blocks for the retained logs. The texts are
+ * only made when the posts are delivered.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#include "../include/stored_post.h"
+#include "../include/database.h"
+
+using namespace std;
+
+/*
+    Bytes of the payload of each type, the text of a STRING ends at its
+    first NUL
+*/
+static const int payload_length[] = {5, 2, 6};
+
+/**
+ * @brief Bytes of the payload of the post.
+ */
+static int value_length(const struct Subscription_Post* post) {
+    if((unsigned char) post->data_type < LOG_NUMERIC_TYPES) {
+        return payload_length[(unsigned char) post->data_type];
+    }
+    return strnlen(post->content, CONTENT_LEN - 1);
+}
+
+void store_post(struct Stored_Post* stored, const string *topic,
+                const struct Subscription_Post* post, struct sockaddr_in source,
+                uint64_t sequence, uint64_t ingress_ns, time_t queued_at) {
+    stored->topic       = topic;
+    stored->sequence    = sequence;
+    stored->ingress_ns  = ingress_ns;
+    stored->queued_at   = queued_at;
+    stored->address     = source.sin_addr.s_addr;
+    stored->port        = source.sin_port;
+    stored->operation   = SUBSCRIPTION_SEND;
+    stored->data_type   = post->data_type;
+    stored->value.assign(post->content, value_length(post));
+}
+
+uint64_t stored_post_bytes(const struct Stored_Post* stored) {
+    /* The short strings are kept in the string itself */
+    uint64_t bytes = sizeof(struct Stored_Post);
+    if(stored->value.capacity() > 15) {
+        bytes += stored->value.capacity() + 1;
+    }
+    return bytes;
+}
+
+void format_post(struct Subscription_Post* post, struct sockaddr_in source,
+                 struct Send_Post* transform) {
+    char IP[IP_LEN];
+    inet_ntop(AF_INET, &(source.sin_addr), IP, IP_LEN);
+    transform->operation = SUBSCRIPTION_SEND;
+    transform->content[0] = '\0';
+    receive_post(post, transform, IP, source);
+}
+
+void format_stored_post(const struct Stored_Post* stored, struct Send_Post* transform) {
+    struct Subscription_Post post;
+    size_t length = strnlen(stored->topic->c_str(), TOPIC_LEN - 1);
+    memcpy(post.topic, stored->topic->c_str(), length);
+    post.topic[length] = '\0';
+    post.data_type = stored->data_type;
+    memcpy(post.content, stored->value.data(), stored->value.size());
+    post.content[stored->value.size()] = '\0';
+
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(struct sockaddr_in));
+    source.sin_family       = AF_INET;
+    source.sin_addr.s_addr  = stored->address;
+    source.sin_port         = stored->port;
+    format_post(&post, source, transform);
+}
+
+static void put_varint(string &buffer, uint64_t value) {
+    while(value >= 0x80) {
+        buffer.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char) value);
+}
+
+static uint64_t get_varint(const string &buffer, size_t *offset) {
+    uint64_t value = 0;
+    for(int shift = 0; shift < 64 && *offset < buffer.size(); shift += 7) {
+        uint8_t byte = buffer[(*offset)++];
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    return value;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/**
+ * @brief Number carried by a numeric payload (see Post_Log).
+ */
+static int64_t payload_number(const struct Subscription_Post* post) {
+    uint32_t number;
+    uint16_t short_number;
+    switch(post->data_type) {
+        case 0:
+            memcpy(&number, post->content + 1, sizeof(uint32_t));
+            return post->content[0] == 1 ? -(int64_t) ntohl(number) : (int64_t) ntohl(number);
+        case 1:
+            memcpy(&short_number, post->content, sizeof(uint16_t));
+            return ntohs(short_number);
+        default:
+            memcpy(&number, post->content + 1, sizeof(uint32_t));
+            return (int64_t) ntohl(number) * 2 + (post->content[0] == 1);
+    }
+}
+
+/**
+ * @brief Payload of a number read from a log. A negative zero INT comes
+ * back positive, which has the same text.
+ */
+static void number_payload(struct Subscription_Post* post, int64_t value) {
+    uint32_t number;
+    uint16_t short_number;
+    switch(post->data_type) {
+        case 0:
+            post->content[0] = value < 0;
+            number = htonl((uint32_t) (value < 0 ? -value : value));
+            memcpy(post->content + 1, &number, sizeof(uint32_t));
+            break;
+        case 1:
+            short_number = htons((uint16_t) value);
+            memcpy(post->content, &short_number, sizeof(uint16_t));
+            break;
+        default:
+            post->content[0] = value & 1;
+            number = htonl((uint32_t) (value >> 1));
+            memcpy(post->content + 1, &number, sizeof(uint32_t));
+            break;
+    }
+}
+
+void log_post(struct Post_Log* log, uint64_t sequence, const struct Subscription_Post* post,
+              struct sockaddr_in source) {
+    if(log->count == 0) {
+        log->first = sequence;
+    }
+    if(log->blocks.empty() || log->blocks.back().count == LOG_BLOCK_LEN) {
+        log->blocks.emplace_back();
+    }
+    struct Log_Block &block = log->blocks.back();
+
+    uint8_t type = post->data_type;
+    bool same_source = block.count != 0 && block.address == source.sin_addr.s_addr &&
+                       block.port == source.sin_port;
+    block.records.push_back((char) (type | (same_source ? LOG_SAME_SOURCE : 0)));
+    if(!same_source) {
+        block.address   = source.sin_addr.s_addr;
+        block.port      = source.sin_port;
+        block.records.append((const char *) &block.address, sizeof(uint32_t));
+        block.records.append((const char *) &block.port, sizeof(uint16_t));
+    }
+
+    if(type < LOG_NUMERIC_TYPES) {
+        int64_t number = payload_number(post);
+        put_varint(block.records, zigzag(number - block.previous[type]));
+        block.previous[type] = number;
+        if(type == 2) {
+            block.records.push_back(post->content[5]);
+        }
+    } else {
+        int length = value_length(post);
+        put_varint(block.records, length);
+        block.records.append(post->content, length);
+    }
+    block.count ++;
+    log->count ++;
+
+    while(log->blocks.size() > 1 && log->count - log->blocks.front().count >= RETENTION_LEN) {
+        log->count -= log->blocks.front().count;
+        log->first += log->blocks.front().count;
+        log->blocks.pop_front();
+    }
+}
+
+/**
+ * @brief Places the cursor at the start of the block.
+ */
+static void start_block(struct Log_Cursor* cursor, size_t block) {
+    cursor->block   = block;
+    cursor->offset  = 0;
+    cursor->left    = (block < cursor->log->blocks.size()) ? cursor->log->blocks[block].count : 0;
+    memset(cursor->previous, 0, sizeof(cursor->previous));
+}
+
+void seek_log(const struct Post_Log* log, const string &topic, uint64_t sequence,
+              struct Log_Cursor* cursor) {
+    cursor->log         = log;
+    cursor->sequence    = log->first;
+    memset(&cursor->source, 0, sizeof(struct sockaddr_in));
+    cursor->source.sin_family = AF_INET;
+    size_t length = strnlen(topic.c_str(), TOPIC_LEN - 1);
+    memcpy(cursor->post.topic, topic.c_str(), length);
+    cursor->post.topic[length] = '\0';
+
+    /*
+        Whole blocks are skipped, then the records of the block are
+        decoded up to the sequence
+    */
+    size_t block = 0;
+    while(block < log->blocks.size() && cursor->sequence + log->blocks[block].count <= sequence) {
+        cursor->sequence += log->blocks[block].count;
+        block ++;
+    }
+    start_block(cursor, block);
+    uint64_t skipped;
+    while(cursor->sequence < sequence && next_logged(cursor, &skipped));
+}
+
+bool next_logged(struct Log_Cursor* cursor, uint64_t *sequence) {
+    while(cursor->left == 0) {
+        if(cursor->block + 1 >= cursor->log->blocks.size()) {
+            return false;
+        }
+        start_block(cursor, cursor->block + 1);
+    }
+    const string &records = cursor->log->blocks[cursor->block].records;
+    size_t &offset = cursor->offset;
+
+    uint8_t flags = records[offset++];
+    uint8_t type = flags & ~LOG_SAME_SOURCE;
+    if((flags & LOG_SAME_SOURCE) == 0) {
+        memcpy(&cursor->source.sin_addr.s_addr, records.data() + offset, sizeof(uint32_t));
+        memcpy(&cursor->source.sin_port, records.data() + offset + sizeof(uint32_t),
+               sizeof(uint16_t));
+        offset += sizeof(uint32_t) + sizeof(uint16_t);
+    }
+
+    struct Subscription_Post &post = cursor->post;
+    post.data_type = type;
+    if(type < LOG_NUMERIC_TYPES) {
+        int64_t number = cursor->previous[type] + unzigzag(get_varint(records, &offset));
+        cursor->previous[type] = number;
+        number_payload(&post, number);
+        if(type == 2) {
+            post.content[5] = records[offset++];
+        }
+    } else {
+        uint64_t length = get_varint(records, &offset);
+        memcpy(post.content, records.data() + offset, length);
+        post.content[length] = '\0';
+        offset += length;
+    }
+
+    cursor->left --;
+    *sequence = cursor->sequence ++;
+    return true;
+}
+
+uint64_t log_bytes(const struct Post_Log* log) {
+    uint64_t bytes = sizeof(struct Post_Log);
+    for(auto &block : log->blocks) {
+        bytes += sizeof(struct Log_Block) + block.records.capacity() + 1;
+    }
+    return bytes;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file timer_wheel.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Hierarchical timer wheel (WHEEL_LEVELS levels of WHEEL_SLOTS
+ * slots), used for the timers of the Database.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#include "../include/timer_wheel.h"
+
+using namespace std;
+
+void init_timer_wheel(struct Timer_Wheel* wheel, uint64_t now) {
+    for(int level = 0; level < WHEEL_LEVELS; level++) {
+        for(int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot].clear();
+        }
+    }
+    wheel->now      = now;
+    wheel->count    = 0;
+}
+
+/**
+ * @brief Places the timer in the level of its distance from <now>. A
+ * timer due at <now> goes in the slot of level 0 about to be expired.
+ */
+static void place_timer(struct Timer_Wheel* wheel, struct Timer &&timer) {
+    uint64_t expiry = max(timer.expiry, wheel->now);
+    uint64_t distance = expiry - wheel->now;
+
+    int level = 0;
+    while(level < WHEEL_LEVELS - 1 && distance >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+        level ++;
+    }
+
+    /*
+        Too far for the wheel: it waits in the last slot it can reach
+    */
+    uint64_t span = 1ULL << (WHEEL_BITS * WHEEL_LEVELS);
+    if(distance >= span) {
+        expiry = wheel->now + span - 1;
+    }
+
+    int slot = (expiry >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    wheel->slots[level][slot].push_back(move(timer));
+}
+
+void add_timer(struct Timer_Wheel* wheel, uint64_t expiry, uint64_t id, const string &key) {
+    place_timer(wheel, Timer{max(expiry, wheel->now + 1), id, key});
+    wheel->count ++;
+}
+
+void advance_timers(struct Timer_Wheel* wheel, uint64_t now, vector<struct Timer> &expired) {
+    /*
+        An empty wheel has nothing to visit on the way
+    */
+    if(wheel->count == 0) {
+        wheel->now = max(wheel->now, now);
+        return;
+    }
+
+    while(wheel->now < now) {
+        wheel->now ++;
+        uint64_t tick = wheel->now;
+
+        /*
+            The lower levels wrapped around: the timers of the next slot of
+            the upper level get closer and move down
+        */
+        for(int level = 1; level < WHEEL_LEVELS; level++) {
+            if((tick & ((1ULL << (WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            int slot = (tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+            vector<struct Timer> moved;
+            moved.swap(wheel->slots[level][slot]);
+            for(auto &timer : moved) {
+                place_timer(wheel, move(timer));
+            }
+        }
+
+        /*
+            A slot of level 0 only holds the timers of its tick
+        */
+        vector<struct Timer> &due = wheel->slots[0][tick & (WHEEL_SLOTS - 1)];
+        for(auto &timer : due) {
+            expired.push_back(move(timer));
+        }
+        wheel->count -= due.size();
+        due.clear();
+        if(wheel->count == 0) {
+            wheel->now = now;
+        }
+    }
+}
+
+uint64_t next_timer_tick(const struct Timer_Wheel* wheel) {
+    if(wheel->count == 0) {
+        return 0;
+    }
+
+    /*
+        The slots of a level are visited from the one after <now>: the
+        slot of level L holding the ticks starting at <start> is reached
+        (expired for level 0, cascaded above) at tick <start>
+    */
+    uint64_t next = UINT64_MAX;
+    for(int level = 0; level < WHEEL_LEVELS; level++) {
+        int shift = WHEEL_BITS * level;
+        for(uint64_t i = 1; i <= WHEEL_SLOTS; i++) {
+            uint64_t start = ((wheel->now >> shift) + i) << shift;
+            if(start >= next) {
+                break;
+            }
+            if(!wheel->slots[level][(start >> shift) & (WHEEL_SLOTS - 1)].empty()) {
+                next = start;
+                break;
+            }
+        }
+    }
+    return next;
+}
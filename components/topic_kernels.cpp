@@ -0,0 +1,321 @@
+/**
+ * @file topic_kernels.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Kernels on the fixed width topics and IDs: a scalar version and,
+ * on x86, SSE2 and AVX2 versions of the same functions, chosen at run time
+ * from the CPU.
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#include "../include/topic_kernels.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+
+using namespace std;
+
+/*
+    Key of the NH hash, one 32 bit word for each word of the largest
+    block (TOPIC_BLOCK_LEN bytes)
+*/
+alignas(32) static const uint32_t nh_key[TOPIC_BLOCK_LEN / sizeof(uint32_t)] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c,
+    0x1f83d9ab, 0x5be0cd19, 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5
+};
+
+/**
+ * @brief Mixes the NH sum, so that all the bits of the hash depend on it.
+ */
+static uint64_t mix_hash(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static int scalar_length(const char *text, int max_length) {
+    for(int i = 0; i < max_length; i++) {
+        if(text[i] == '\0') {
+            return i;
+        }
+    }
+    return max_length;
+}
+
+static uint64_t scalar_hash(const char *block, int length) {
+    uint64_t sum = 0;
+    for(int i = 0; i < length / (int) sizeof(uint32_t); i += 2) {
+        uint32_t first, second;
+        memcpy(&first, block + i * sizeof(uint32_t), sizeof(uint32_t));
+        memcpy(&second, block + (i + 1) * sizeof(uint32_t), sizeof(uint32_t));
+        sum += (uint64_t) (uint32_t) (first + nh_key[i]) * (uint32_t) (second + nh_key[i + 1]);
+    }
+    return mix_hash(sum);
+}
+
+static bool scalar_equal(const char *first, const char *second, int length) {
+    return memcmp(first, second, length) == 0;
+}
+
+static int scalar_key(const char *text, int max_length, char block[TOPIC_BLOCK_LEN],
+                      uint64_t *hash) {
+    int length = scalar_length(text, min(max_length, TOPIC_BLOCK_LEN));
+    memset(block, 0, TOPIC_BLOCK_LEN);
+    memcpy(block, text, length);
+    *hash = scalar_hash(block, TOPIC_BLOCK_LEN);
+    return length;
+}
+
+#ifdef KERNELS_X86
+
+/*
+    SSE2 (always there on x86-64): 16 bytes at a time, the rest byte by
+    byte. These functions are also inlined in the AVX2 ones, where they
+    are VEX encoded: mixing them with the 256 bit registers would stall
+    at every call.
+*/
+#define SSE2_KERNEL static inline __attribute__((always_inline))
+
+SSE2_KERNEL int sse2_length(const char *text, int max_length) {
+    const __m128i zero = _mm_setzero_si128();
+    int offset = 0;
+    for(; offset + 16 <= max_length; offset += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (text + offset));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+        if(mask != 0) {
+            return offset + __builtin_ctz(mask);
+        }
+    }
+    return offset + scalar_length(text + offset, max_length - offset);
+}
+
+/**
+ * @brief NH of 16 bytes: the words 0 and 2 are added to their keys and
+ * multiplied by the words 1 and 3 (shifted down in the 64 bit lanes).
+ */
+SSE2_KERNEL __m128i sse2_nh(__m128i sum, __m128i bytes, const uint32_t *key) {
+    __m128i words = _mm_add_epi32(bytes, _mm_load_si128((const __m128i *) key));
+    return _mm_add_epi64(sum, _mm_mul_epu32(words, _mm_srli_epi64(words, 32)));
+}
+
+SSE2_KERNEL uint64_t sse2_sum(__m128i sum) {
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, sum);
+    return mix_hash(lanes[0] + lanes[1]);
+}
+
+SSE2_KERNEL uint64_t sse2_hash(const char *block, int length) {
+    __m128i sum = _mm_setzero_si128();
+    for(int offset = 0; offset < length; offset += 16) {
+        sum = sse2_nh(sum, _mm_loadu_si128((const __m128i *) (block + offset)),
+                      nh_key + offset / sizeof(uint32_t));
+    }
+    return sse2_sum(sum);
+}
+
+/**
+ * @brief The last bytes [offset, max_length) of a text (less than 16,
+ * max_length at least 16), followed by zeros. They are read as words
+ * ending at <max_length>, so no byte after the text is read.
+ */
+SSE2_KERNEL __m128i sse2_partial(const char *text, int offset, int max_length) {
+    int count = max_length - offset;
+    uint64_t low, high = 0;
+    if(count <= 8) {
+        memcpy(&low, text + max_length - 8, sizeof(uint64_t));
+        low >>= 8 * (8 - count);
+    } else {
+        memcpy(&low, text + offset, sizeof(uint64_t));
+        memcpy(&high, text + max_length - 8, sizeof(uint64_t));
+        high >>= 8 * (16 - count);
+    }
+    return _mm_set_epi64x(high, low);
+}
+
+/**
+ * @brief Key kernel from <offset> on, 16 bytes at a time: the bytes after
+ * the first NUL are cleared with a compare of the byte indexes.
+ *
+ * @param length - end of the text if already found, -1 otherwise
+ */
+SSE2_KERNEL __m128i sse2_key_blocks(const char *text, int offset, int max_length,
+                               char block[TOPIC_BLOCK_LEN], __m128i sum, int *length) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for(; offset < TOPIC_BLOCK_LEN; offset += 16) {
+        __m128i bytes = zero;
+        if(*length < 0 && offset + 16 <= max_length) {
+            bytes = _mm_loadu_si128((const __m128i *) (text + offset));
+        } else if(*length < 0 && offset < max_length) {
+            bytes = sse2_partial(text, offset, max_length);
+        }
+
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+        if(*length < 0 && mask != 0) {
+            int end = __builtin_ctz(mask);
+            bytes = _mm_and_si128(bytes, _mm_cmplt_epi8(index, _mm_set1_epi8(end)));
+            *length = min(offset + end, max_length);
+        }
+        _mm_storeu_si128((__m128i *) (block + offset), bytes);
+        sum = sse2_nh(sum, bytes, nh_key + offset / sizeof(uint32_t));
+    }
+    return sum;
+}
+
+SSE2_KERNEL int sse2_key(const char *text, int max_length, char block[TOPIC_BLOCK_LEN],
+                    uint64_t *hash) {
+    max_length = min(max_length, TOPIC_BLOCK_LEN);
+    if(max_length < 16) {
+        return scalar_key(text, max_length, block, hash);
+    }
+    int length = -1;
+    *hash = sse2_sum(sse2_key_blocks(text, 0, max_length, block, _mm_setzero_si128(), &length));
+    return length < 0 ? max_length : length;
+}
+
+SSE2_KERNEL bool sse2_equal(const char *first, const char *second, int length) {
+    int offset = 0;
+    for(; offset + 16 <= length; offset += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (first + offset));
+        __m128i b = _mm_loadu_si128((const __m128i *) (second + offset));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xffff) {
+            return false;
+        }
+    }
+    return memcmp(first + offset, second + offset, length - offset) == 0;
+}
+
+/*
+    AVX2: 32 bytes at a time, then one SSE2 block and the rest byte by
+    byte
+*/
+__attribute__((target("avx2")))
+static int avx2_length(const char *text, int max_length) {
+    const __m256i zero = _mm256_setzero_si256();
+    int offset = 0;
+    for(; offset + 32 <= max_length; offset += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (text + offset));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero));
+        if(mask != 0) {
+            return offset + __builtin_ctz(mask);
+        }
+    }
+    return offset + sse2_length(text + offset, max_length - offset);
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_hash(const char *block, int length) {
+    __m256i sum = _mm256_setzero_si256();
+    int offset = 0;
+    for(; offset + 32 <= length; offset += 32) {
+        __m256i words = _mm256_add_epi32(
+            _mm256_loadu_si256((const __m256i *) (block + offset)),
+            _mm256_load_si256((const __m256i *) (nh_key + offset / sizeof(uint32_t))));
+        sum = _mm256_add_epi64(sum, _mm256_mul_epu32(words, _mm256_srli_epi64(words, 32)));
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    if(offset < length) {
+        half = sse2_nh(half, _mm_loadu_si128((const __m128i *) (block + offset)),
+                       nh_key + offset / sizeof(uint32_t));
+    }
+    return sse2_sum(half);
+}
+
+/*
+    The first 32 bytes in one block, the rest as in SSE2
+*/
+__attribute__((target("avx2")))
+static int avx2_key(const char *text, int max_length, char block[TOPIC_BLOCK_LEN],
+                    uint64_t *hash) {
+    max_length = min(max_length, TOPIC_BLOCK_LEN);
+    if(max_length < 32) {
+        return sse2_key(text, max_length, block, hash);
+    }
+
+    const __m256i index = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                           16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28,
+                                           29, 30, 31);
+    int length = -1;
+    __m256i bytes = _mm256_loadu_si256((const __m256i *) text);
+    unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_setzero_si256()));
+    if(mask != 0) {
+        length = __builtin_ctz(mask);
+        bytes = _mm256_and_si256(bytes, _mm256_cmpgt_epi8(_mm256_set1_epi8(length), index));
+    }
+    _mm256_storeu_si256((__m256i *) block, bytes);
+
+    __m256i words = _mm256_add_epi32(bytes, _mm256_load_si256((const __m256i *) nh_key));
+    __m256i sum = _mm256_mul_epu32(words, _mm256_srli_epi64(words, 32));
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    *hash = sse2_sum(sse2_key_blocks(text, 32, max_length, block, half, &length));
+    return length < 0 ? max_length : length;
+}
+
+__attribute__((target("avx2")))
+static bool avx2_equal(const char *first, const char *second, int length) {
+    int offset = 0;
+    for(; offset + 32 <= length; offset += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (first + offset));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (second + offset));
+        if((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) != 0xffffffffU) {
+            return false;
+        }
+    }
+    return sse2_equal(first + offset, second + offset, length - offset);
+}
+
+#endif
+
+static const struct Topic_Kernels all_kernels[] = {
+    {KERNELS_SCALAR, "scalar", scalar_length, scalar_hash, scalar_equal, scalar_key},
+#ifdef KERNELS_X86
+    {KERNELS_SSE2, "sse2", sse2_length, sse2_hash, sse2_equal, sse2_key},
+    {KERNELS_AVX2, "avx2", avx2_length, avx2_hash, avx2_equal, avx2_key},
+#endif
+};
+
+int best_kernel_level() {
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return KERNELS_AVX2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return KERNELS_SSE2;
+    }
+#endif
+    return KERNELS_SCALAR;
+}
+
+struct Topic_Kernels kernels = all_kernels[best_kernel_level()];
+
+int select_kernels(int level) {
+    level = min(max(level, KERNELS_SCALAR), best_kernel_level());
+    kernels = all_kernels[level];
+    return level;
+}
+
+void make_topic_key(const char topic[TOPIC_LEN], struct Topic_Key* key) {
+    key->length = kernels.key(topic, TOPIC_LEN, key->topic, &key->hash);
+}
+
+void make_topic_key(const char *topic, int length, struct Topic_Key* key) {
+    memset(key->topic, 0, TOPIC_BLOCK_LEN);
+    memcpy(key->topic, topic, min(length, TOPIC_BLOCK_LEN));
+    key->length = length;
+    key->hash = kernels.hash(key->topic, TOPIC_BLOCK_LEN);
+}
+
+size_t Topic_Hash::operator()(const string &topic) const {
+    struct Topic_Key key;
+    make_topic_key(topic.data(), topic.size(), &key);
+    return key.hash;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file admission.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the validation and the per-source admission control
+ * of the UDP datagrams
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _ADMISSION_H
+#define _ADMISSION_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "post.h"
+
+using namespace std;
+
+/*
+    Token bucket of an UDP source (IP:PORT)
+
+    | KEY | TOKENS | LAST REFILL | LAST SEEN | ACCEPTED | DROPPED |
+    |_____|________|_____________|___________|__________|_________|
+
+    <key>       = IP << 16 | PORT, 0 marks a free slot
+    <tokens>    = tokens in units of 1/1e9 datagram, so that the refill
+    |             (elapsed ns * rate) needs no division
+*/
+struct Source_Bucket {
+    uint64_t key;
+    uint64_t tokens;
+    uint64_t last_refill;
+    uint64_t last_seen;
+    uint64_t accepted;
+    uint64_t dropped;
+};
+
+/*
+    Admission control
+
+    <buckets>       = open addressing table (linear probing), its size
+    |                 is a power of 2; when it is 3/4 full the sources idle
+    |                 for ADMISSION_IDLE_NS are dropped and, if that is not
+    |                 enough, the table doubles up to ADMISSION_MAX_SOURCES
+    <overflow>      = bucket shared by the new sources once the table
+    |                 cannot grow (spoofed floods)
+    <next_aging>    = a full table that aging could not free is only aged
+    |                 again after ADMISSION_AGING_NS; until then the new
+    |                 sources go to <overflow> at once, so a flood of new
+    |                 sources does not rebuild the table on every datagram
+    <rate>, <burst> = datagrams per second and bucket size of a source
+    |                 (rate 0 - only the validation is done)
+    <malformed>     = datagrams rejected by the validation
+*/
+struct Admission {
+    vector<struct Source_Bucket> buckets;
+    size_t used;
+    struct Source_Bucket overflow;
+    uint64_t next_aging;
+    uint64_t rate;
+    uint64_t burst;
+    uint64_t malformed;
+    uint64_t dropped;
+};
+
+/**
+ * @brief Prepares the admission control (<rate> 0 disables the buckets).
+ */
+void init_admission(struct Admission* admission, uint64_t rate, uint64_t burst);
+
+/**
+ * @brief Checks the datagram before it is decoded: NUL terminated topic,
+ * known data type and a payload long enough for it. A STRING filling the
+ * whole payload is cut at CONTENT_LEN - 1 bytes, as it is stored.
+ */
+bool valid_datagram(struct Subscription_Post* post, int length);
+
+/**
+ * @brief Takes a token from the bucket of the source.
+ * 
+ * @return true - the datagram is accepted
+ * @return false - the source exceeded its rate, the datagram is dropped
+ */
+bool admit_datagram(struct Admission* admission, const struct sockaddr_in* source);
+
+/**
+ * @brief Prints the drop counters, the sources with the most drops first.
+ */
+void print_admission_stats(struct Admission* admission);
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file analytics.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the streaming analytics of the hot topics and sources
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _ANALYTICS_H
+#define _ANALYTICS_H
+
+#include "helpers.h"
+#include "constants.h"
+#include <string>
+#include <time.h>
+
+using namespace std;
+
+/*
+    Heavy hitters of a stream of (key, amount)
+
+    <counters>  = count-min sketch, SKETCH_DEPTH rows of SKETCH_WIDTH
+    |             counters; the estimate of a key is the minimum of its
+    |             counters, never lower than the real sum
+    <top>       = min-heap of the ANALYTICS_TOP_K keys with the largest
+    |             estimates (the smallest one at top[0]); the entries only
+    |             hold the slot of their key in <names>, so that moving
+    |             them in the heap copies no string
+
+    Memory does not depend on the number of keys. The heap is only
+    touched when the estimate of a key passes its smallest entry.
+*/
+struct Heavy_Hitter {
+    uint64_t hash;
+    uint64_t estimate;
+    unsigned int slot;
+};
+
+struct Heavy_Hitters {
+    vector<uint64_t> counters;
+    vector<struct Heavy_Hitter> top;
+    vector<string> names;
+};
+
+/*
+    Analytics of the UDP ingest
+
+    <messages>  = posts per topic
+    <fan_out>   = subscribers x bytes of the frame, per topic (cost of
+    |             the fan-out)
+    <volume>    = bytes per source (IP:PORT)
+
+    Every ANALYTICS_WINDOW seconds all the counts are halved, so the
+    ranking follows the recent traffic.
+
+    Only one post in ANALYTICS_SAMPLE (chosen by <random>, a xorshift
+    generator) is counted, with its amounts multiplied by ANALYTICS_SAMPLE:
+    the estimates stay unbiased and the heavy hitters, the keys that
+    matter, are sampled often enough, while most posts only cost the
+    random draw.
+*/
+struct Analytics {
+    struct Heavy_Hitters messages;
+    struct Heavy_Hitters fan_out;
+    struct Heavy_Hitters volume;
+    time_t next_decay;
+    uint64_t random;
+};
+
+/**
+ * @brief Allocates the sketches (bounded memory).
+ */
+void init_analytics(struct Analytics* analytics);
+
+/**
+ * @brief Counts a datagram of <bytes> on <topic> from <source>, whose
+ * frames to the subscribers took <fan_out_bytes>.
+ */
+void record_post(struct Analytics* analytics, const char *topic,
+                 const struct sockaddr_in* source, int bytes, uint64_t fan_out_bytes);
+
+/**
+ * @brief Halves the counts once per window.
+ */
+void decay_analytics(struct Analytics* analytics, time_t now);
+
+/**
+ * @brief Prints the heaviest topics and sources.
+ */
+void print_analytics(struct Analytics* analytics);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file capture.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the capture of the UDP ingest of the server and its
+ * reading by the replay tool
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "post.h"
+
+using namespace std;
+
+/*
+    Capture file
+
+    | MAGIC | RECORD | RECORD | ... |
+    |_______|________|________|_____|
+
+    Record of a received datagram
+
+    | DELTA | ADDRESS | PORT | LENGTH | DATAGRAM |
+    |_______|_________|______|________|__________|
+
+    <delta>     = varint, nanoseconds since the previous record (the
+    |             receive time itself for the first record)
+    <address>   = IPv4 address of the source (network order, 4 bytes)
+    <port>      = port of the source (network order, 2 bytes)
+    <length>    = varint, size of the datagram
+    <datagram>  = the bytes received, as they were received (also the
+    |             malformed datagrams, so a replay loads the server the
+    |             same way)
+
+    A post of a few bytes costs about 10 bytes of record header instead
+    of the whole Subscription_Post.
+*/
+#define CAPTURE_MAGIC           "TUCAPT01"
+
+/*
+    Capture of the UDP ingest (-C <file>)
+
+    <file>      = capture file, written through a CAPTURE_BUFFER_LEN buffer
+    <last_ns>   = receive time of the last record
+    <records>, <bytes> = datagrams captured and size of the file
+*/
+struct Capture {
+    FILE *file = NULL;
+    uint64_t last_ns = 0;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+};
+
+/*
+    Record read from a capture file
+
+    <time_ns>   = receive time of the datagram
+*/
+struct Capture_Record {
+    uint64_t time_ns;
+    struct sockaddr_in source;
+    int length;
+    char datagram[sizeof(struct Subscription_Post)];
+};
+
+/**
+ * @brief Creates the capture file and writes its magic.
+ *
+ * @return false - the file cannot be written
+ */
+bool open_capture(struct Capture* capture, const char *path);
+
+/**
+ * @brief Appends the record of a datagram. On a write error the capture
+ * is stopped (the server goes on without it).
+ *
+ * @param received_ns - receive time of the datagram
+ */
+void capture_datagram(struct Capture* capture, const void *datagram, int length,
+                      const struct sockaddr_in *source, uint64_t received_ns);
+
+/**
+ * @brief Writes the buffered records and closes the file.
+ */
+void close_capture(struct Capture* capture);
+
+/**
+ * @brief Prints the datagrams captured and the size of the file.
+ */
+void print_capture_stats(struct Capture* capture);
+
+/**
+ * @brief Opens a capture file and checks its magic.
+ *
+ * @return NULL - missing file or not a capture
+ */
+FILE *open_capture_file(const char *path);
+
+/**
+ * @brief Reads the next record. <record>->time_ns must hold the time of
+ * the previous record (0 before the first one).
+ *
+ * @return false - end of the capture (or a truncated record)
+ */
+bool read_capture_record(FILE *file, struct Capture_Record* record);
+
+#endif
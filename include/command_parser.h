@@ -40,4 +40,57 @@ bool check_command_format(char buffer[BUFLEN], int correct_arguments);
 
 void obtain_nth_argument(char buffer[BUFLEN], int n, char result[TOPIC_LEN]);
 
+
+/*
+    Token in a command buffer
+
+    | START | LENGTH |
+    |_______|________|
+
+    A token only points inside the received buffer, so commands
+    can be split without copying them or writing '\0' in them
+    (as strtok does).
+*/
+struct Token {
+    const char *start;
+    unsigned int length;
+};
+
+/**
+ * @brief Obtains the next token (separated by spaces/tabs) from the
+ *        line starting at <cursor> and ending at <end> and advances
+ *        the cursor after it.
+ * 
+ * @param cursor - current position in the line
+ * @param end - end of the line
+ * @param token - the found token
+ * @return true - a token was found
+ * @return false - the line has no more tokens
+ */
+
+bool next_token(const char **cursor, const char *end, struct Token *token);
+
+
+
+/**
+ * @brief Obtains the next line from the buffer starting at <cursor>
+ *        and ending at <end> and advances the cursor after it.
+ * 
+ * @param cursor - current position in the buffer
+ * @param end - end of the buffer
+ * @param line - the found line, without the '\n'
+ * @return true - a line was found
+ * @return false - the buffer has no more lines
+ */
+
+bool next_line(const char **cursor, const char *end, struct Token *line);
+
+
+
+/**
+ * @brief Checks if a token is equal to a C string.
+ */
+
+bool token_equals(struct Token *token, const char *word);
+
 #endif
\ No newline at end of file
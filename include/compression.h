@@ -0,0 +1,91 @@
+/**
+ * @file compression.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the batch frames: many posts packed in one frame and
+ * compressed with a small built-in LZ77 codec
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _COMPRESSION_H
+#define _COMPRESSION_H
+
+#include "helpers.h"
+#include "constants.h"
+#include <string>
+
+using namespace std;
+
+/*
+    Batch frame (BATCH_CODE), only sent to the clients that set
+    ID_BATCH_FLAG on their ID frame
+
+    | RAW LENGTH | COMPRESSED RECORDS |
+    |____________|____________________|
+
+    The records, once decompressed, are the posts of the batch in order:
+
+    | SEQUENCE | LENGTH | CONTENT |
+    |__________|________|_________|
+
+    <sequence>  = uint64, as in the header of a SUBSCRIPTION_SEND frame
+    <length>    = uint32, bytes of <content> (with its '\0')
+
+    The texts of the posts ("IP:PORT - topic - TYPE - value") repeat
+    most of their bytes, so even a codec without entropy coding shrinks
+    them several times.
+*/
+
+/*
+    LZ77 block format (the token layout of LZ4, without its end-of-block
+    rules: only this decoder reads these blocks): a sequence of
+
+    | TOKEN | [LITERAL LENGTH] | LITERALS | OFFSET | [MATCH LENGTH] |
+    |_______|__________________|__________|________|________________|
+
+    <token>     = literals (high 4 bits) and match length - 4 (low 4 bits),
+    |             15 is continued by bytes of 255 and a last byte < 255
+    <offset>    = uint16 LE, distance back to the copied bytes
+    The last sequence has only literals.
+*/
+
+/**
+ * @brief Appends the post to the raw records of a batch.
+ */
+void append_batch_record(string &records, uint64_t sequence, const char *content, int size);
+
+/**
+ * @brief Reads the next record of the raw records.
+ * 
+ * @return false - no more records (or a cut record)
+ */
+bool next_batch_record(const char **cursor, const char *end, uint64_t *sequence,
+                       const char **content, uint32_t *size);
+
+/**
+ * @brief Compresses <length> bytes, appending the block to <block>.
+ */
+void compress_block(const char *input, size_t length, string &block);
+
+/**
+ * @brief Decompresses a block into <output> (exactly <raw_length> bytes).
+ * 
+ * @return false - malformed block
+ */
+bool decompress_block(const char *block, size_t length, string &output, size_t raw_length);
+
+/**
+ * @brief Builds the body of a batch frame from the raw records.
+ */
+void build_batch(const string &records, string &body);
+
+/**
+ * @brief Decompresses the body of a batch frame into its raw records.
+ * 
+ * @return false - malformed frame
+ */
+bool open_batch(const char *body, int size, string &records);
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file connection.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the Connection structure
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ */
+#ifndef _CONNECTION_H
+#define _CONNECTION_H
+
+#include "helpers.h"
+#include "shared_ring.h"
+
+#define TRANSPORT_STREAM        0
+#define TRANSPORT_SHM           1
+
+/*
+    | SOCKET | TRANSPORT | RING |
+    |________|___________|______|
+
+    State of the connection of a client, by socket.
+    <socket_fd> = TCP or Unix domain socket of the client, used for
+    |             the commands of the client in every transport
+    <transport> = TRANSPORT_STREAM - frames are sent on the socket
+    |             TRANSPORT_SHM    - frames are written in the ring
+    <ring>      = shared memory ring (TRANSPORT_SHM only)
+*/
+struct Connection {
+    int socket_fd;
+    int transport;
+    struct Shared_Ring ring;
+};
+
+#endif
@@ -17,6 +17,7 @@
 #define SUBSCRIBE_REQUEST       "subscribe"
 #define UNSUBSCRIBE_REQUEST     "unsubscribe"
 #define ID_IN_USE               "id_in_use"
+#define BULK_REQUEST            "subscribe_file"
 
 #define STDIN                   0
 #define BUFLEN                  1600
@@ -33,5 +34,84 @@
 #define UNSUBSCRIBE_CODE        13
 #define SUBSCRIBE_CODE          12
 #define ID_CODE                 11
+#define BULK_SUBSCRIPTION_CODE  14
+#define MAX_BULK_LEN            (1 << 22)
+#define DEFAULT_SNAPSHOT_INTERVAL   10
+#define JOURNAL_FLUSH_LEN       (1 << 16)
+#define MAX_PASSED_FDS          64
+#define HANDOVER_STATE_CODE     20
+#define HANDOVER_CLIENTS_CODE   21
+#define HANDOVER_DONE_CODE      22
+#define PEER_HELLO_CODE         30
+#define PEER_INTEREST_CODE      31
+#define PEER_POSTS_CODE         32
+#define PEER_RETRY_INTERVAL     1
+#define MAX_PEER_BATCH          (1 << 16)
+#define MAX_PEER_OUTPUT         (1 << 26)
+#define ID_SHM_CODE             40
+#define SHM_SETUP_CODE          41
+#define SHM_RING_LEN            (1 << 20)
+#define RING_WAIT_NS            10000000
+#define TRACE_RING_LEN          65536
+#define STATS_REQUEST           "stats\n"
+#define DUMP_TRACE_REQUEST      "dump_trace"
+#define BUSY_POLL_BUDGET        256
+#define RESUME_CODE             15
+#define ID_RESUME_FLAG          0x100
+#define RETENTION_LEN           1024
+#define SEQUENCE_RESERVE        4096
+#define ADMISSION_TABLE_LEN     1024
+#define ADMISSION_MAX_SOURCES   (1 << 16)
+#define ADMISSION_IDLE_NS       (60ULL * 1000000000ULL)
+#define ADMISSION_REPORTED_SOURCES  10
+#define SKETCH_DEPTH            4
+#define SKETCH_WIDTH            4096
+#define ANALYTICS_TOP_K         10
+#define ANALYTICS_WINDOW        60
+#define ANALYTICS_SAMPLE        16
+#define LOGIN_INDEX_LEN         1024
+#define SESSION_FREE            0
+#define SESSION_OFFLINE         1
+#define SESSION_CONNECTING      2
+#define SESSION_ONLINE          3
+#define MAX_CLIENT_OUTPUT       (1 << 22)
+#define DRAIN_TIMEOUT_MS        1000
+#define BATCH_CODE              16
+#define ID_BATCH_FLAG           0x200
+#define ID_FLAGS                (ID_RESUME_FLAG | ID_BATCH_FLAG | ID_MULTICAST_FLAG | \
+                                 ID_HEARTBEAT_FLAG)
+#define BATCH_RAW_LEN           (1 << 15)
+#define MAX_BATCH_RAW_LEN       (1 << 20)
+#define BATCH_HOT_RATE          1000
+#define BATCH_DELAY_NS          5000000ULL
+#define WHEEL_LEVELS            4
+#define WHEEL_BITS              6
+#define WHEEL_SLOTS             (1 << WHEEL_BITS)
+#define EVICTED_POST            0
+#define DEFAULT_COALESCE_USEC   200
+#define COALESCE_MAX_BYTES      (1 << 16)
+#define ID_MULTICAST_FLAG       0x400
+#define MULTICAST_SETUP_CODE    17
+#define MULTICAST_JOIN_CODE     18
+#define MULTICAST_LEAVE_CODE    19
+#define NAK_CODE                24
+#define CAPTURE_BUFFER_LEN      (1 << 16)
+#define PRIORITY_CLASSES        3
+#define PRIORITY_HIGH           0
+#define PRIORITY_NORMAL         1
+#define PRIORITY_BULK           2
+#define SCHEDULE_QUANTUM        1600
+#define SCHEDULE_LOW_WATER      (1 << 14)
+#define SCHEDULE_BUDGET         (1 << 18)
+#define LOG_BLOCK_LEN           64
+#define INGEST_BATCH_LEN        64
+#define HEARTBEAT_CODE          23
+#define ID_HEARTBEAT_FLAG       0x800
+#define DEFAULT_HEARTBEAT_MS    0
+#define DEFAULT_HEARTBEAT_MISSES    3
+#define HEARTBEAT_TICK_MS       100
+#define ADMISSION_AGING_NS      1000000000ULL
+#define RING_RETRY_NS           1000000
+#define HANDOVER_WAIT_NS        1000000000ULL
 
 #endif
\ No newline at end of file
@@ -14,27 +14,202 @@
 
 #include "helpers.h"
 #include "subscriber.h"
+#include "connection.h"
 #include "constants.h"
 #include "post.h"
+#include "login_index.h"
+#include "topic_kernels.h"
+#include "latency.h"
+#include <deque>
 
 using namespace std;
 
+struct Journal;
+struct Federation;
+struct Latency_Tracer;
+struct Event_Loop;
+struct Retention;
+struct Multicast;
+struct Heartbeat;
+
+/*
+    | IDS | POSITION |
+    |_____|__________|
+
+    Subscribers of a topic.
+    <IDs>       = IDs of the subscribed clients, kept contiguous
+    |             for the fan-out loop
+    <position>  = ID -> index in <IDs>, so that a client is
+    |             removed in O(1) by moving the last ID in its
+    |             place
+*/
+struct Topic_Subscribers {
+    vector<string> IDs;
+    unordered_map<string, unsigned int> position;
+};
+
+/*
+    Topic -> subscribers, hashed with the topic kernels, so that a post
+    is found from the Topic_Key of its fixed width topic
+*/
+typedef unordered_map<string, struct Topic_Subscribers, Topic_Hash, Topic_Equal> Topic_Index;
+
+/*
+    | SEQUENCE | RESERVED | RETAINED |
+    |__________|__________|__________|
+
+    Sequence numbers of a topic. Unlike the subscribers, the log of a
+    topic is never removed, so the numbers never restart.
+    <sequence>  = sequence of the last post of the topic
+    <reserved>  = highest sequence recorded in the journal; after a
+    |             crash the numbering continues from it, so that no
+    |             number is given twice (the journal is only written
+    |             once every SEQUENCE_RESERVE posts)
+    <retained>  = at least the last RETENTION_LEN posts (consecutive
+    |             sequences), for the clients resuming from a sequence,
+    |             delta-encoded (see stored_post.h)
+    <window>, <window_posts> = posts in the current second; a topic that
+    |             had at least BATCH_HOT_RATE posts in the last second is
+    |             <hot>: its posts are batched for the clients taking
+    |             batch frames
+*/
+struct Topic_Log {
+    uint64_t sequence = 0;
+    uint64_t reserved = 0;
+    struct Post_Log retained;
+    time_t window = 0;
+    uint32_t window_posts = 0;
+    bool hot = false;
+};
+
+/*
+    | RECORDS | DEADLINE | PRIORITY | MARKS |
+    |_________|__________|__________|_______|
+
+    Posts waiting to be sent to a client in one batch frame.
+    <records>   = raw records (see compression.h)
+    <deadline>  = the batch is sent at most BATCH_DELAY_NS after its
+    |             first post (or once BATCH_RAW_LEN bytes are waiting)
+    <priority>  = class of its posts: a post of another class sends the
+    |             batch first
+    <marks>     = traced posts of the batch, recorded when its frame
+    |             is sent (see Egress_Mark)
+*/
+struct Post_Batch {
+    string records;
+    uint64_t deadline;
+    int priority;
+    vector<struct Egress_Mark> marks;
+};
+
+/*
+    | POST | SOURCE | INGRESS | LENGTH | FAN-OUT |
+    |______|________|_________|________|_________|
+
+    Post read from the UDP socket in an ingest batch.
+    <length>    = size of the datagram
+    <fan_out_bytes> = result, bytes of the frames sent and stored for
+    |             the post (0 - no subscribers)
+    The other fields are filled when the post is published: its text,
+    its sequence, the log of its topic, whether the topic is hot and its
+    stored form (made for the first offline client).
+*/
+struct Ingest_Post {
+    struct Subscription_Post post;
+    struct sockaddr_in source;
+    uint64_t ingress_ns;
+    int length;
+    uint64_t fan_out_bytes;
+    struct Send_Post text;
+    int size;
+    uint64_t sequence;
+    pair<const string, struct Topic_Log> *log;
+    bool hot;
+    struct Stored_Post stored;
+    bool stored_ready;
+};
+
 /*
-    subscription<string, vector<>>  ::  topic -> subscribed clients
-    online<string, subscriber>      ::  ID    -> client
-    locations<int, subscriber>      ::  socket-> client
+    Posts read from the UDP socket at once, at most INGEST_BATCH_LEN
+*/
+struct Ingest_Batch {
+    struct Ingest_Post posts[INGEST_BATCH_LEN];
+    int count = 0;
+};
+
+/*
+    subscription<string, topic_subscribers> ::  topic -> subscribed clients
+    online<string, subscriber>              ::  ID    -> client
+    locations<int, subscriber>              ::  socket-> connected client
+    sessions                                ::  ID    -> session state
+                                                (offline/connecting/online),
+                                                checked at every login
+    topic_logs<string, topic_log>           ::  topic -> sequence numbers
+                                                and retained posts
+    batches<int, post_batch>                ::  socket-> posts waiting for
+                                                a batch frame
+    connections<int, connection>            ::  socket-> transport of the
+                                                client (only for clients
+                                                not using the socket)
+    journal                                 ::  changes since the last
+                                                snapshot (NULL if disabled)
+    federation                              ::  peer servers notified when
+                                                a topic gains its first or
+                                                loses its last subscriber
+    tracer                                  ::  latency of the deliveries
+                                                (NULL if disabled)
+    loop                                    ::  output queues of the client
+                                                sockets (NULL - the frames
+                                                are sent blocking)
+    retention                               ::  limits of the SF queues
+                                                (NULL - no limits)
+    multicast                               ::  topics published to a
+                                                multicast group (NULL -
+                                                all unicast)
+    priorities<string, int>                 ::  topic -> priority class of
+                                                its frames (the others are
+                                                PRIORITY_NORMAL)
+    heartbeat                               ::  liveness of the client
+                                                connections (NULL - a dead
+                                                client is only noticed by
+                                                the kernel)
 */
 struct Database {
-    unordered_map<string, vector<struct Subscriber>> subscription;
+    Topic_Index subscription;
     unordered_map<string, struct Subscriber> online;
     unordered_map<int, struct Subscriber> locations;
+    unordered_map<int, struct Connection> connections;
+    unordered_map<string, struct Topic_Log> topic_logs;
+    struct Login_Index sessions;
+    unordered_map<int, struct Post_Batch> batches;
+    struct Journal *journal = NULL;
+    struct Federation *federation = NULL;
+    struct Latency_Tracer *tracer = NULL;
+    struct Event_Loop *loop = NULL;
+    struct Retention *retention = NULL;
+    struct Multicast *multicast = NULL;
+    unordered_map<string, int> priorities;
+    struct Heartbeat *heartbeat = NULL;
 };
 
 /**
- * @brief Adds a new client in the database
+ * @brief Adds a new client in the database, receiving its ID (blocking)
  */
 bool add_new_client(int socket, struct sockaddr_in adress, struct Database* database);
 
+/**
+ * @brief Adds the client whose login was started with begin_login, sends
+ * its SF queue and marks its session online.
+ */
+void login_client(struct Database* database, int socket, struct sockaddr_in adress,
+                  const struct Login_Key* key, int operation,
+                  unordered_map<string, uint64_t> &resume_from);
+
+/**
+ * @brief Parses the body of a RESUME frame: "<topic> <sequence>" lines.
+ */
+void parse_resume(const char *body, int size, unordered_map<string, uint64_t> &resume_from);
+
 /**
  * @brief Adds a new subscription in the database having the command buffer
  * and the socket_fd is the socket of the client
@@ -45,13 +220,20 @@ void add_subscription(struct Database* database, int socket_fd,
 
 /**
  * @brief sets the client having the port socket_fd in the database to offline
+ * and forgets the socket, so that a new client reusing it starts clean
  * 
  */
 void disconnect_client(struct Database* database, int socket_fd);
 
+/**
+ * @brief Finds the subscriber logged in at <socket_fd> (NULL if none).
+ * 
+ */
+struct Subscriber* find_subscriber(struct Database* database, int socket_fd);
+
 /**
  * @brief Checks if an ID is already in the database to a connected
- * client.
+ * (or connecting) client, in O(1).
  * 
  */
 bool ID_already_in_database(char ID[BUFLEN], struct Database* database);
@@ -66,6 +248,24 @@ void receive_post(struct Subscription_Post* new_post,
                  struct Send_Post* transform, char IP[16],
                  struct sockaddr_in server_address);
 
+/**
+ * @brief Sends the post received from an UDP client to the connected
+ * subscribers of its topic and stores it for the offline subscribers
+ * having SF set. Returns the bytes of the frames delivered or enqueued.
+ * 
+ */
+uint64_t publish_post(struct Database* database, struct Subscription_Post* new_post,
+                      struct sockaddr_in source, uint64_t ingress_ns);
+
+/**
+ * @brief Publishes the posts of an ingest batch. The posts are grouped by
+ * topic and the subscribers of a topic are walked once for all its posts,
+ * so a subscriber gets the posts of a topic in order, one topic after the
+ * other. Sets the fan_out_bytes of every post.
+ * 
+ */
+void publish_batch(struct Database* database, struct Ingest_Batch* batch);
+
 /**
  * @brief removes the topic <buffer> from the map of subscriptions of
  * the client at <socket_fd> port stored in the <database>.
@@ -74,4 +274,93 @@ void receive_post(struct Subscription_Post* new_post,
 void remove_subscription(struct Database* database, int socket_fd,
                          char buffer[BUFLEN]);
 
+/**
+ * @brief Sends a frame to the client at <socket_fd> on its transport:
+ * the socket or its shared memory ring. The <marks> of the posts in the
+ * frame are traced once the transport accepts it.
+ * 
+ */
+bool deliver_frame(struct Database* database, int socket_fd, int operation,
+                   const char *body, int size, uint64_t sequence = 0,
+                   int priority = PRIORITY_NORMAL,
+                   const struct Egress_Mark *marks = NULL, int mark_count = 0);
+
+/**
+ * @brief Priority class of the frames of a topic. All the frames of a
+ * topic (live, SF, resent, membership) take its class, so the scheduler
+ * never reorders the posts of a topic.
+ */
+int topic_priority(struct Database* database, const string &topic);
+
+/**
+ * @brief Sends the batch waiting for the client at <socket_fd>.
+ * 
+ */
+void flush_batch(struct Database* database, int socket_fd);
+
+/**
+ * @brief Sends the batches whose deadline is before <now> (all of them
+ * for UINT64_MAX).
+ * 
+ */
+void flush_batches(struct Database* database, uint64_t now);
+
+/**
+ * @brief Deadline of the first batch to send, 0 if none is waiting.
+ * 
+ */
+uint64_t next_batch_deadline(struct Database* database);
+
+/**
+ * @brief Releases the transport of the client at <socket_fd> when it
+ * disconnects.
+ * 
+ */
+void close_connection(struct Database* database, int socket_fd);
+
+/**
+ * @brief Gives back the reserved sequences before the last snapshot of
+ * this server (exit or handover), so the numbering continues without gap.
+ * 
+ */
+void settle_sequences(struct Database* database);
+
+/**
+ * @brief Stores the post in the SF queue of the offline client.
+ * 
+ */
+void enqueue_post(struct Database* database, struct Subscriber* subscriber,
+                  struct Stored_Post* post);
+
+/**
+ * @brief Interned name of a topic: the key of its log, which is never
+ * removed (the log is created if needed).
+ * 
+ */
+const string *intern_topic(struct Database* database, const string &topic);
+
+/**
+ * @brief Subscribes the client to <topic> with the given SF. A client
+ * subscribed twice to the same topic only has its SF updated.
+ * 
+ */
+void subscribe_topic(struct Database* database, struct Subscriber* subscriber,
+                     const string &topic, bool SF);
+
+/**
+ * @brief Unsubscribes the client from <topic> in O(1).
+ * 
+ */
+void unsubscribe_topic(struct Database* database, struct Subscriber* subscriber,
+                       const string &topic);
+
+/**
+ * @brief Applies every "subscribe <topic> <SF>" / "unsubscribe <topic>" line
+ * of a bulk frame <body> for the client at <socket_fd> in a single pass.
+ * Returns the number of applied lines, invalid lines are skipped.
+ * 
+ */
+int apply_bulk_subscriptions(struct Database* database, int socket_fd,
+                             const char *body, int size);
+
 #endif
\ No newline at end of file
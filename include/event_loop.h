@@ -0,0 +1,366 @@
+/**
+ * @file event_loop.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the coroutines of the client connections: awaitable
+ * receive/send operations resumed by the select() loop of the server
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#ifndef _EVENT_LOOP_H
+#define _EVENT_LOOP_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "post.h"
+#include "latency.h"
+#include "shared_ring.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+using namespace std;
+
+/*
+    Frames of a priority class waiting for the output of a socket
+
+    | FRAMES | DEFICIT |
+    |________|_________|
+
+    <frames>    = header and body of each frame, with the time it was
+    |             queued
+    <deficit>   = bytes the socket may still move to its output in the
+    |             current round (deficit round robin)
+*/
+struct Pending_Frame {
+    uint64_t queued_ns;
+    string bytes;
+    vector<struct Egress_Mark> marks;
+};
+
+struct Class_Queue {
+    deque<struct Pending_Frame> frames;
+    uint64_t deficit = 0;
+};
+
+struct Pending_Output {
+    struct Class_Queue classes[PRIORITY_CLASSES];
+    size_t bytes = 0;
+};
+
+/*
+    Output of a socket held back for write coalescing
+
+    | DEADLINE | FRAMES |
+    |__________|________|
+
+    <deadline>  = time at which the output is sent at the latest
+    <frames>    = class and time of each frame held, so the time it was
+    |             held is counted in the delays of its class
+*/
+struct Held_Frame {
+    int priority;
+    uint64_t queued_ns;
+};
+
+struct Held_Output {
+    uint64_t deadline;
+    vector<struct Held_Frame> frames;
+};
+
+/*
+    Deliveries traced on a socket
+
+    <sent>  = bytes the socket accepted since the first mark
+    <marks> = deliveries whose frame is not sent yet, in output order
+*/
+struct Egress_Log {
+    uint64_t sent = 0;
+    deque<struct Egress_Mark> marks;
+};
+
+/*
+    Event loop of the client connections
+
+    | READERS | PARTIAL | FLUSHED | OUTPUT | HELD | COALESCE | PENDING | ACTIVE | DELAYS | COUNTERS | RINGS |
+    |_________|_________|_________|________|______|__________|_________|________|________|__________|_______|
+
+    Every client connection is a coroutine (see session.h) that only
+    suspends when its socket has no data: it never blocks the loop.
+    <readers>   = socket -> coroutine waiting for the socket to be readable
+    <partial>   = sockets whose coroutine holds part of a frame (its
+    |             bytes are only in the coroutine frame): a handover
+    |             waits until no socket is in the middle of a frame
+    <flushed>   = socket -> coroutine waiting for <output> to be sent
+    <output>    = socket -> bytes not yet accepted by the socket; they are
+    |             sent when select() finds the socket writable. Frames for
+    |             a client (posts, SF replay) are only appended here, so a
+    |             slow client never delays the others.
+    <held>      = socket -> output held back while the frames are held
+    |             to be sent together (write coalescing). The
+    |             output is sent at the end of the first loop iteration
+    |             that finds no new events, so an idle server adds no
+    |             latency; under a burst the frames of many iterations
+    |             go in one write, until the deadline or until
+    |             COALESCE_MAX_BYTES are held.
+    <coalesce_ns> = longest time a frame is held (0 - sent at once)
+    <pending>   = socket -> frames of a backlogged client, by priority
+    |             class: once the socket does not take its output, the
+    |             next frames wait here and the scheduler moves them to
+    |             the output when it is below SCHEDULE_LOW_WATER, the
+    |             high class first, so an alarm never waits behind a
+    |             megabyte of telemetry
+    <active>    = sockets having frames of each class, in round robin
+    |             order: every round a socket moves up to its quantum
+    |             (SCHEDULE_QUANTUM times the weight of the class), so a
+    |             client replaying its SF queue gets the same share of
+    |             the output as the others
+    <delays>    = time the frames of each class waited in <pending> or
+    |             in <held> (0 for the frames sent at once), for "stats"
+    <frames>, <writes>, <written> = frames queued, writes to the sockets
+    |             and their bytes, for "stats"
+    <tracer>    = latency tracer (NULL - not traced)
+    <egress>    = socket -> traced deliveries waiting in its output: the
+    |             latency of a post is recorded when the socket accepts
+    |             its frame, so it includes the time spent in <held>,
+    |             <pending> and <output>
+    <rings>     = socket -> shared memory ring of a local client: its
+    |             frames are written in the ring instead of <output>.
+    |             When the ring is full they wait in <pending> and the
+    |             scheduler retries them every RING_RETRY_NS, so a
+    |             subscriber that does not read never blocks the loop.
+
+    The sockets stay blocking, the operations of the loop use MSG_DONTWAIT,
+    so the code outside the loop (handover, exit) may still block on them.
+*/
+struct Event_Loop {
+    unordered_map<int, coroutine_handle<>> readers;
+    unordered_set<int> partial;
+    unordered_map<int, coroutine_handle<>> flushed;
+    unordered_map<int, string> output;
+    unordered_map<int, struct Held_Output> held;
+    uint64_t coalesce_ns = 0;
+    unordered_map<int, struct Pending_Output> pending;
+    deque<int> active[PRIORITY_CLASSES];
+    struct Latency_Histogram delays[PRIORITY_CLASSES] = {};
+    uint64_t frames = 0;
+    uint64_t writes = 0;
+    uint64_t written = 0;
+    struct Latency_Tracer *tracer = NULL;
+    unordered_map<int, struct Egress_Log> egress;
+    unordered_map<int, struct Shared_Ring*> rings;
+};
+
+/*
+    Coroutine started by the loop and never awaited (a client connection).
+    It runs until its first suspension when it is called and frees its
+    frame when it returns.
+*/
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task(); }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+};
+
+/*
+    Awaitable operation returning true/false (e.g. a whole frame was
+    received). It starts when it is awaited and resumes its caller
+    directly when it returns (symmetric transfer), so a chain of
+    operations costs no stack.
+*/
+struct Async {
+    struct promise_type {
+        bool result = false;
+        coroutine_handle<> caller;
+
+        Async get_return_object() {
+            return Async(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() noexcept { return {}; }
+
+        struct Return_To_Caller {
+            bool await_ready() noexcept { return false; }
+            coroutine_handle<> await_suspend(coroutine_handle<promise_type> self) noexcept {
+                return self.promise().caller;
+            }
+            void await_resume() noexcept {}
+        };
+        Return_To_Caller final_suspend() noexcept { return {}; }
+        void return_value(bool value) { result = value; }
+        void unhandled_exception() { terminate(); }
+    };
+
+    coroutine_handle<promise_type> handle;
+
+    explicit Async(coroutine_handle<promise_type> operation) : handle(operation) {}
+    Async(Async &&other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    Async(const Async &) = delete;
+    ~Async() {
+        if(handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> caller) {
+        handle.promise().caller = caller;
+        return handle;
+    }
+    bool await_resume() { return handle.promise().result; }
+};
+
+/*
+    Suspends the coroutine until select() finds <socket_fd> readable.
+*/
+struct Wait_Readable {
+    struct Event_Loop *loop;
+    int socket_fd;
+
+    bool await_ready() { return false; }
+    void await_suspend(coroutine_handle<> waiting) { loop->readers[socket_fd] = waiting; }
+    void await_resume() {}
+};
+
+/*
+    Suspends the coroutine until the output of <socket_fd> is sent.
+*/
+struct Wait_Flushed {
+    struct Event_Loop *loop;
+    int socket_fd;
+
+    bool await_ready() {
+        auto output = loop->output.find(socket_fd);
+        return (output == loop->output.end() || output->second.empty()) &&
+               loop->pending.count(socket_fd) == 0;
+    }
+    void await_suspend(coroutine_handle<> waiting) { loop->flushed[socket_fd] = waiting; }
+    void await_resume() {}
+};
+
+/**
+ * @brief Receives exactly <length> bytes, suspending while the socket
+ * has no data. The socket is in <partial> from the first byte received
+ * until the last one.
+ *
+ * @return true - all the bytes were received
+ * @return false - the peer closed the connection or an error occured
+ */
+Async async_recv_all(struct Event_Loop* loop, int socket_fd, void *buffer, size_t length);
+
+/**
+ * @brief Receives a header and its whole body (see recv_frame). The
+ * socket stays in <partial> from the first byte of the header until the
+ * body is received.
+ */
+Async async_recv_frame(struct Event_Loop* loop, int socket_fd, struct Send_Header *header,
+                       vector<char> &body, int max_size);
+
+/**
+ * @brief Queues the frame and waits until it is sent.
+ *
+ * @return false - the client cannot receive frames anymore
+ */
+Async async_send_frame(struct Event_Loop* loop, int socket_fd, int operation,
+                       const char *body, int size);
+
+/**
+ * @brief Sends the frame now if the socket accepts it whole, otherwise
+ * appends (the rest of) it to the output of the socket. With write
+ * coalescing the frame is held in the output instead. When the socket
+ * already has output waiting, the frame waits in the queue of its
+ * <priority> class. A client whose output exceeds MAX_CLIENT_OUTPUT is
+ * shut down. The <marks> (posts of the frame) are recorded in the tracer
+ * of the loop when the socket accepts the frame. The frames of a socket
+ * having a ring are written in the ring, or wait in their class while
+ * the ring is full.
+ *
+ * @return false - the client cannot receive frames anymore
+ */
+bool queue_frame(struct Event_Loop* loop, int socket_fd, int operation,
+                 const char *body, int size, uint64_t sequence,
+                 int priority = PRIORITY_NORMAL,
+                 const struct Egress_Mark *marks = NULL, int mark_count = 0);
+
+/**
+ * @brief Moves the pending frames to the outputs below SCHEDULE_LOW_WATER,
+ * at most SCHEDULE_BUDGET bytes: weighted deficit round robin over the
+ * classes, round robin over the sockets of a class. An output that was
+ * empty is sent at once.
+ *
+ * @return true - the budget ran out before the outputs were filled (the
+ * loop should not wait for new events)
+ */
+bool schedule_output(struct Event_Loop* loop);
+
+/**
+ * @brief Checks if frames wait for space in a shared memory ring (the
+ * loop should not wait longer than RING_RETRY_NS for new events).
+ */
+bool rings_backlogged(struct Event_Loop* loop);
+
+/**
+ * @brief Class of a name ("high", "normal", "bulk").
+ *
+ * @return -1 - unknown class
+ */
+int parse_priority_class(const char *name);
+
+/**
+ * @brief Sends the held output of the sockets whose deadline is before
+ * <now> (all of them for UINT64_MAX). What a socket does not accept is
+ * sent when it becomes writable.
+ */
+void flush_held(struct Event_Loop* loop, uint64_t now);
+
+/**
+ * @brief Prints the frames, the writes and the bytes per write, then the
+ * queueing delay of each priority class.
+ */
+void print_output_stats(struct Event_Loop* loop);
+
+/**
+ * @brief Adds the sockets waited by the coroutines to the sets of select()
+ * (the sockets holding their output are not watched for writing).
+ */
+void watch_events(struct Event_Loop* loop, fd_set *read_fds, fd_set *write_fds,
+                  int *max_fds);
+
+/**
+ * @brief Sends the output of the writable sockets and resumes the
+ * coroutines of the ready sockets. The handled sockets are cleared
+ * from the sets.
+ */
+void resume_ready(struct Event_Loop* loop, fd_set *read_fds, fd_set *write_fds);
+
+/**
+ * @brief Sends all the output of the sockets, then their pending frames
+ * by class, blocking for at most DRAIN_TIMEOUT_MS (before the exit or the
+ * handover of the server). The frames of the rings are written as the
+ * subscribers free space. The clients whose output is not sent in time
+ * are shut down.
+ */
+void drain_output(struct Event_Loop* loop);
+
+/**
+ * @brief The client does not read its frames (or is dead): its output is
+ * dropped and its reader sees the end of the connection and disconnects
+ * it.
+ */
+void shut_down_client(struct Event_Loop* loop, int socket_fd);
+
+/**
+ * @brief Forgets the waiting coroutines, the partial frame, the output,
+ * the pending frames and the ring of a socket that is closed.
+ */
+void forget_socket(struct Event_Loop* loop, int socket_fd);
+
+#endif
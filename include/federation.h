@@ -0,0 +1,140 @@
+/**
+ * @file federation.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the links between servers forming a mesh, where the
+ *        posts received by a server reach the subscribers of all servers.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _FEDERATION_H
+#define _FEDERATION_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "post.h"
+#include <string>
+#include <unordered_set>
+#include <time.h>
+
+using namespace std;
+
+struct Database;
+struct Event_Loop;
+
+/*
+    Peer server
+
+    | SOCKET | CONNECTING | ADDRESS | TOPICS | OUTPUT | BATCH | INTEREST |
+    |________|____________|_________|________|________|_______|__________|
+
+    <socket_fd> = link with the peer (-1 while not connected)
+    <connecting> = the connect() of <socket_fd> is in progress
+    <address>   = address given with -P (empty for accepted links,
+    |             which are not reconnected by this server)
+    <name>      = IP:PORT of the peer server
+    <topics>    = topics for which the peer has subscribers
+    <output>    = frames not yet accepted by the socket
+    <batch>     = posts forwarded during the current iteration
+    <interest>  = "+topic" / "-topic" lines not yet sent
+*/
+struct Peer {
+    int socket_fd;
+    bool connecting;
+    string address;
+    string name;
+    unordered_set<string> topics;
+    vector<char> output;
+    vector<char> batch;
+    string interest;
+    time_t next_retry;
+};
+
+/*
+    Federation
+
+    | PORT | PEERS | FORWARDED | RECEIVED | MALFORMED | LOOP |
+    |______|_______|___________|__________|___________|______|
+
+    <port>      = port of this server, announced to the peers
+    <peers>     = links with the other servers
+    <forwarded> = posts sent to peers / <received> = posts from peers
+    <malformed> = posts from peers dropped by valid_datagram
+    <loop>      = event loop of the server: the frames of each link are
+    |             received by a coroutine, like the ones of a client
+*/
+struct Federation {
+    int port;
+    vector<struct Peer> peers;
+    unsigned long forwarded;
+    unsigned long received;
+    unsigned long malformed;
+    struct Event_Loop *loop;
+};
+
+/*
+    Peer protocol (frames with Send_Header on the link)
+
+    PEER_HELLO_CODE     - <port of the sender>
+    PEER_INTEREST_CODE  - lines "+topic" / "-topic"
+    PEER_POSTS_CODE     - records | LENGTH | IP | PORT | INGRESS | SUBSCRIPTION POST |
+
+    The posts received from a peer are only delivered to local
+    subscribers and never forwarded again, so the servers have to
+    form a full mesh, each pair being linked once.
+*/
+
+/**
+ * @brief Adds the peers given as IP:PORT, they are connected by
+ * connect_peers.
+ */
+void init_federation(struct Federation* federation, int port,
+                     const vector<string> &addresses);
+
+/**
+ * @brief Connects to the configured peers that are not connected yet,
+ * without blocking: the peers whose connect() is in progress are added to
+ * <write_fds> and checked at the next call. Returns the time of the next
+ * retry (0 if all peers are connected).
+ */
+time_t connect_peers(struct Federation* federation, struct Database* database,
+                     fd_set *write_fds, int *max_fds);
+
+/**
+ * @brief Accepts a link from another server on the TCP listener, once
+ * its first frame (PEER_HELLO_CODE, having the <port> of the server)
+ * was received.
+ */
+void accept_peer(struct Federation* federation, struct Database* database,
+                 int socket_fd, struct sockaddr_in address, const char *port);
+
+/**
+ * @brief Returns the peer linked at <socket_fd> or NULL.
+ */
+struct Peer* find_peer(struct Federation* federation, int socket_fd);
+
+/**
+ * @brief Announces to the peers that the first local client subscribed
+ * to <topic> / the last local client unsubscribed from <topic>.
+ * A NULL federation is ignored.
+ */
+void federation_topic_added(struct Federation* federation, const string &topic);
+void federation_topic_removed(struct Federation* federation, const string &topic);
+
+/**
+ * @brief Adds the post received from an UDP client to the batch of every
+ * peer interested in its topic.
+ */
+void forward_post(struct Federation* federation, struct Subscription_Post* post,
+                  int length, struct sockaddr_in source, uint64_t ingress_ns);
+
+/**
+ * @brief Sends the batches and interest changes of the iteration, one frame
+ * of each kind per peer, without blocking. Peers with output left are added
+ * to <write_fds>.
+ */
+void flush_peers(struct Federation* federation, fd_set *write_fds, int *max_fds);
+
+#endif
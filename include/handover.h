@@ -0,0 +1,64 @@
+/**
+ * @file handover.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for handing the sockets and the Database of a running
+ *        server over to a newly started server (hot restart).
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _HANDOVER_H
+#define _HANDOVER_H
+
+#include "helpers.h"
+#include "database.h"
+
+using namespace std;
+
+/*
+    Handover protocol over a Unix domain socket
+
+    old server                                          new server
+        | <--------------------- connect --------------------- |
+        | --- HANDOVER_STATE   (Database)                  ---> |
+        | --- HANDOVER_CLIENTS (Unix listener, flags, IDs) ---> |
+        | --- SCM_RIGHTS (listeners, clients, rings)       ---> |
+        | <------------------ HANDOVER_DONE ------------------ |
+      exit                                              continue
+
+    HANDOVER_CLIENTS starts with a line telling if the Unix listener is
+    passed, then has a line "<flags> <ID>" per connected client. The
+    descriptors are the UDP socket, the TCP listener, the Unix listener
+    (if any), the client sockets and the memfd and eventfd of the shared
+    memory ring of every client whose flags have HANDOVER_RING_FLAG, so
+    the local clients keep their rings too.
+
+    The running server waits for its replacement on a Unix domain
+    socket (open_unix_listener). It hands over at the end of an
+    iteration of its loop once no client is in the middle of a frame
+    (Event_Loop.partial), so the clients keep their connections and the
+    new server continues from the next frame in their sockets. A client
+    still sending its frame after HANDOVER_WAIT_NS is disconnected.
+*/
+
+/**
+ * @brief Sends the state and the sockets of the server on <channel_fd>.
+ * 
+ * @return true - the new server took over
+ * @return false - the handover failed, the server keeps running
+ */
+bool hand_over(int channel_fd, struct Database* database,
+               int socket_fd_UDP, int socket_fd_TCP, int socket_fd_unix);
+
+/**
+ * @brief Connects to the server listening at <path> and takes over its
+ * state and sockets. The sockets of the connected clients are stored
+ * in <client_fds>, their rings in the connections of the Database.
+ * <socket_fd_unix> is -1 if the server had no Unix listener.
+ */
+bool take_over(const char *path, struct Database* database, int *socket_fd_UDP,
+               int *socket_fd_TCP, int *socket_fd_unix, vector<int> &client_fds);
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @file heartbeat.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the detection of the dead clients: heartbeats sent to
+ * the silent clients, tracked in a timer wheel, and the reclaiming of the
+ * connections that stop answering
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#ifndef _HEARTBEAT_H
+#define _HEARTBEAT_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "database.h"
+#include "timer_wheel.h"
+
+using namespace std;
+
+/*
+    | HEARD | TIMER | MISSED |
+    |_______|_______|________|
+
+    Liveness of a client connection.
+    <heard>     = tick of the last frame received from the client
+    <timer>     = id of the timer of the connection in the wheel, the
+    |             other timers fired for the socket are ignored
+    <missed>    = heartbeats sent since the client was last heard (any
+    |             frame of the client resets it)
+*/
+struct Peer_Liveness {
+    uint64_t heard;
+    uint64_t timer;
+    int missed;
+};
+
+/*
+    Heartbeats of the client connections
+
+    | INTERVAL | MISSES | WHEEL | PEERS | COUNTERS |
+    |__________|________|_______|_______|__________|
+
+    <interval>  = ticks (HEARTBEAT_TICK_MS) a client may stay silent
+    |             before it is sent a HEARTBEAT (-K <ms>[:<misses>],
+    |             0 - disabled, the default)
+    <misses>    = unanswered heartbeats after which the client is dead:
+    |             its connection is reset, which ends its session (the
+    |             client is set offline, its posts go to its SF queue
+    |             again, its socket is closed and forgotten)
+    <wheel>     = one timer per connection, due <interval> after the
+    |             client was last heard. A received frame only sets
+    |             <heard>; the timer finds it when it fires and starts
+    |             again from it, so a tick only costs the timers it
+    |             fires, whatever the number of connections.
+    <peers>     = socket -> liveness, for the clients that set
+    |             ID_HEARTBEAT_FLAG (they answer every HEARTBEAT with
+    |             one). The other TCP clients get the same limits from
+    |             the TCP keepalive probes of their socket.
+    <sent>, <answered>, <reclaimed> = heartbeats sent, answers received
+    |             and connections reset (printed by "stats")
+*/
+struct Heartbeat {
+    uint64_t interval = 0;
+    int misses = DEFAULT_HEARTBEAT_MISSES;
+    struct Timer_Wheel wheel;
+    unordered_map<int, struct Peer_Liveness> peers;
+    uint64_t next_timer = 1;
+    uint64_t sent = 0;
+    uint64_t answered = 0;
+    uint64_t reclaimed = 0;
+};
+
+/**
+ * @brief Starts the heartbeats every <interval_ms> (rounded up to
+ * HEARTBEAT_TICK_MS), a client being dead after <misses> of them.
+ */
+void init_heartbeat(struct Heartbeat* heartbeat, uint64_t interval_ms, int misses);
+
+/**
+ * @brief Watches the client logged in at <socket_fd>: with heartbeats if
+ * it answers them (<answers>), otherwise with the TCP keepalive of its
+ * socket. A NULL heartbeat is ignored.
+ */
+void watch_peer(struct Heartbeat* heartbeat, int socket_fd, bool answers);
+
+/**
+ * @brief A frame was received from the client at <socket_fd>, in O(1)
+ * (the wheel is not touched).
+ */
+void heard_from(struct Heartbeat* heartbeat, int socket_fd, int operation);
+
+/**
+ * @brief The connection ended: its timer is no longer expected.
+ */
+void forget_peer(struct Heartbeat* heartbeat, int socket_fd);
+
+/**
+ * @brief Moves the wheel to the current tick: sends the heartbeats due
+ * and resets the connections of the dead clients.
+ */
+void check_heartbeats(struct Database* database);
+
+/**
+ * @brief Microseconds until the tick of the earliest timer of the wheel
+ * (-1 if it has none), the longest the select() loop may sleep.
+ */
+int64_t heartbeat_timeout(struct Database* database);
+
+/**
+ * @brief Prints the heartbeat counters.
+ */
+void print_heartbeat_stats(struct Heartbeat* heartbeat);
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * @file latency.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the ingress-to-egress latency tracing of the posts
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include "helpers.h"
+#include "constants.h"
+#include <string>
+
+using namespace std;
+
+/*
+    Histogram of latencies (nanoseconds)
+
+    Log-linear buckets: every power of 2 is split in LATENCY_SUB_BUCKETS
+    linear buckets, so a percentile is known within 25% at any scale
+    with a fixed, small array.
+*/
+#define LATENCY_SUB_BITS        2
+#define LATENCY_SUB_BUCKETS     (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS         (64 * LATENCY_SUB_BUCKETS)
+
+struct Latency_Histogram {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[LATENCY_BUCKETS];
+};
+
+/*
+    Sampled delivery in the trace ring
+
+    | INGRESS | EGRESS | TOPIC HASH | SOCKET | KIND |
+    |_________|________|____________|________|______|
+
+    <ingress> = kernel receive time of the datagram (CLOCK_REALTIME)
+    <egress>  = time at which the transport (socket or ring) accepted
+    |           the last byte of the frame, after any queueing
+    <kind>    = TRACE_LIVE / TRACE_REPLAY (SF queue)
+
+    Posts forwarded by a peer server keep the ingress time of the server
+    that received the datagram.
+*/
+#define TRACE_LIVE              0
+#define TRACE_REPLAY            1
+#define TRACE_MAGIC             "TUTRACE1"
+
+struct Trace_Record {
+    uint64_t ingress_ns;
+    uint64_t egress_ns;
+    uint32_t topic_hash;
+    int32_t socket_fd;
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+/*
+    Delivery waiting for its frame to leave the output of a socket
+
+    | INGRESS | TOPIC | HISTOGRAM | KIND | END |
+    |_________|_______|___________|______|_____|
+
+    <topic>     = interned topic of the post (never freed)
+    <histogram> = histogram the latency goes in (topic or replay)
+    <end>       = position, in the bytes queued for the socket, of the
+    |             end of the frame: the delivery is recorded once the
+    |             socket accepted that many bytes
+*/
+struct Egress_Mark {
+    uint64_t ingress_ns;
+    const string *topic;
+    struct Latency_Histogram *histogram;
+    int kind;
+    uint64_t end;
+};
+
+/*
+    Latency tracer
+
+    <topics>        = histogram per topic of the live deliveries
+    <replay>        = histogram of the deliveries from the SF queues
+    <trace>         = ring of the sampled deliveries (oldest overwritten)
+    <sample_rate>   = one delivery in <sample_rate> is traced
+*/
+struct Latency_Tracer {
+    unordered_map<string, struct Latency_Histogram> topics;
+    struct Latency_Histogram replay;
+    vector<struct Trace_Record> trace;
+    uint64_t traced;
+    uint64_t deliveries;
+    unsigned int sample_rate;
+};
+
+/**
+ * @brief Prepares the tracer, tracing one delivery in <sample_rate>.
+ */
+void init_tracer(struct Latency_Tracer* tracer, unsigned int sample_rate);
+
+/**
+ * @brief Asks the kernel for software receive timestamps on <socket_fd>.
+ */
+bool enable_rx_timestamps(int socket_fd);
+
+/**
+ * @brief Receives a datagram and its kernel receive time. Without a kernel
+ * timestamp the time of the call is used. <flags> as for recvmsg.
+ */
+ssize_t recv_timestamped(int socket_fd, void *buffer, size_t length,
+                         struct sockaddr_in *source, uint64_t *ingress_ns, int flags);
+
+/**
+ * @brief Current CLOCK_REALTIME in nanoseconds (the clock of the kernel
+ * timestamps).
+ */
+uint64_t now_ns();
+
+/**
+ * @brief Histogram of a topic, looked up once per post.
+ */
+struct Latency_Histogram* topic_histogram(struct Latency_Tracer* tracer,
+                                          const char *topic);
+
+/**
+ * @brief Adds a latency (ns) in the histogram.
+ */
+void add_latency(struct Latency_Histogram* histogram, uint64_t latency);
+
+/**
+ * @brief Records a delivery in the <histogram> and, if sampled, in the trace.
+ */
+void record_latency(struct Latency_Tracer* tracer, struct Latency_Histogram* histogram,
+                    const char *topic, uint64_t ingress_ns, uint64_t egress_ns,
+                    int socket_fd, int kind);
+
+/**
+ * @brief Approximate <percentile> (0 - 100) of the histogram, in ns.
+ */
+uint64_t histogram_percentile(struct Latency_Histogram* histogram, double percentile);
+
+/**
+ * @brief Prints count, p50, p99 and max for every topic and for the replay.
+ */
+void print_latency_stats(struct Latency_Tracer* tracer);
+
+/**
+ * @brief Writes the trace ring (oldest record first) in a binary file:
+ * | MAGIC | COUNT | TRACE_RECORD ... |
+ */
+bool dump_trace(struct Latency_Tracer* tracer, const char *path);
+
+#endif
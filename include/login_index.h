@@ -0,0 +1,92 @@
+/**
+ * @file login_index.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the index of the client IDs used when a client
+ * logs in: the session state of every known ID, found in O(1)
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _LOGIN_INDEX_H
+#define _LOGIN_INDEX_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "subscriber.h"
+
+using namespace std;
+
+/*
+    Key of a client ID
+
+    | ID | HASH |
+    |____|______|
+
+    <ID>    = the ID padded with '\0' up to ID_MAX_LEN, so two keys are
+    |         compared as fixed blocks (see topic_kernels.h), without
+    |         strcmp
+    <hash>  = hash of the padded ID, computed once when the ID is received
+*/
+struct Login_Key {
+    char ID[ID_MAX_LEN];
+    uint64_t hash;
+};
+
+/*
+    Session of a client ID
+
+    | KEY | SOCKET | STATE |
+    |_____|________|_______|
+
+    <state>     = SESSION_OFFLINE, SESSION_CONNECTING (the ID frame was
+    |             accepted, the login is not finished yet, so a second
+    |             login with the same ID is refused) or SESSION_ONLINE
+    <socket>    = socket of the client while it is connecting/online
+*/
+struct Session {
+    struct Login_Key key;
+    int socket_fd;
+    int state;
+};
+
+/*
+    Index of the IDs
+
+    <slots> = open addressing table (linear probing), its size is a power
+    |         of 2 and it doubles when half full; a slot with state
+    |         SESSION_FREE is empty. IDs are never removed, like the
+    |         clients of the database.
+*/
+struct Login_Index {
+    vector<struct Session> slots;
+    size_t used = 0;
+};
+
+/**
+ * @brief Builds the padded key and its hash from the ID.
+ */
+void make_login_key(const char *ID, struct Login_Key* key);
+
+/**
+ * @brief Finds the session of the ID, NULL if the ID never logged in.
+ */
+struct Session* find_session(struct Login_Index* index, const struct Login_Key* key);
+
+/**
+ * @brief Starts the login of the ID on <socket_fd>.
+ * 
+ * @return true - the ID is offline (or new) and it is now connecting
+ * @return false - the ID is already connecting or online
+ */
+bool begin_login(struct Login_Index* index, const struct Login_Key* key, int socket_fd);
+
+/**
+ * @brief Sets the state (and socket) of the session of the ID, adding
+ * the ID if needed.
+ */
+void set_session(struct Login_Index* index, const struct Login_Key* key,
+                 int socket_fd, int state);
+
+#endif
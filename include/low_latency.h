@@ -0,0 +1,46 @@
+/**
+ * @file low_latency.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the latency-optimized run mode of the server
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _LOW_LATENCY_H
+#define _LOW_LATENCY_H
+
+#include "helpers.h"
+#include "server_config.h"
+
+using namespace std;
+
+/*
+    Busy-poll mode (-b <usec>)
+
+    The server never sleeps in select(): the UDP socket is non-blocking,
+    select() is called with a zero timeout and every ready datagram is
+    read in the same iteration (at most BUSY_POLL_BUDGET). The kernel
+    also busy-polls the device queue for <usec> on the reads of the UDP
+    socket (SO_BUSY_POLL).
+
+    The single thread of the server (ingest and fan-out) may be pinned
+    to a core (-c <cpu>) and the memory allocated at startup is locked
+    (mlockall), so that neither a migration nor a page fault delays a
+    post.
+*/
+
+/**
+ * @brief Sets O_NONBLOCK on the descriptor.
+ */
+bool set_nonblocking(int socket_fd);
+
+/**
+ * @brief Applies the options of the <config> for the latency-optimized
+ * mode. Options that cannot be applied (missing privileges) are reported
+ * and skipped.
+ */
+void enter_low_latency_mode(struct Server_Config* config, int socket_fd_UDP);
+
+#endif
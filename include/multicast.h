@@ -0,0 +1,97 @@
+/**
+ * @file multicast.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the multicast egress: the posts of selected topics
+ * are published once to a multicast group instead of once per client
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _MULTICAST_H
+#define _MULTICAST_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "database.h"
+#include <string>
+#include <unordered_set>
+
+using namespace std;
+
+/*
+    Multicast egress
+
+    | SOCKET | GROUP | TOPICS | COUNTERS |
+    |________|_______|________|__________|
+
+    <group>     = multicast group and port (-M <IP>:<PORT>)
+    <topics>    = topics published to the group (-m <topic>, repeated)
+    <published>, <naks>, <resent> = datagrams sent to the group, NAKs
+    |             received and posts sent again for them
+
+    A datagram is a SUBSCRIPTION_SEND frame (header with the sequence of
+    the post in its topic, then the text). The clients that set
+    ID_MULTICAST_FLAG get the group (MULTICAST_SETUP) and, for each of
+    their subscriptions to these topics, a MULTICAST_JOIN with the current
+    sequence of the topic (MULTICAST_LEAVE when they unsubscribe); their
+    posts of these topics are then only sent to the group. A client that
+    finds a gap in the sequences sends a NAK ("<first> <last> <topic>") on
+    its TCP connection: the retained posts of the range are sent again
+    on it, followed by a NAK frame with <last> as its sequence.
+*/
+struct Multicast {
+    int socket_fd;
+    struct sockaddr_in group;
+    unordered_set<string> topics;
+    uint64_t published = 0;
+    uint64_t naks = 0;
+    uint64_t resent = 0;
+};
+
+/**
+ * @brief Opens the socket publishing to the group.
+ * 
+ * @return false - invalid group or socket error
+ */
+bool open_multicast(struct Multicast* multicast, const char *group,
+                    const vector<string> &topics);
+
+/**
+ * @brief Tells if the posts of the topic are published to the group
+ * (false for a NULL multicast).
+ */
+bool multicast_topic(struct Multicast* multicast, const string &topic);
+
+/**
+ * @brief Publishes the post to the group.
+ */
+void multicast_post(struct Multicast* multicast, const char *content, int size,
+                    uint64_t sequence);
+
+/**
+ * @brief Sends the group and the multicast topics of a client that just
+ * logged in (only if it asked for the multicast).
+ */
+void multicast_login(struct Database* database, struct Subscriber* subscriber);
+
+/**
+ * @brief Tells a connected multicast client that it now receives (or no
+ * longer receives) the topic from the group.
+ */
+void multicast_subscribed(struct Database* database, struct Subscriber* subscriber,
+                          const string &topic, bool joined);
+
+/**
+ * @brief Sends again the retained posts asked by a NAK of the client,
+ * for a topic it is subscribed to (the other NAKs are ignored).
+ */
+void answer_nak(struct Database* database, int socket_fd, const char *body);
+
+/**
+ * @brief Prints the counters of the multicast egress.
+ */
+void print_multicast_stats(struct Multicast* multicast);
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file network.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for helpers that send and receive complete
+ *        frames (header + body) over a stream socket.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _NETWORK_H
+#define _NETWORK_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "post.h"
+
+using namespace std;
+
+/**
+ * @brief Receives exactly <length> bytes from the socket.
+ * 
+ * @return true - all the bytes were received
+ * @return false - the peer closed the connection or an error occured
+ */
+bool recv_all(int socket_fd, void *buffer, size_t length);
+
+/**
+ * @brief Sends exactly <length> bytes on the socket.
+ * 
+ * @return true - all the bytes were sent
+ * @return false - an error occured
+ */
+bool send_all(int socket_fd, const void *buffer, size_t length);
+
+/**
+ * @brief Sends a header having <operation> and <size> followed
+ * by <size> bytes of body.
+ */
+bool send_frame(int socket_fd, int operation, const char *body, int size,
+                uint64_t sequence = 0);
+
+/**
+ * @brief Receives a header and its whole body in <body>. Bodies
+ * larger than <max_size> are rejected.
+ * 
+ * @return true - a complete frame was received
+ * @return false - the peer disconnected or sent an invalid frame
+ */
+bool recv_frame(int socket_fd, struct Send_Header *header,
+                vector<char> &body, int max_size);
+
+/**
+ * @brief Creates a Unix domain stream socket listening at <path>,
+ * replacing a socket file left by a previous server.
+ */
+int open_unix_listener(const char *path, int backlog);
+
+/**
+ * @brief Connects to the Unix domain socket at <path>.
+ * 
+ * @return the socket or -1
+ */
+int connect_unix(const char *path);
+
+/**
+ * @brief Sends the file descriptors <fds> over the Unix domain socket
+ * <channel_fd> (SCM_RIGHTS), in groups of at most MAX_PASSED_FDS.
+ */
+bool send_fds(int channel_fd, const int *fds, int count);
+
+/**
+ * @brief Receives <count> file descriptors sent with send_fds.
+ */
+bool recv_fds(int channel_fd, int *fds, int count);
+
+/**
+ * @brief Parses a multicast group "<IP>:<PORT>".
+ * 
+ * @return false - not an IPv4 multicast address
+ */
+bool parse_multicast_group(const char *text, struct sockaddr_in *group);
+
+/**
+ * @brief Opens the UDP socket publishing to a multicast group (the
+ * datagrams are also looped back to the receivers on this host).
+ * 
+ * @return the socket or -1
+ */
+int open_multicast_sender();
+
+/**
+ * @brief Opens a UDP socket bound to the port of the group and joins
+ * the group. Several receivers on the same host may join it.
+ * 
+ * @return the socket or -1
+ */
+int join_multicast_group(const struct sockaddr_in *group);
+
+#endif
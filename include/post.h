@@ -13,6 +13,7 @@
 #define _POST_H
 
 #include "helpers.h"
+#include "constants.h"
 
 /*
     Subscription Post from UDP clients
@@ -40,23 +41,22 @@ struct Subscription_Post {
     | OPERATION | CONTENT |
     |___________|_________|
 
-    Whenever a client is offline and subscribed to
-    a specific topic and the server receives a new
-    post having the topic, we store in the queue of
-    posts of the client the post having this format.
+    Text of a post for the TCP clients, made by receive_post
+    when the post is delivered (the SF queues and the logs
+    keep the posts in their compact form, see stored_post.h).
 
 */
 
 struct Send_Post {
     int operation;
-    char content[BUFLEN];   
+    char content[BUFLEN];
 };
 
 /*
     Header for the TCP clients
 
-    | SIZE  | OPERATION |
-    |_______|___________|
+    | SIZE  | OPERATION | SEQUENCE |
+    |_______|___________|__________|
 
     In order to communicate between the server and the
     TCP clients via text - messages, we send a header 
@@ -64,6 +64,10 @@ struct Send_Post {
     the operation code (defined in the constants). This
     way the receiver knows how many bytes to receive.
 
+    SEQUENCE numbers the posts of each topic (1, 2, ...) so that
+    the client can detect gaps and skip duplicates; it is 0 for
+    all the other frames.
+
     See Also: <constants.h>
 
 */
@@ -71,6 +75,7 @@ struct Send_Post {
 struct Send_Header {
     int size;
     int operation;
+    uint64_t sequence;
 };
 
 #endif
\ No newline at end of file
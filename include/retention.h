@@ -0,0 +1,122 @@
+/**
+ * @file retention.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the retention policies of the SF queues: maximum
+ * age, count and bytes of the posts queued for an offline client
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _RETENTION_H
+#define _RETENTION_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "database.h"
+#include "timer_wheel.h"
+#include <string>
+
+using namespace std;
+
+/*
+    Retention policy of a topic
+
+    | MAX AGE | MAX COUNT | MAX BYTES |
+    |_________|___________|___________|
+
+    Limits of the posts of the topic in the SF queue of each client
+    (0 - no limit). When a limit is exceeded the oldest posts of the
+    topic are evicted first.
+    <max_age>   = seconds a post stays queued
+    <max_count> = posts of the topic queued for a client
+    <max_bytes> = bytes stored for these posts (see stored_post_bytes)
+*/
+struct Retention_Policy {
+    uint64_t max_age;
+    uint64_t max_count;
+    uint64_t max_bytes;
+};
+
+/*
+    | POLICY | EXPIRED | OVER COUNT | OVER BYTES | EVICTED BYTES |
+    |________|_________|____________|____________|_______________|
+
+    A policy and its eviction counters, by the limit that evicted the
+    posts (printed by "stats", to size the limits against the traffic)
+*/
+struct Topic_Retention {
+    struct Retention_Policy policy;
+    uint64_t expired = 0;
+    uint64_t over_count = 0;
+    uint64_t over_bytes = 0;
+    uint64_t evicted_bytes = 0;
+};
+
+/*
+    Retention of the SF queues
+
+    | TOPICS | FALLBACK | WHEEL | NEXT TIMER |
+    |________|__________|_______|____________|
+
+    <topics>    = topic -> its policy
+    <fallback>  = policy of the other topics ("*"), if <has_fallback>
+    <wheel>     = timer wheel in seconds; each (client, topic) queue with
+    |             a maximum age has one timer, due when its oldest post
+    |             expires, so expiring never scans the queues. The key of
+    |             a timer is "<ID>\0<topic>".
+    <next_timer>= id of the next timer; a queue only accepts the timer
+    |             whose id it holds (a timer is not removed when the
+    |             queue is emptied by a login)
+*/
+struct Retention {
+    unordered_map<string, struct Topic_Retention> topics;
+    struct Topic_Retention fallback;
+    bool has_fallback = false;
+    struct Timer_Wheel wheel;
+    uint64_t next_timer = 1;
+};
+
+/**
+ * @brief Parses a policy "<topic>=<max_age>[:<max_count>[:<max_bytes>]]",
+ * the topic "*" being the fallback of the topics without a policy.
+ * 
+ * @return false - invalid policy
+ */
+bool parse_retention_policy(const char *text, string &topic, struct Retention_Policy* policy);
+
+/**
+ * @brief Sets the policy of the topic ("*" for the fallback).
+ */
+void set_retention_policy(struct Retention* retention, const string &topic,
+                          const struct Retention_Policy* policy);
+
+/**
+ * @brief Applies the policy of its topic to the post just pushed at the
+ * back of the SF queue of the subscriber. A NULL retention is ignored.
+ */
+void retain_post(struct Retention* retention, struct Subscriber* subscriber);
+
+/**
+ * @brief The SF queue of the subscriber was sent: forgets its posts.
+ */
+void release_queue(struct Subscriber* subscriber);
+
+/**
+ * @brief Applies the policies to all the SF queues (after they are
+ * loaded from a snapshot or taken over).
+ */
+void retain_all(struct Database* database);
+
+/**
+ * @brief Evicts the posts whose maximum age passed before <now>.
+ */
+void expire_posts(struct Database* database, time_t now);
+
+/**
+ * @brief Prints the eviction counters of the policies.
+ */
+void print_retention_stats(struct Retention* retention);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file server_config.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the options of the server
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _SERVER_CONFIG_H
+#define _SERVER_CONFIG_H
+
+#include "helpers.h"
+#include "retention.h"
+#include <string>
+
+using namespace std;
+
+/*
+    ./server [options] <PORT>
+
+    <port>              = port for the TCP and UDP sockets
+    <snapshot_path>     = -s <file>, snapshot of the Database
+    |                     (NULL if the state is not persisted)
+    <snapshot_interval> = -i <seconds>, period of the snapshots
+    <handover_path>     = -H <path>, Unix socket on which a new server
+    |                     can take over this one
+    <takeover_path>     = -T <path>, take over the sockets and the state
+    |                     of the server listening at <path> instead of
+    |                     opening new sockets
+    <peers>             = -P <IP:PORT> (repeated), servers of the mesh
+    |                     to which this server connects
+    <unix_path>         = -u <path>, Unix domain socket for the clients
+    |                     on the same host (stream or shared memory)
+    <trace_sample_rate> = -L <N>, measure the latency of the deliveries
+    |                     and trace one in <N> (0 if disabled)
+    <busy_poll_usec>    = -b <usec>, busy-poll mode, SO_BUSY_POLL time
+    |                     of the UDP socket (0 if the server blocks)
+    <cpu>               = -c <cpu>, core of the server thread (-1 if
+    |                     not pinned)
+    <source_rate>       = -R <rate>[:<burst>], datagrams per second
+    <source_burst>      | accepted from each UDP source (0 if unlimited),
+    |                     bursts of <burst> (default <rate>)
+    <retention>         = -Q <topic>=<max_age>[:<max_count>[:<max_bytes>]]
+    |                     (repeated), retention policy of the SF queues
+    |                     for the topic ("*" - the other topics)
+    <coalesce_usec>     = -W <usec>, longest time the frames for a client
+    |                     are held to be sent in one write (0 - every
+    |                     frame is sent at once)
+    <multicast_group>   = -M <IP>:<PORT>, multicast group of the topics
+    |                     with large audiences (NULL - all unicast)
+    <multicast_topics>  = -m <topic> (repeated), topics published to
+    |                     the group
+    <capture_path>      = -C <file>, capture of the received datagrams
+    |                     for the replay tool (NULL if not captured)
+    <priorities>        = -p <topic>=<class> (repeated), priority class
+    |                     of the frames of the topic: high, normal (the
+    |                     default) or bulk
+    <heartbeat_ms>      = -K <ms>[:<misses>], a client silent for <ms> is
+    <heartbeat_misses>  | sent a heartbeat, after <misses> unanswered
+    |                     ones it is closed (0 - disabled)
+*/
+struct Server_Config {
+    int port;
+    const char *snapshot_path;
+    int snapshot_interval;
+    const char *handover_path;
+    const char *takeover_path;
+    vector<string> peers;
+    const char *unix_path;
+    unsigned int trace_sample_rate;
+    int busy_poll_usec;
+    int cpu;
+    uint64_t source_rate;
+    uint64_t source_burst;
+    vector<pair<string, struct Retention_Policy>> retention;
+    int coalesce_usec;
+    const char *multicast_group;
+    vector<string> multicast_topics;
+    const char *capture_path;
+    vector<pair<string, int>> priorities;
+    uint64_t heartbeat_ms;
+    int heartbeat_misses;
+};
+
+/**
+ * @brief Fills the <config> from the command line arguments.
+ * 
+ * @return true - valid arguments
+ * @return false - invalid arguments
+ */
+bool parse_server_arguments(int argc, char *argv[], struct Server_Config* config);
+
+#endif
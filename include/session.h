@@ -0,0 +1,53 @@
+/**
+ * @file session.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the coroutine of a client connection: handshake,
+ * SF replay and commands, written as straight-line code
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _SESSION_H
+#define _SESSION_H
+
+#include "helpers.h"
+#include "event_loop.h"
+#include "database.h"
+
+using namespace std;
+
+struct Federation;
+
+/*
+    Server side of the connections
+
+    | LOOP | DATABASE | FEDERATION |
+    |______|__________|____________|
+
+    <federation>    = receives the links opened by other servers (their
+    |                 first frame is a PEER_HELLO), NULL on the listeners
+    |                 of the local clients
+*/
+struct Session_Context {
+    struct Event_Loop *loop;
+    struct Database *database;
+    struct Federation *federation;
+};
+
+/**
+ * @brief Coroutine of a new connection: receives the ID (and the resume
+ * frame), refuses an ID in use, sends the SF queue and then applies the
+ * commands of the client until it disconnects.
+ */
+Task client_session(struct Session_Context* context, int socket_fd,
+                    struct sockaddr_in address);
+
+/**
+ * @brief Coroutine of a client already logged in (taken over from the
+ * previous server): applies its commands until it disconnects.
+ */
+Task client_commands(struct Session_Context* context, int socket_fd);
+
+#endif
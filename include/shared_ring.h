@@ -0,0 +1,122 @@
+/**
+ * @file shared_ring.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the shared memory ring used to deliver frames to
+ *        subscribers running on the same host as the server.
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _SHARED_RING_H
+#define _SHARED_RING_H
+
+#include "helpers.h"
+#include "post.h"
+#include <atomic>
+#include <sys/uio.h>
+
+using namespace std;
+
+/*
+    Ring header (start of the shared memory)
+
+    | HEAD | TAIL | CONSUMER WAITING | PRODUCER WAITING | CAPACITY |
+    |______|______|__________________|__________________|__________|
+
+    <head>  = bytes written by the server (only the server changes it)
+    <tail>  = bytes read by the subscriber (only the subscriber changes it)
+    <consumer_waiting> = the subscriber is about to sleep, the server has
+    |                    to signal the eventfd after writing
+    <producer_waiting> = the ring is full, the subscriber has to wake the
+    |                    server (futex on <tail>) after reading
+
+    Head and tail are on separate cache lines, so the two processes do not
+    invalidate each other's line on every frame. A frame is a Send_Header
+    followed by its body, written contiguously modulo the capacity.
+*/
+struct Ring_Header {
+    alignas(64) atomic<uint64_t> head;
+    alignas(64) atomic<uint64_t> tail;
+    alignas(64) atomic<uint32_t> consumer_waiting;
+    atomic<uint32_t> producer_waiting;
+    uint64_t capacity;
+};
+
+/*
+    | HEADER | DATA | MEMORY FD | EVENT FD |
+    |________|______|___________|__________|
+
+    One ring per subscriber, the single producer is the server and the
+    single consumer is the subscriber.
+*/
+struct Shared_Ring {
+    struct Ring_Header *header;
+    char *data;
+    size_t mapped_size;
+    int memory_fd;
+    int event_fd;
+};
+
+/**
+ * @brief Creates the shared memory (memfd) and the eventfd of a new ring.
+ */
+bool create_ring(struct Shared_Ring* ring, size_t capacity);
+
+/**
+ * @brief Maps the ring created by the server from its descriptors.
+ */
+bool attach_ring(struct Shared_Ring* ring, int memory_fd, int event_fd);
+
+/**
+ * @brief Unmaps the ring and closes its descriptors.
+ */
+void destroy_ring(struct Shared_Ring* ring);
+
+/**
+ * @brief Writes a frame in the ring and signals the subscriber if it
+ * sleeps. While the ring is full the server waits for the subscriber,
+ * as send does for a full socket; <socket_fd> is checked so that a
+ * subscriber that left does not block the server. Only used outside the
+ * event loop, which calls ring_try_write.
+ * 
+ * @return false - the subscriber left or the frame does not fit
+ */
+bool ring_write_frame(struct Shared_Ring* ring, int operation,
+                      const char *body, int size, int socket_fd,
+                      uint64_t sequence = 0);
+
+/**
+ * @brief Writes the parts (header and body) as one frame if the ring has
+ * space for the whole frame, without waiting.
+ * 
+ * @return false - the ring is too full for the frame now
+ */
+bool ring_try_write(struct Shared_Ring* ring, const struct iovec *parts, int count);
+
+/**
+ * @brief Bytes the producer may write in the ring now.
+ */
+uint64_t ring_free_space(struct Shared_Ring* ring);
+
+/**
+ * @brief Reads the next frame from the ring.
+ * 
+ * @return false - the ring is empty
+ */
+bool ring_read_frame(struct Shared_Ring* ring, struct Send_Header *header,
+                     vector<char> &body);
+
+/**
+ * @brief Called by the subscriber before it sleeps: announces that it
+ * waits and returns false if frames arrived in the meantime.
+ */
+bool ring_prepare_wait(struct Shared_Ring* ring);
+
+/**
+ * @brief Consumes the signal of the eventfd after waking up.
+ */
+void ring_finish_wait(struct Shared_Ring* ring);
+
+#endif
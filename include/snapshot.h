@@ -0,0 +1,143 @@
+/**
+ * @file snapshot.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the snapshot and change journal of the Database
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include "helpers.h"
+#include "database.h"
+
+using namespace std;
+
+/*
+    Snapshot file
+
+    | MAGIC | EPOCH | SUBSCRIBERS | TOPICS | TOPIC ... | SUBSCRIBER ... | LOGS | LOG ... |
+    |_______|_______|_____________|________|___________|________________|______|_________|
+
+    <epoch>     = epoch of the journal that continues the snapshot (0 in
+    |             the state sent at a handover)
+
+    Topic:
+    | NAME | NUMBER OF SUBSCRIBERS |
+    |______|_______________________|
+
+    Subscriber:
+    | ID | SUBSCRIPTIONS <topic index, SF> ... | QUEUE <post> ... |
+    |____|____________________________________|__________________|
+
+    Post (see Stored_Post, the text is made when it is delivered):
+    | VALUE | SEQUENCE | TOPIC | QUEUED AT | ADDRESS | PORT | TYPE |
+    |_______|__________|_______|___________|_________|______|______|
+
+    Log (sequence numbers of a topic, the retained posts are not saved):
+    | TOPIC | RESERVED SEQUENCE |
+    |_______|___________________|
+
+    Strings are stored as <length, bytes> and numbers in host order,
+    the file is only meant to be loaded back on the same machine.
+
+    Journal file (<snapshot>.journal)
+
+    | TYPE | ID | ARGUMENTS |  ...
+    |______|____|___________|
+
+    (JOURNAL_SEQUENCE records have the topic instead of the ID, the
+    JOURNAL_EPOCH record an empty ID)
+
+    Every change of the Database after the last snapshot is appended
+    to the journal, so a periodic snapshot only needs to flush the new
+    records. The journal is compacted in a full snapshot once it grows
+    larger than the snapshot itself and on exit.
+
+    The journal starts with a JOURNAL_EPOCH record and is only replayed
+    on the snapshot with the same epoch. A snapshot takes a new epoch and
+    the journal is emptied after the snapshot is renamed in place: if the
+    server dies in between, the old journal no longer matches and its
+    records, already in the snapshot, are not applied twice.
+*/
+#define SNAPSHOT_MAGIC          "TUSNAP05"
+#define SNAPSHOT_MAGIC_LEN      8
+
+#define JOURNAL_CLIENT          1
+#define JOURNAL_SUBSCRIBE       2
+#define JOURNAL_UNSUBSCRIBE     3
+#define JOURNAL_ENQUEUE         4
+#define JOURNAL_DRAIN           5
+#define JOURNAL_SEQUENCE        6
+#define JOURNAL_EPOCH           7
+
+struct Journal {
+    int fd;
+    vector<char> pending;
+    size_t size;
+    size_t snapshot_size;
+    uint64_t epoch;
+};
+
+/**
+ * @brief Appends the records for the changes of the Database in
+ * the pending buffer of the journal. A NULL journal is ignored.
+ */
+void journal_client(struct Journal* journal, const char *ID);
+void journal_subscribe(struct Journal* journal, const char *ID,
+                       const string &topic, bool SF);
+void journal_unsubscribe(struct Journal* journal, const char *ID,
+                         const string &topic);
+void journal_enqueue(struct Journal* journal, const char *ID,
+                     const struct Stored_Post *post);
+void journal_drain(struct Journal* journal, const char *ID);
+void journal_sequence(struct Journal* journal, const string &topic,
+                      uint64_t reserved);
+
+/**
+ * @brief Writes the pending records at the end of the journal file.
+ */
+bool journal_flush(struct Journal* journal);
+
+/**
+ * @brief Appends the subscribers, subscriptions and SF queues of the
+ * <database> to the <buffer>.
+ */
+void serialize_database(struct Database* database, vector<char> &buffer,
+                        uint64_t epoch = 0);
+
+/**
+ * @brief Restores the subscribers from a serialized buffer. All the
+ * restored clients are offline until they log in again.
+ */
+bool deserialize_database(struct Database* database, const char *data, size_t size,
+                          uint64_t *epoch = NULL);
+
+/**
+ * @brief Writes a full snapshot to <path> (through a temporary file and
+ * rename) and empties the journal.
+ */
+bool save_snapshot(struct Database* database, const char *path);
+
+/**
+ * @brief Opens the journal of the snapshot at <path> for appending.
+ */
+void open_journal(struct Journal* journal, const char *path);
+
+/**
+ * @brief Loads the snapshot at <path> (mapped in memory), replays its
+ * journal and opens the <journal> for the next changes of the <database>.
+ */
+bool load_snapshot(struct Database* database, struct Journal* journal,
+                   const char *path);
+
+/**
+ * @brief Periodic snapshot: flushes the journal and compacts it in a full
+ * snapshot only when it grew larger than the last snapshot.
+ */
+bool checkpoint_snapshot(struct Database* database, const char *path);
+
+#endif
@@ -0,0 +1,177 @@
+/**
+ * @file stored_post.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the compact forms of the posts kept by the server
+ * (SF queues and retained logs), formatted only when they are delivered
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#ifndef _STORED_POST_H
+#define _STORED_POST_H
+
+#include "helpers.h"
+#include "constants.h"
+#include "post.h"
+#include <deque>
+#include <string>
+
+using namespace std;
+
+/*
+    Post in an SF queue
+
+    | TOPIC | SEQUENCE | INGRESS | QUEUED AT | SOURCE | OPERATION | TYPE | VALUE |
+    |_______|__________|_________|___________|________|___________|______|_______|
+
+    <topic>     = interned name: the key of the log of the topic, which is
+    |             never removed (see intern_topic)
+    <sequence>  = position of the post in its topic, so that a resuming
+    |             client does not receive it twice
+    <ingress_ns> = receive time of the UDP datagram, for the latency of
+    |             the delivery from the queue (0 if unknown, e.g. restored
+    |             posts)
+    <queued_at> = time at which the post was queued, for its maximum age
+    <address>, <port> = source of the datagram (network order), the
+    |             IP:PORT of the text
+    <operation> = SUBSCRIPTION_SEND, or EVICTED_POST for a post evicted by
+    |             the retention policy, which keeps its place in the queue
+    |             until it reaches the front
+    <data_type>, <value> = the payload as received (5 bytes for an INT, 2
+    |             for a SHORT_REAL, 6 for a FLOAT, the text of a STRING),
+    |             so the numbers fit in the string itself
+
+    The text sent to the client is made again from these fields when the
+    post is delivered, exactly as for a live post.
+*/
+struct Stored_Post {
+    const string *topic;
+    uint64_t sequence;
+    uint64_t ingress_ns;
+    time_t queued_at;
+    uint32_t address;
+    uint16_t port;
+    uint8_t operation;
+    uint8_t data_type;
+    string value;
+};
+
+/*
+    Retained posts of a topic (consecutive sequences)
+
+    | BLOCKS | FIRST | COUNT |
+    |________|_______|_______|
+
+    <first>     = sequence of the first post of the first block
+    <count>     = posts in the blocks
+
+    The posts are appended to blocks of at most LOG_BLOCK_LEN records;
+    the first block is dropped once the others hold RETENTION_LEN posts.
+
+    Record of a block
+
+    | FLAGS & TYPE | ADDRESS | PORT | VALUE |
+    |______________|_________|______|_______|
+
+    <flags>     = LOG_SAME_SOURCE - the source of the previous record,
+    |             the address and the port are left out
+    <value>     = the numbers are varints of the difference to the
+    |             previous number of the same type in the block (zigzag):
+    |                 INT         - the signed value
+    |                 SHORT_REAL  - the value * 100
+    |                 FLOAT       - the value * 10^power * 2 + sign,
+    |                               followed by the power byte
+    |             a STRING is its length (varint) and its bytes.
+    |             An INT of a counter or a sensor costs 2-3 bytes.
+*/
+#define LOG_SAME_SOURCE         0x80
+#define LOG_NUMERIC_TYPES       3
+
+struct Log_Block {
+    string records;
+    uint32_t count = 0;
+    int64_t previous[LOG_NUMERIC_TYPES] = {0, 0, 0};
+    uint32_t address = 0;
+    uint16_t port = 0;
+};
+
+struct Post_Log {
+    deque<struct Log_Block> blocks;
+    uint64_t first = 0;
+    uint64_t count = 0;
+};
+
+/*
+    Position in a log, with the state needed to decode the next record
+
+    <sequence>  = sequence of the next post
+    <source>, <post> = the last post read, as it was received (the topic
+    |             is set by seek_log)
+*/
+struct Log_Cursor {
+    const struct Post_Log *log;
+    size_t block;
+    size_t offset;
+    uint32_t left;
+    uint64_t sequence;
+    int64_t previous[LOG_NUMERIC_TYPES];
+    struct sockaddr_in source;
+    struct Subscription_Post post;
+};
+
+/**
+ * @brief Fills the stored form of a post received from <source>.
+ */
+void store_post(struct Stored_Post* stored, const string *topic,
+                const struct Subscription_Post* post, struct sockaddr_in source,
+                uint64_t sequence, uint64_t ingress_ns, time_t queued_at);
+
+/**
+ * @brief Memory taken by a stored post (the string of a long STRING).
+ */
+uint64_t stored_post_bytes(const struct Stored_Post* stored);
+
+/**
+ * @brief Makes the text of a stored post (see receive_post).
+ */
+void format_stored_post(const struct Stored_Post* stored, struct Send_Post* transform);
+
+/**
+ * @brief Makes the text of a post received from <source>.
+ */
+void format_post(struct Subscription_Post* post, struct sockaddr_in source,
+                 struct Send_Post* transform);
+
+/**
+ * @brief Appends the post with the next <sequence> of the topic to its
+ * log and drops the oldest block when it is no longer needed.
+ */
+void log_post(struct Post_Log* log, uint64_t sequence, const struct Subscription_Post* post,
+              struct sockaddr_in source);
+
+/**
+ * @brief Positions the <cursor> on the first post of the log with a
+ * sequence at least <sequence>.
+ *
+ * @param topic - topic of the log (copied in the posts read)
+ */
+void seek_log(const struct Post_Log* log, const string &topic, uint64_t sequence,
+              struct Log_Cursor* cursor);
+
+/**
+ * @brief Reads the post at the cursor in <cursor>->post and
+ * <cursor>->source, then advances.
+ *
+ * @param sequence - result, sequence of the post
+ * @return false - end of the log
+ */
+bool next_logged(struct Log_Cursor* cursor, uint64_t *sequence);
+
+/**
+ * @brief Memory taken by the blocks of a log.
+ */
+uint64_t log_bytes(const struct Post_Log* log);
+
+#endif
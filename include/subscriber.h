@@ -16,7 +16,8 @@
 #define IP_MAX_LEN 32
 
 #include "helpers.h"
-#include <queue>
+#include "stored_post.h"
+#include <deque>
 
 using namespace std;
 
@@ -31,18 +32,44 @@ using namespace std;
     <queue>     = queue of Posts received from
     |             the UDP clients of the subscription
     |             topics whenever the online tag is set
-    |             to offline
+    |             to offline (compact form, see stored_post.h)
     <subscriptions> = map of subscriptio type - bool
     |                 true/false depending on the
     |                 SF character received
+    <batch_frames>  = the client asked for batch frames (ID_BATCH_FLAG)
+    |                 on its current connection
+    <multicast>     = the client takes the multicast topics from the
+    |                 group (ID_MULTICAST_FLAG, see multicast.h)
+    <heartbeats>    = the client answers the heartbeats (ID_HEARTBEAT_FLAG)
+    |                 on its current connection
+    <SF_first>      = number of the post at the front of the queue (the
+    |                 posts are numbered as they are queued), so a post
+    |                 is found in O(1) from its number
+    <SF_topics>     = topic -> numbers of its posts still in the queue,
+    |                 oldest first, and their bytes. Only kept for the
+    |                 topics with a retention policy (see retention.h).
+    <SF_evicted>    = posts of the queue evicted by the retention, kept
+    |                 as EVICTED_POST until the queue is compacted
 
 */
+struct SF_Topic {
+    deque<uint64_t> posts;
+    uint64_t bytes = 0;
+    uint64_t timer = 0;
+};
+
 struct Subscriber {
     int socket_fd;
     char ID[ID_MAX_LEN];
     bool online;
-    queue<struct Send_Post> SF_queue;
+    deque<struct Stored_Post> SF_queue;
     unordered_map<string, bool> subscription_types;
+    bool batch_frames = false;
+    bool multicast = false;
+    bool heartbeats = false;
+    uint64_t SF_first = 0;
+    unordered_map<string, struct SF_Topic> SF_topics;
+    uint64_t SF_evicted = 0;
 };
 
 
@@ -0,0 +1,83 @@
+/**
+ * @file timer_wheel.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the hierarchical timer wheel: timers added and
+ * expired in O(1), without scanning what they refer to
+ * @version 0.1
+ * @date 2022-05-07
+ * 
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ * 
+ */
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+#include "helpers.h"
+#include "constants.h"
+#include <string>
+
+using namespace std;
+
+/*
+    Timer
+
+    | EXPIRY | ID | KEY |
+    |________|____|_____|
+
+    <expiry>    = tick at which the timer fires
+    <id>, <key> = chosen by the owner of the wheel to find what expired;
+    |             a timer cannot be cancelled, the owner ignores the
+    |             timers it no longer expects (e.g. by their id)
+*/
+struct Timer {
+    uint64_t expiry;
+    uint64_t id;
+    string key;
+};
+
+/*
+    Hierarchical timer wheel
+
+    | NOW | SLOTS [WHEEL_LEVELS][WHEEL_SLOTS] | COUNT |
+    |_____|__________________________________|_______|
+
+    <now>   = last tick reached (the unit of a tick is chosen by the owner)
+    <slots> = level L holds the timers due in less than WHEEL_SLOTS^(L+1)
+    |         ticks, in the slot given by bits [L * WHEEL_BITS, (L+1) *
+    |         WHEEL_BITS) of their expiry. When the lower levels wrap
+    |         around, the slot of the next level is moved down (cascade).
+    |         Timers further than WHEEL_SLOTS^WHEEL_LEVELS ticks wait in
+    |         the last level and are placed again when it cascades.
+    <count> = timers in the wheel
+*/
+struct Timer_Wheel {
+    uint64_t now = 0;
+    vector<struct Timer> slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    size_t count = 0;
+};
+
+/**
+ * @brief Starts the wheel at tick <now>.
+ */
+void init_timer_wheel(struct Timer_Wheel* wheel, uint64_t now);
+
+/**
+ * @brief Adds a timer firing at tick <expiry> (at the next tick if
+ * <expiry> already passed).
+ */
+void add_timer(struct Timer_Wheel* wheel, uint64_t expiry, uint64_t id, const string &key);
+
+/**
+ * @brief Moves the wheel up to tick <now>, appending the timers that
+ * fire to <expired> (in the order of their ticks).
+ */
+void advance_timers(struct Timer_Wheel* wheel, uint64_t now, vector<struct Timer> &expired);
+
+/**
+ * @brief Tick to move the wheel to next: the earliest timer of level 0,
+ * or the earliest cascade of an upper level if it comes first (the
+ * timers it moves down are due at or after it). 0 if the wheel is empty.
+ */
+uint64_t next_timer_tick(const struct Timer_Wheel* wheel);
+
+#endif
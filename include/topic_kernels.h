@@ -0,0 +1,132 @@
+/**
+ * @file topic_kernels.h
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Header for the kernels on the fixed width topics and IDs (end of
+ * the text, hash, compare), in SSE2/AVX2 with a scalar fallback chosen
+ * when the server starts
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+#ifndef _TOPIC_KERNELS_H
+#define _TOPIC_KERNELS_H
+
+#include "helpers.h"
+#include "constants.h"
+#include <string>
+
+using namespace std;
+
+/*
+    Kernels of a CPU level
+
+    <length>    = bytes before the first NUL of <text>, at most
+    |             <max_length> (then there is no NUL); only the bytes
+    |             [0, max_length) are read, so the text must be a fixed
+    |             width field (e.g. the topic of a Subscription_Post)
+    <hash>      = hash of a zero padded block, <length> is a multiple of
+    |             KERNEL_BLOCK_LEN. The result is the same at every level.
+    <equal>     = compares <length> bytes, only these bytes are read
+    <key>       = length, padding and hash at once: the text (read as for
+    |             <length>, at most TOPIC_BLOCK_LEN bytes) is copied in
+    |             <block> with zeros after its end and <block> is hashed,
+    |             without reading it back; returns the length
+
+    The hash is NH: the sum of the products of the 32 bit words of the
+    block, added by pairs to the words of a fixed key, which is made of
+    the 32 x 32 -> 64 bit multiplications of SSE2 and AVX2 (2 and 4 per
+    instruction), then mixed.
+*/
+#define KERNELS_SCALAR          0
+#define KERNELS_SSE2            1
+#define KERNELS_AVX2            2
+#define KERNEL_BLOCK_LEN        16
+#define TOPIC_BLOCK_LEN         64
+
+struct Topic_Kernels {
+    int level;
+    const char *name;
+    int (*length)(const char *text, int max_length);
+    uint64_t (*hash)(const char *block, int length);
+    bool (*equal)(const char *first, const char *second, int length);
+    int (*key)(const char *text, int max_length, char block[TOPIC_BLOCK_LEN], uint64_t *hash);
+};
+
+/*
+    Kernels in use, the best level of the CPU unless select_kernels
+    chose another one
+*/
+extern struct Topic_Kernels kernels;
+
+/*
+    Key of a topic
+
+    | TOPIC | LENGTH | HASH |
+    |_______|________|______|
+
+    <topic>     = the topic padded with '\0' up to TOPIC_BLOCK_LEN
+    <hash>      = hash of the padded topic, the same as for the topic
+    |             stored as a string in the Topic_Index
+*/
+struct Topic_Key {
+    char topic[TOPIC_BLOCK_LEN];
+    int length;
+    uint64_t hash;
+};
+
+/**
+ * @brief Uses the kernels of <level> (or the best one the CPU has, if it
+ * lacks <level>).
+ *
+ * @return the level in use
+ */
+int select_kernels(int level);
+
+/**
+ * @brief Best kernel level of the CPU.
+ */
+int best_kernel_level();
+
+/**
+ * @brief Builds the key of a fixed width topic of at most TOPIC_LEN bytes
+ * (see Subscription_Post), without copying it in a string.
+ */
+void make_topic_key(const char topic[TOPIC_LEN], struct Topic_Key* key);
+
+/**
+ * @brief Builds the key of a topic of <length> bytes (only the first
+ * TOPIC_BLOCK_LEN are hashed).
+ */
+void make_topic_key(const char *topic, int length, struct Topic_Key* key);
+
+/*
+    Hash and equality of the topic index, which also find a topic from
+    its Topic_Key (heterogeneous lookup), so a post is looked up with
+    the hash of its key and compared without making a string.
+*/
+struct Topic_Hash {
+    using is_transparent = void;
+    size_t operator()(const string &topic) const;
+    size_t operator()(const struct Topic_Key &key) const {
+        return key.hash;
+    }
+};
+
+struct Topic_Equal {
+    using is_transparent = void;
+    bool operator()(const string &first, const string &second) const {
+        return first.size() == second.size() &&
+               kernels.equal(first.data(), second.data(), first.size());
+    }
+    bool operator()(const string &first, const struct Topic_Key &second) const {
+        return (int) first.size() == second.length &&
+               kernels.equal(first.data(), second.topic, second.length);
+    }
+    bool operator()(const struct Topic_Key &first, const string &second) const {
+        return (*this)(second, first);
+    }
+};
+
+#endif
@@ -19,17 +19,80 @@
 #include "include/helpers.h"
 #include "include/database.h"
 #include "include/constants.h"
+#include "include/network.h"
+#include "include/snapshot.h"
+#include "include/server_config.h"
+#include "include/handover.h"
+#include "include/federation.h"
+#include "include/latency.h"
+#include "include/low_latency.h"
+#include "include/admission.h"
+#include "include/analytics.h"
+#include "include/event_loop.h"
+#include "include/session.h"
+#include "include/retention.h"
+#include "include/multicast.h"
+#include "include/capture.h"
+#include "include/heartbeat.h"
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
 
 using namespace std;
 
 void usage(char *file)
 {
     /*
-        ./server <PORT>
+        ./server [-s snapshot_file] [-i snapshot_interval]
+                 [-H handover_socket] [-T takeover_socket]
+                 [-P peer_IP:peer_PORT]... [-u unix_socket]
+                 [-L trace_sample_rate] [-b busy_poll_usec] [-c cpu]
+                 [-R rate[:burst]] [-Q topic=max_age[:max_count[:max_bytes]]]...
+                 [-W coalesce_usec] [-M group_IP:group_PORT [-m topic]...]
+                 [-C capture_file] [-p topic=high|normal|bulk]...
+                 [-K heartbeat_ms[:misses]] <PORT>
     */
-	fprintf(stderr, "Usage: %s server_port\n", file);
+	fprintf(stderr, "Usage: %s [-s snapshot_file] [-i snapshot_interval] "
+                    "[-H handover_socket] [-T takeover_socket] "
+                    "[-P peer_address:peer_port]... [-u unix_socket] "
+                    "[-L trace_sample_rate] [-b busy_poll_usec] [-c cpu] "
+                    "[-R rate[:burst]] [-Q topic=max_age[:max_count[:max_bytes]]]... "
+                    "[-W coalesce_usec] [-M group_address:group_port [-m topic]...] "
+                    "[-C capture_file] [-p topic=high|normal|bulk]... "
+                    "[-K heartbeat_ms[:misses]] server_port\n", file);
 	exit(0);
 }
+
+/*
+    Set by SIGINT/SIGTERM, so that the server leaves the loop
+    the same way as for the exit command.
+*/
+static volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int signal_number)
+{
+    (void) signal_number;
+    stop_requested = 1;
+}
+
+/*
+    Sends the posts of the ingest batch to the subscribers connected to
+    this server and to the peer servers having subscribers for their
+    topics, then empties the batch.
+*/
+static void publish_ingest(struct Database* database, struct Ingest_Batch* ingest,
+                           struct Analytics* analytics, struct Federation* federation)
+{
+    publish_batch(database, ingest);
+    for(int i = 0; i < ingest->count; i++) {
+        struct Ingest_Post &ingested = ingest->posts[i];
+        record_post(analytics, ingested.post.topic, &ingested.source, ingested.length,
+                    ingested.fan_out_bytes);
+        forward_post(federation, &ingested.post, ingested.length, ingested.source,
+                     ingested.ingress_ns);
+    }
+    ingest->count = 0;
+}
 /*
     Server
 
@@ -52,82 +115,392 @@ int main(int argc, char* argv[])
         Unique Database
     */
     struct Database database;
+    struct Journal journal;
+    struct Server_Config config;
 
-    int socket_fd_TCP, new_socket_fd_TCP, port_number, socket_fd_UDP;
+    int socket_fd_TCP = -1, new_socket_fd_TCP, port_number, socket_fd_UDP = -1;
     char buffer[BUFLEN];
 
     struct sockaddr_in server_address, client_address;
     int return_value;
     socklen_t socket_length = sizeof(struct sockaddr_in);
 
-    if(argc < 2) {
+    if(parse_server_arguments(argc, argv, &config) == false) {
         usage(argv[0]);
     }
     int enable = 1;
 
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(struct sigaction));
+    stop_action.sa_handler = request_stop;
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    time_t next_snapshot = time(NULL) + config.snapshot_interval;
+
     /* 
-        Create a socket for TCP.
+        Create the sets for file descriptors for multiplexing.
+        Add UDP and TCP sockets and STDIN to the set.
     */
-    socket_fd_TCP = socket(AF_INET, SOCK_STREAM, 0);
-    DIE(socket_fd_TCP < 0, "Cannot open socket file descriptor for TCP.");
+    fd_set read_fds;
+    fd_set tmp_fds;
+    FD_ZERO(&read_fds);
+    FD_ZERO(&tmp_fds);
+    FD_SET(STDIN, &read_fds);
+    int max_fds = 0;
+    vector<int> client_fds;
+    int socket_fd_unix = -1;
+
+    if(config.takeover_path != NULL) {
+        /*
+            Hot restart - continue with the sockets, the connected clients
+            and the Database of the running server.
+        */
+        DIE(take_over(config.takeover_path, &database, &socket_fd_UDP, &socket_fd_TCP,
+                      &socket_fd_unix, client_fds) == false, "Error in taking over the server.");
+        cout << "Took over " << client_fds.size() << " connected clients." << endl;
+
+        if(config.snapshot_path != NULL) {
+            open_journal(&journal, config.snapshot_path);
+            database.journal = &journal;
+            DIE(save_snapshot(&database, config.snapshot_path) == false,
+                "Error in writing the snapshot.");
+        }
+    } else {
+        /*
+            Restore the subscribers, subscriptions and SF queues saved by
+            the previous run of the server.
+        */
+        if(config.snapshot_path != NULL) {
+            DIE(load_snapshot(&database, &journal, config.snapshot_path) == false,
+                "Corrupted snapshot.");
+            cout << "Restored " << database.online.size() << " clients and "
+                 << database.subscription.size() << " topics." << endl;
+        }
+
+        /* 
+            Create a socket for TCP.
+        */
+        socket_fd_TCP = socket(AF_INET, SOCK_STREAM, 0);
+        DIE(socket_fd_TCP < 0, "Cannot open socket file descriptor for TCP.");
+
+        DIE(setsockopt(socket_fd_TCP, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0, "Error in neagle");
+
+        int neagle = 1;
+        return_value = setsockopt(socket_fd_TCP, IPPROTO_TCP, TCP_NODELAY, &neagle, sizeof(int));
+        DIE(return_value < 0, "Error in neagle");
+
+        /*
+            Create a socket for UDP 
+        */
+        socket_fd_UDP = socket(AF_INET, SOCK_DGRAM, 0);
+        DIE(socket_fd_UDP < 0, "Cannot open socket file descriptor for UDP.");
+
+        /*
+            Obtain the address and the socket for the server
+        */
+        port_number = config.port;
+
+        memset((char *) &server_address, 0, sizeof(server_address));
+        server_address.sin_family       = AF_INET;
+        server_address.sin_port         = htons((uint16_t)port_number);
+        server_address.sin_addr.s_addr  = INADDR_ANY;
+
+        /*
+            Connect the sockets for UDP and TCP to server's address
+        */
+        return_value = bind(socket_fd_TCP, (struct sockaddr *) &server_address, sizeof(struct sockaddr));
+        DIE(return_value < 0, "Error in binding TCP socket.");
 
-    DIE(setsockopt(socket_fd_TCP, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0, "Error in neagle");
+        return_value = listen(socket_fd_TCP, 5);
+        DIE(return_value < 0, "Error in listen process.");
 
-    int neagle = 1;
-    return_value = setsockopt(socket_fd_TCP, IPPROTO_TCP, TCP_NODELAY, &neagle, sizeof(int));
-    DIE(return_value < 0, "Error in neagle");
+        return_value = bind(socket_fd_UDP, (struct sockaddr *)&server_address, sizeof(server_address));
+        DIE(return_value == -1, "Error in binding UDP socket.");
+    }
+
+    FD_SET(socket_fd_TCP, &read_fds);
+    FD_SET(socket_fd_UDP, &read_fds);
+    max_fds = max(max_fds, max(socket_fd_TCP, socket_fd_UDP));
 
     /*
-        Create a socket for UDP 
+        Servers of the mesh. The port announced to them is the one of
+        the TCP listener (also when it was taken over).
     */
-    socket_fd_UDP = socket(AF_INET, SOCK_DGRAM, 0);
-    DIE(socket_fd_UDP < 0, "Cannot open socket file descriptor for UDP.");
+    struct Federation federation;
+    struct sockaddr_in listener_address;
+    socklen_t listener_length = sizeof(struct sockaddr_in);
+    getsockname(socket_fd_TCP, (struct sockaddr *) &listener_address, &listener_length);
+    init_federation(&federation, ntohs(listener_address.sin_port), config.peers);
+    database.federation = &federation;
 
     /*
-        Obtain the address and the socket for the server
+        Latency of the deliveries, from the kernel receive time of the
+        datagrams (also for the UDP socket taken over)
     */
-    port_number = atoi(argv[1]);
-    DIE(port_number == 0, "Error in parsing port number.");
+    struct Latency_Tracer tracer;
+    if(config.trace_sample_rate != 0) {
+        init_tracer(&tracer, config.trace_sample_rate);
+        database.tracer = &tracer;
+        if(enable_rx_timestamps(socket_fd_UDP) == false) {
+            cerr << "No kernel timestamps, using the time of the reads." << endl;
+        }
+    }
 
-    memset((char *) &server_address, 0, sizeof(server_address));
-    server_address.sin_family       = AF_INET;
-    server_address.sin_port         = htons((uint16_t)port_number);
-    server_address.sin_addr.s_addr  = INADDR_ANY;
+    /*
+        Retention policies of the SF queues, also applied to the queues
+        restored from the snapshot or taken over
+    */
+    struct Retention retention;
+    if(!config.retention.empty()) {
+        for(auto &policy : config.retention) {
+            set_retention_policy(&retention, policy.first, &policy.second);
+        }
+        database.retention = &retention;
+        retain_all(&database);
+    }
 
     /*
-        Connect the sockets for UDP and TCP to server's address
+        Topics published once to a multicast group
     */
-    return_value = bind(socket_fd_TCP, (struct sockaddr *) &server_address, sizeof(struct sockaddr));
-    DIE(return_value < 0, "Error in binding TCP socket.");
+    struct Multicast multicast;
+    if(config.multicast_group != NULL) {
+        DIE(open_multicast(&multicast, config.multicast_group, config.multicast_topics) == false,
+            "Error in opening the multicast group.");
+        database.multicast = &multicast;
+    }
 
-    return_value = listen(socket_fd_TCP, 5);
-    DIE(return_value < 0, "Error in listen process.");
+    /*
+        Validation of the datagrams and rate of each UDP source
+    */
+    struct Admission admission;
+    init_admission(&admission, config.source_rate, config.source_burst);
 
-    return_value = bind(socket_fd_UDP, (struct sockaddr *)&server_address, sizeof(server_address));
-    DIE(return_value == -1, "Error in binding UDP socket.");
+    /*
+        Heaviest topics and sources (constant memory)
+    */
+    struct Analytics analytics;
+    init_analytics(&analytics);
 
-    /* 
-        Create the sets for file descriptors for multiplexing.
-        Add UDP and TCP sockets and STDIN to the set.
+    /*
+        Posts read from the UDP socket at once, published together
     */
-    fd_set read_fds;
-    fd_set tmp_fds;
-    FD_ZERO(&read_fds);
-    FD_ZERO(&tmp_fds);
-    FD_SET(STDIN, &read_fds);
-    FD_SET(socket_fd_TCP, &read_fds);
-    FD_SET(socket_fd_UDP, &read_fds);
-    int max_fds;
-    max_fds = max(socket_fd_TCP, socket_fd_UDP);
+    struct Ingest_Batch ingest;
+
+    /*
+        Capture of the received datagrams, with their kernel receive
+        times, for the replay tool
+    */
+    struct Capture capture;
+    if(config.capture_path != NULL) {
+        DIE(open_capture(&capture, config.capture_path) == false,
+            "Error in opening the capture file.");
+        if(database.tracer == NULL && enable_rx_timestamps(socket_fd_UDP) == false) {
+            cerr << "No kernel timestamps, using the time of the reads." << endl;
+        }
+    }
+
+    /*
+        Busy-poll mode, pinning and locking, once every buffer of the
+        setup is allocated
+    */
+    enter_low_latency_mode(&config, socket_fd_UDP);
+
+    /*
+        Every client connection is a coroutine resumed by the loop; the
+        frames for the clients are queued in the loop, never blocking it.
+        The clients taken over continue with their commands.
+    */
+    struct Event_Loop loop;
+    loop.coalesce_ns = (uint64_t) config.coalesce_usec * 1000;
+    loop.tracer      = database.tracer;
+    database.loop = &loop;
+    federation.loop = &loop;
+    for(auto &priority : config.priorities) {
+        database.priorities[priority.first] = priority.second;
+    }
+
+    /*
+        Heartbeats of the clients, which also watch the clients taken over
+    */
+    struct Heartbeat heartbeat;
+    if(config.heartbeat_ms != 0) {
+        init_heartbeat(&heartbeat, config.heartbeat_ms, config.heartbeat_misses);
+        database.heartbeat = &heartbeat;
+    }
+    struct Session_Context clients = {&loop, &database, &federation};
+    struct Session_Context local_clients = {&loop, &database, NULL};
+    for(auto &connection : database.connections) {
+        if(connection.second.transport == TRANSPORT_SHM) {
+            loop.rings[connection.first] = &connection.second.ring;
+        }
+    }
+    for(int client_fd : client_fds) {
+        client_commands(&clients, client_fd);
+    }
+
+    /*
+        Unix socket for the clients on the same host (the one taken over
+        is kept, the local clients keep connecting to it)
+    */
+    if(socket_fd_unix < 0 && config.unix_path != NULL) {
+        socket_fd_unix = open_unix_listener(config.unix_path, MAX_CLIENTS);
+    }
+    if(socket_fd_unix >= 0) {
+        FD_SET(socket_fd_unix, &read_fds);
+        max_fds = max(max_fds, socket_fd_unix);
+    }
+
+    /*
+        Unix socket on which the next server can take over this one. The
+        connection of the new server waits in <handover_channel> until
+        no client is in the middle of a frame, at most until
+        <handover_deadline>.
+    */
+    int socket_fd_handover = -1;
+    int handover_channel = -1;
+    uint64_t handover_deadline = 0;
+    bool handed_over = false;
+    if(config.handover_path != NULL) {
+        socket_fd_handover = open_unix_listener(config.handover_path, 1);
+        FD_SET(socket_fd_handover, &read_fds);
+        max_fds = max(max_fds, socket_fd_handover);
+    }
 
     while(1) {
+        /*
+            Multiplexing process
+        */
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
         tmp_fds = read_fds;
+        int select_max = max_fds;
+        time_t next_retry = connect_peers(&federation, &database, &write_fds, &select_max);
+        flush_peers(&federation, &write_fds, &select_max);
+        bool backlogged = schedule_output(&loop);
+        watch_events(&loop, &tmp_fds, &write_fds, &select_max);
+
+        time_t wakeup = next_retry;
+        if(config.snapshot_path != NULL && (wakeup == 0 || next_snapshot < wakeup)) {
+            wakeup = next_snapshot;
+        }
+        if(database.retention != NULL && retention.wheel.count != 0 &&
+           (wakeup == 0 || time(NULL) + 1 < wakeup)) {
+            wakeup = time(NULL) + 1;
+        }
+
+        struct timeval timeout;
+        struct timeval *select_timeout = NULL;
+        if(config.busy_poll_usec > 0) {
+            /*
+                Busy-poll mode - only check the descriptors, never sleep
+            */
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = 0;
+            select_timeout  = &timeout;
+        } else if(wakeup != 0) {
+            time_t now = time(NULL);
+            timeout.tv_sec  = (wakeup > now) ? wakeup - now : 0;
+            timeout.tv_usec = 0;
+            select_timeout  = &timeout;
+        }
 
         /*
-            Multiplexing process
+            The batches waiting for their deadline (at most BATCH_DELAY_NS)
+        */
+        uint64_t batch_deadline = next_batch_deadline(&database);
+        if(batch_deadline != 0 && config.busy_poll_usec == 0) {
+            uint64_t now = now_ns();
+            uint64_t wait_usec = (batch_deadline > now) ? (batch_deadline - now) / 1000 + 1 : 0;
+            if(select_timeout == NULL ||
+               (uint64_t) timeout.tv_sec * 1000000 + timeout.tv_usec > wait_usec) {
+                timeout.tv_sec  = wait_usec / 1000000;
+                timeout.tv_usec = wait_usec % 1000000;
+                select_timeout  = &timeout;
+            }
+        }
+
+        /*
+            The next tick of the heartbeats
+        */
+        int64_t heartbeat_wait = heartbeat_timeout(&database);
+        if(heartbeat_wait >= 0 && config.busy_poll_usec == 0 &&
+           (select_timeout == NULL ||
+            (uint64_t) timeout.tv_sec * 1000000 + timeout.tv_usec > (uint64_t) heartbeat_wait)) {
+            timeout.tv_sec  = heartbeat_wait / 1000000;
+            timeout.tv_usec = heartbeat_wait % 1000000;
+            select_timeout  = &timeout;
+        }
+
+        /*
+            Frames held for coalescing: only check for new events, the
+            frames are sent as soon as there is none. The same when the
+            scheduler left frames it could move now.
+        */
+        if(!loop.held.empty() || backlogged) {
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = 0;
+            select_timeout  = &timeout;
+        }
+
+        /*
+            Frames waiting for space in a shared memory ring: the tail
+            of the ring is checked again after RING_RETRY_NS
+        */
+        if(rings_backlogged(&loop) &&
+           (select_timeout == NULL ||
+            (uint64_t) timeout.tv_sec * 1000000 + timeout.tv_usec > RING_RETRY_NS / 1000)) {
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = RING_RETRY_NS / 1000;
+            select_timeout  = &timeout;
+        }
+
+        /*
+            A handover waiting for the frames being received
+        */
+        if(handover_channel >= 0) {
+            uint64_t now = now_ns();
+            uint64_t wait_usec = (handover_deadline > now) ?
+                                 (handover_deadline - now) / 1000 + 1 : 0;
+            if(select_timeout == NULL ||
+               (uint64_t) timeout.tv_sec * 1000000 + timeout.tv_usec > wait_usec) {
+                timeout.tv_sec  = wait_usec / 1000000;
+                timeout.tv_usec = wait_usec % 1000000;
+                select_timeout  = &timeout;
+            }
+        }
+
+        return_value = select(select_max + 1, &tmp_fds, &write_fds, NULL, select_timeout);
+        if(return_value < 0 && errno == EINTR) {
+            FD_ZERO(&tmp_fds);
+            FD_ZERO(&write_fds);
+        } else {
+            DIE(return_value < 0, "Error in select process.");
+        }
+
+        if(stop_requested) {
+            break;
+        }
+
+        decay_analytics(&analytics, time(NULL));
+        expire_posts(&database, time(NULL));
+        check_heartbeats(&database);
+        if(!database.batches.empty()) {
+            flush_batches(&database, now_ns());
+        }
+        if(!loop.held.empty()) {
+            flush_held(&loop, (return_value == 0) ? UINT64_MAX : now_ns());
+        }
+
+        /*
+            Periodic snapshot
         */
-        return_value = select(max_fds + 1, &tmp_fds, NULL, NULL, NULL);
-        DIE(return_value < 0, "Error in select process.");
+        if(config.snapshot_path != NULL && time(NULL) >= next_snapshot) {
+            if(checkpoint_snapshot(&database, config.snapshot_path) == false) {
+                cerr << "Error in writing the snapshot." << endl;
+            }
+            next_snapshot = time(NULL) + config.snapshot_interval;
+        }
 
         memset(buffer, 0, BUFLEN);
 
@@ -154,30 +527,79 @@ int main(int argc, char* argv[])
                struct Send_Header header;
                header.operation = EXIT_CODE;
                header.size = strlen(aux) + 1;
+               header.sequence = 0;
 
                 /*
-                    Send the exit-request packet to all connected
-                    users and close sockets.
+                    Send the queued frames, then the exit-request packet to
+                    all connected users and close sockets.
                 */
+                flush_batches(&database, UINT64_MAX);
+                drain_output(&loop);
                 for(auto user_data : database.locations) {
                     struct Subscriber user = user_data.second;
                     if(user.online == true) {
+                        /*
+                            A client shut down by drain_output cannot receive it
+                        */
                         return_value = send(user.socket_fd, &header, sizeof(struct Send_Header), 0);
-                        DIE(return_value < 0, "Error in sending header");
-
-                        return_value = send(user.socket_fd, aux, header.size, 0);
-                        DIE(return_value < 0, "Error in sending message");
+                        if(return_value >= 0) {
+                            send(user.socket_fd, aux, header.size, 0);
+                        }
                         close(user.socket_fd);                
                     }
                 }
                 break;
+            } else if(strcmp(buffer, STATS_REQUEST) == 0) {
+                cout << "Forwarded " << federation.forwarded << " posts, received "
+                     << federation.received << " from peers ("
+                     << federation.malformed << " malformed dropped)." << endl;
+                print_admission_stats(&admission);
+                print_analytics(&analytics);
+                print_retention_stats(database.retention);
+                print_output_stats(&loop);
+                print_multicast_stats(database.multicast);
+                print_capture_stats(&capture);
+                print_heartbeat_stats(database.heartbeat);
+                if(database.tracer != NULL) {
+                    print_latency_stats(database.tracer);
+                }
+            } else if(strncmp(buffer, DUMP_TRACE_REQUEST " ", strlen(DUMP_TRACE_REQUEST) + 1) == 0) {
+                /*
+                    dump_trace <file>
+                */
+                char *path = buffer + strlen(DUMP_TRACE_REQUEST) + 1;
+                path[strcspn(path, "\n")] = '\0';
+                if(database.tracer == NULL || dump_trace(database.tracer, path) == false) {
+                    cerr << "Cannot write the trace (enable it with -L)." << endl;
+                }
             }
         }
 
+        /*
+            Resume the coroutines of the clients whose sockets are ready
+            and send the queued frames the sockets accept
+        */
+        resume_ready(&loop, &tmp_fds, &write_fds);
+
         for (int i = 1; i <= max_fds; i ++) {
             /* UDP - Receive message */
             if(FD_ISSET(i, &tmp_fds)) {
-                if(i == socket_fd_UDP) {
+                if(i == socket_fd_handover) {
+                    /*
+                        A new server wants to take over (one at a time); it
+                        is handed over at the end of an iteration
+                    */
+                    int channel_fd = accept(socket_fd_handover, NULL, NULL);
+                    if(channel_fd < 0) {
+                        continue;
+                    }
+                    if(handover_channel >= 0) {
+                        close(channel_fd);
+                        continue;
+                    }
+                    handover_channel  = channel_fd;
+                    handover_deadline = now_ns() + HANDOVER_WAIT_NS;
+                } else if(i == socket_fd_UDP) {
                     /*
                         If the socket for UDP is set, then a new subscription packet is received.
 
@@ -193,123 +615,131 @@ int main(int argc, char* argv[])
                         the corresponding code for UDP (See: Constants)
                     */
 
-                    struct Subscription_Post *new_post = (Subscription_Post *)malloc(sizeof(struct Subscription_Post));
-                    new_post->content[0] = '\0';
-                    memset(new_post, 0, sizeof(struct Subscription_Post));
-                    
-                    struct Send_Post *transform = (Send_Post *)malloc(sizeof(struct Send_Post));
-                    memset(transform, 0, sizeof(struct Send_Post));
-                    transform->operation = SUBSCRIPTION_SEND;
-                    transform->content[0] = '\0';
-
-                    return_value = recvfrom(socket_fd_UDP, new_post, sizeof(struct Subscription_Post), 0, (struct sockaddr *) &server_address, &socket_length);
-
-                    char UDP_IP[IP_LEN];
-                    inet_ntop(AF_INET, &(server_address.sin_addr), UDP_IP, IP_LEN);
-
-                    DIE(return_value < 0, "error");
-                    receive_post (new_post, transform, UDP_IP, server_address);
-
                     /*
-                        Send the packet to all connected users in the databse subscribed to the received topic.
-                        For the disconnected users, store the post in their local queue of posts, that will be
-                        emptied once they restore thei connection.
+                        The queued datagrams are read without blocking, up to the
+                        budget (BUSY_POLL_BUDGET in busy-poll mode, which never
+                        sleeps in select), and published in batches of
+                        INGEST_BATCH_LEN: the subscribers of a topic are walked
+                        once per batch.
                     */
-                    for(auto user_data : database.subscription[new_post->topic]) {
-                        auto test = database.online.find(user_data.ID);
-                        if(test->second.online == true) {
-                            struct Send_Header header;
-                            header.operation = SUBSCRIPTION_SEND;
-                            header.size = strlen(transform->content) + 1;
-
-                            return_value = send(test->second.socket_fd, &header, sizeof(struct Send_Header), 0);
-                            DIE(return_value < 0, "Error in sending header.");
-
-                            return_value = send(test->second.socket_fd, transform->content, header.size, 0);
-                            DIE(return_value < 0, "Error in sending mssage.");
-
-                        } else if (test->second.online == false && test->second.subscription_types[new_post->topic] == true) {
-                            (test->second).SF_queue.push(*transform);
-                        }      
+                    int budget = (config.busy_poll_usec > 0) ? BUSY_POLL_BUDGET : INGEST_BATCH_LEN;
+                    ingest.count = 0;
+                    for(int datagram = 0; datagram < budget; datagram++) {
+                        struct Ingest_Post &ingested = ingest.posts[ingest.count];
+                        struct Subscription_Post &new_post = ingested.post;
+                        memset(&new_post, 0, sizeof(struct Subscription_Post));
+
+                        uint64_t ingress_ns = 0;
+                        if(database.tracer != NULL || capture.file != NULL) {
+                            return_value = recv_timestamped(socket_fd_UDP, &new_post, sizeof(struct Subscription_Post), &server_address, &ingress_ns, MSG_DONTWAIT);
+                        } else {
+                            return_value = recvfrom(socket_fd_UDP, &new_post, sizeof(struct Subscription_Post), MSG_DONTWAIT, (struct sockaddr *) &server_address, &socket_length);
+                        }
+                        if(return_value < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                            break;
+                        }
+                        DIE(return_value < 0, "error");
+                        capture_datagram(&capture, &new_post, return_value, &server_address, ingress_ns);
+
+                        /*
+                            Drop malformed datagrams and sources above their
+                            rate before decoding the post
+                        */
+                        if(valid_datagram(&new_post, return_value) == false) {
+                            admission.malformed ++;
+                            continue;
+                        }
+                        if(admit_datagram(&admission, &server_address) == false) {
+                            continue;
+                        }
+
+                        ingested.source     = server_address;
+                        ingested.ingress_ns = ingress_ns;
+                        ingested.length     = return_value;
+                        if(++ ingest.count == INGEST_BATCH_LEN) {
+                            publish_ingest(&database, &ingest, &analytics, &federation);
+                        }
                     }
+                    publish_ingest(&database, &ingest, &analytics, &federation);
+                } else if(i == socket_fd_unix) {
+                    /*
+                        Unix - Receive new client on the same host. The client may ask
+                        for a shared memory ring instead of receiving on the socket.
+                    */
+                    new_socket_fd_TCP = accept(socket_fd_unix, NULL, NULL);
+                    DIE(new_socket_fd_TCP < 0, "Accept error in receiving Unix.");
+
+                    struct sockaddr_in local_address;
+                    memset(&local_address, 0, sizeof(struct sockaddr_in));
+                    local_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+                    client_session(&local_clients, new_socket_fd_TCP, local_address);
                 } else if(i == socket_fd_TCP) {
                     /*
                         TCP - Receive new client on the TCP socket of the server
 
-                        First add the client in the Database and distinguish 3 main cases:
-                        1. The user is a new user, in which case we add the socket to the set of file descriptors
+                        The coroutine of the connection receives the ID without
+                        blocking the server and distinguishes 3 main cases:
+                        1. The user is a new user, in which case it is added to the Database
                         2. The user reconnects, in which case we set its -online- parameter to true
                         3. The user is already connected in the Database, in which case we send an ID_IN_USE packet
                         error.
-                    
+                        Another server of the mesh opens its link with a PEER_HELLO
+                        frame instead of an ID.
                     */
 
                     new_socket_fd_TCP = accept(socket_fd_TCP, (struct sockaddr *) &client_address, (socklen_t *) &socket_length);
                     DIE(new_socket_fd_TCP < 0, "Accept error in receiving TCP.");
                     int neagle3 = 1;
-                    setsockopt(socket_fd_TCP, IPPROTO_TCP, TCP_NODELAY, &neagle3, sizeof(int));
+                    setsockopt(new_socket_fd_TCP, IPPROTO_TCP, TCP_NODELAY, &neagle3, sizeof(int));
 
-                    if(add_new_client(new_socket_fd_TCP, client_address, &database) == true) {
-                        FD_SET(new_socket_fd_TCP, &read_fds);
-                        if(new_socket_fd_TCP > max_fds) {
-                            max_fds = new_socket_fd_TCP;
-                        }
-                    } else {
-                        /* (3) */
-                        struct Send_Header header;
-                        header.operation = ID_IN_USE_CODE;
-                        char aux[BUFLEN];
-                        strcpy(aux, ID_IN_USE);
-                        header.size = strlen(aux) + 1;
-
-                        return_value = send(new_socket_fd_TCP, &header, sizeof(struct Send_Header), 0);
-                        return_value = send(new_socket_fd_TCP, aux, header.size, 0);
-
-                        close(new_socket_fd_TCP);
-                    }
-                } else {
-                    /*
-                        Receive new message on one of the sockets of the clients. Distinguish 3 cases:
-                        1. The client disconnected, in which case we set the -online- tag to false
-                        in both maps and clear the socket from the sets of sockets.
-                        2. The client sends a Subscribe request
-                        3. The client sends an Unsubscribe request
-                    
-                    */
-
-                    /* (1) */
-                    struct Send_Header header;
-
-                    return_value = recv(i, &header, sizeof(struct Send_Header), 0);
-                    DIE(return_value < 0, "Error in receiving TCP.");
-
-                    char aux2[BUFLEN];
-                    return_value = recv(i, aux2, header.size, 0);
-
-                    if(return_value == 0) {
-                        struct Subscriber subscriber = database.locations[i];
-                        cout << "Client " << subscriber.ID << " disconnected." << endl;
-
-                        auto user_data_locations = database.locations.find(i);
-                        user_data_locations->second.online = false;
-
-                        auto user_data_online = database.online.find(subscriber.ID);
-                        user_data_online->second.online = false;
-
-                        FD_CLR(i, &read_fds);
-                        FD_CLR(i, &tmp_fds);
-                        close(i);
-                    }
-
-                    if(header.operation == SUBSCRIBE_CODE) {    /* (2) */
-                        add_subscription(&database, i, aux2); 
-                    } else if(header.operation == UNSUBSCRIBE_CODE) { /* (3) */
-                        remove_subscription(&database, i, aux2);
-                    }
+                    client_session(&clients, new_socket_fd_TCP, client_address);
                 }
             }
         }
+
+        /*
+            Hand over once no client is in the middle of a frame: the bytes
+            of a frame already read are only in the coroutine of the client
+            and would be lost, the new server would read the rest of the
+            frame as a new one. A client still sending its frame at the
+            deadline is shut down (its socket is handed over closed and
+            the new server disconnects it). Everything is passed to the new
+            server and the clients are not notified, their connections
+            continue in the new server.
+        */
+        if(handover_channel >= 0 && (loop.partial.empty() || now_ns() >= handover_deadline)) {
+            for(int socket_fd : loop.partial) {
+                shut_down_client(&loop, socket_fd);
+            }
+            if(config.snapshot_path != NULL) {
+                journal_flush(&journal);
+            }
+            flush_batches(&database, UINT64_MAX);
+            drain_output(&loop);
+            handed_over = hand_over(handover_channel, &database, socket_fd_UDP, socket_fd_TCP,
+                                    socket_fd_unix);
+            close(handover_channel);
+            handover_channel = -1;
+            if(handed_over == true) {
+                cout << "Handed over to the new server." << endl;
+                break;
+            }
+            cerr << "Handover failed, the server keeps running." << endl;
+        }
     }
+    /*
+        Save the whole state for the next run. After a handover the state
+        belongs to the new server.
+    */
+    if(config.snapshot_path != NULL && handed_over == false) {
+        settle_sequences(&database);
+        DIE(save_snapshot(&database, config.snapshot_path) == false,
+            "Error in writing the snapshot.");
+    }
+
+    close_capture(&capture);
+
     /*
         Close the sockets.
     */
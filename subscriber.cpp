@@ -12,6 +12,13 @@
 #include "include/constants.h"
 #include "include/command_parser.h"
 #include "include/post.h"
+#include "include/network.h"
+#include "include/shared_ring.h"
+#include "include/compression.h"
+#include <fstream>
+#include <map>
+#include <signal.h>
+#include <getopt.h>
 
 using namespace std;
 
@@ -19,12 +26,340 @@ using namespace std;
 void usage(char *file)
 {
     /*
-        ./subscriber <ID> <SERVER_IP> <SERVER_PORT>
+        ./subscriber [-r STATE_FILE] [-z] [-g] <ID> <SERVER_IP> <SERVER_PORT> [SUBSCRIPTIONS_FILE]
+        ./subscriber [-r STATE_FILE] [-z] [-g] <ID> <tcp://IP:PORT | unix://PATH | shm://PATH> [SUBSCRIPTIONS_FILE]
     */
-	fprintf(stderr, "Usage: %s id_client server_address server_port\n", file);
+	fprintf(stderr, "Usage: %s [-r state_file] [-z] [-g] id_client server_address server_port "
+                    "[subscriptions_file]\n"
+                    "       %s [-r state_file] [-z] [-g] id_client tcp://address:port|unix://path|shm://path "
+                    "[subscriptions_file]\n", file, file);
 	exit(0);
 }
 
+/*
+    Opens the connection with the server at the given address
+        tcp://IP:PORT   - TCP (also the legacy <IP> <PORT> arguments)
+        unix://PATH     - Unix domain socket of a server on the same host
+        shm://PATH      - Unix domain socket for the commands, the server
+                          writes the messages in a shared memory ring
+    and sets <shared_memory> for the last one.
+*/
+int connect_to_server(const char *URL, bool *shared_memory)
+{
+    *shared_memory = false;
+
+    if(strncmp(URL, "unix://", 7) == 0 || strncmp(URL, "shm://", 6) == 0) {
+        *shared_memory = (URL[0] == 's');
+        const char *path = strstr(URL, "://") + 3;
+
+        int socket_fd = connect_unix(path);
+        DIE(socket_fd < 0, "Error in connecting client");
+        return socket_fd;
+    }
+
+    if(strncmp(URL, "tcp://", 6) == 0) {
+        URL += 6;
+    }
+    const char *separator = strrchr(URL, ':');
+    DIE(separator == NULL, "Invalid server address.");
+    string IP(URL, separator - URL);
+
+    /*
+        Open socket for TCP and diable nagle
+    */
+    int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    DIE(socket_fd < 0, "Error in opening client's socket.");
+    int neagle = 1;
+    setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &neagle, sizeof(int));
+
+    /*
+        Obtain the address and the port of the server
+    */
+    struct sockaddr_in server_address;
+    memset((char *) &server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(atoi(separator + 1));
+    int return_value = inet_aton(IP.c_str(), &server_address.sin_addr);
+    DIE(return_value == 0, "Error in inet aton.");
+
+    /*
+        Connect the socket with the server
+    */
+    return_value = connect(socket_fd, (struct sockaddr*) &server_address, sizeof(server_address));
+    DIE(return_value < 0, "Error in connecting client");
+
+    return socket_fd;
+}
+
+/*
+    Topic of a received message: IP:PORT - TOPIC - TYPE - VALUE
+*/
+string message_topic(const char *message)
+{
+    const char *start = strstr(message, " - ");
+    if(start == NULL) {
+        return "";
+    }
+    start += 3;
+    const char *end = strstr(start, " - ");
+    return (end == NULL) ? "" : string(start, end - start);
+}
+
+/*
+    Multicast topics (see multicast.h)
+
+    <server_fd> = TCP connection, for the NAKs
+    <group_fd>  = socket joined to the group (-1 until MULTICAST_SETUP)
+    <topics>    = topics taken from the group (MULTICAST_JOIN) ->
+    |   <early>     posts received after a gap, by sequence, until the
+    |               missing ones are sent again
+    |   <nak_sent>  a NAK is waiting for its answer (one at a time)
+*/
+struct Multicast_Topic {
+    map<uint64_t, string> early;
+    bool nak_sent = false;
+};
+
+struct Multicast_Receiver {
+    int server_fd;
+    int group_fd;
+    unordered_map<string, struct Multicast_Topic> topics;
+};
+
+/*
+    Prints the posts of the topic that follow its last sequence. A gap
+    before the next early post is asked again from the server with a NAK
+    ("<first> <last> <topic>").
+*/
+void deliver_in_order(struct Multicast_Receiver *receiver, const string &topic,
+                      unordered_map<string, uint64_t> &last_sequence)
+{
+    auto state = receiver->topics.find(topic);
+    if(state == receiver->topics.end()) {
+        return;
+    }
+    map<uint64_t, string> &early = state->second.early;
+    uint64_t &last = last_sequence[topic];
+
+    while(!early.empty() && early.begin()->first <= last + 1) {
+        if(early.begin()->first == last + 1) {
+            cout << early.begin()->second << endl;
+            last ++;
+        }
+        early.erase(early.begin());
+    }
+
+    if(!early.empty() && state->second.nak_sent == false) {
+        string nak = to_string(last + 1) + " " + to_string(early.begin()->first - 1) + " " + topic;
+        if(send_frame(receiver->server_fd, NAK_CODE, nak.c_str(), nak.size() + 1) == true) {
+            state->second.nak_sent = true;
+        }
+    }
+}
+
+/*
+    Reads a datagram of the group: a SUBSCRIPTION_SEND frame. The posts of
+    the topics not taken from the group are ignored.
+*/
+void receive_multicast(struct Multicast_Receiver *receiver,
+                       unordered_map<string, uint64_t> &last_sequence)
+{
+    char datagram[sizeof(struct Send_Header) + BUFLEN];
+    ssize_t length = recv(receiver->group_fd, datagram, sizeof(datagram) - 1, 0);
+    if(length < (ssize_t) sizeof(struct Send_Header)) {
+        return;
+    }
+    struct Send_Header header;
+    memcpy(&header, datagram, sizeof(struct Send_Header));
+    if(header.operation != SUBSCRIPTION_SEND || header.size != length - (ssize_t) sizeof(struct Send_Header)) {
+        return;
+    }
+    char *text = datagram + sizeof(struct Send_Header);
+    text[header.size] = '\0';
+
+    string topic = message_topic(text);
+    auto state = receiver->topics.find(topic);
+    if(state == receiver->topics.end() || header.sequence <= last_sequence[topic]) {
+        return;
+    }
+    state->second.early.emplace(header.sequence, string(text));
+    deliver_in_order(receiver, topic, last_sequence);
+}
+
+/*
+    Handles a frame received from the server (on the socket or from the
+    shared memory ring). Returns true if the client has to close:
+    Exit, ID-in-use error; subscription messages are printed, the posts
+    of a batch frame are handled one by one.
+
+    The last sequence of every topic is kept in <last_sequence>: a message
+    already received (e.g. sent again after a reconnect) is skipped and a
+    jump in the sequence is reported as missed messages.
+
+    The multicast frames: MULTICAST_SETUP joins the group, MULTICAST_JOIN /
+    LEAVE start / stop taking a topic from it (from the sequence in the
+    header) and NAK ends the posts sent again for a NAK; the posts the
+    server no longer had are reported as missed.
+
+    A HEARTBEAT is answered at once: a client that stops answering them is
+    taken for dead and closed by the server.
+*/
+bool handle_server_frame(struct Send_Header *header, vector<char> &body,
+                         unordered_map<string, uint64_t> &last_sequence,
+                         struct Multicast_Receiver *receiver)
+{
+    if(header->operation == EXIT_CODE) {
+        return true;
+    } else if(header->operation == ID_IN_USE_CODE) {
+        return true;
+    } else if(header->operation == HEARTBEAT_CODE) {
+        send_frame(receiver->server_fd, HEARTBEAT_CODE, "", 1);
+        return false;
+    } else if(header->operation == BATCH_CODE) {
+        string records;
+        if(open_batch(body.data(), header->size, records) == false) {
+            cerr << "Invalid batch frame!" << endl;
+            return false;
+        }
+
+        const char *cursor = records.data();
+        const char *end = cursor + records.size();
+        struct Send_Header post_header;
+        const char *content;
+        uint32_t size;
+        vector<char> post;
+        post_header.operation = SUBSCRIPTION_SEND;
+        while(next_batch_record(&cursor, end, &post_header.sequence, &content, &size)) {
+            post_header.size = size;
+            post.assign(content, content + size);
+            post.push_back('\0');
+            handle_server_frame(&post_header, post, last_sequence, receiver);
+        }
+        return false;
+    } else if(header->operation == MULTICAST_SETUP_CODE) {
+        struct sockaddr_in group;
+        if(receiver->group_fd < 0 && parse_multicast_group(body.data(), &group) == true) {
+            receiver->group_fd = join_multicast_group(&group);
+        }
+        if(receiver->group_fd < 0) {
+            cerr << "Cannot join the multicast group " << body.data() << "!" << endl;
+        }
+        return false;
+    } else if(header->operation == MULTICAST_JOIN_CODE) {
+        uint64_t &last = last_sequence[body.data()];
+        last = max(last, header->sequence);
+        receiver->topics[body.data()].early.clear();
+        return false;
+    } else if(header->operation == MULTICAST_LEAVE_CODE) {
+        receiver->topics.erase(body.data());
+        return false;
+    } else if(header->operation == NAK_CODE) {
+        auto state = receiver->topics.find(body.data());
+        if(state != receiver->topics.end()) {
+            state->second.nak_sent = false;
+            uint64_t &last = last_sequence[body.data()];
+            if(last < header->sequence) {
+                cerr << "Missed " << header->sequence - last << " messages on topic "
+                     << body.data() << "." << endl;
+                last = header->sequence;
+            }
+            deliver_in_order(receiver, body.data(), last_sequence);
+        }
+        return false;
+    }
+
+    if(header->operation == SUBSCRIPTION_SEND && header->sequence != 0) {
+        uint64_t &last = last_sequence[message_topic(body.data())];
+        if(header->sequence <= last) {
+            return false;
+        }
+        if(last != 0 && header->sequence > last + 1) {
+            cerr << "Missed " << header->sequence - last - 1 << " messages on topic "
+                 << message_topic(body.data()) << "." << endl;
+        }
+        last = header->sequence;
+        cout << body.data() << endl;
+
+        /* A post sent again may fill the gap before the early posts */
+        if(!receiver->topics.empty()) {
+            deliver_in_order(receiver, message_topic(body.data()), last_sequence);
+        }
+        return false;
+    }
+    cout << body.data() << endl;
+    return false;
+}
+
+/*
+    State file of the sequences: one "<topic> <last sequence>" line per topic
+*/
+void load_sequences(const char *path, unordered_map<string, uint64_t> &last_sequence)
+{
+    ifstream file(path);
+    string topic;
+    uint64_t sequence;
+    while(file >> topic >> sequence) {
+        last_sequence[topic] = sequence;
+    }
+}
+
+string format_sequences(unordered_map<string, uint64_t> &last_sequence)
+{
+    ostringstream lines;
+    for(auto &topic : last_sequence) {
+        if(!topic.first.empty() && topic.second != 0) {
+            lines << topic.first << " " << topic.second << "\n";
+        }
+    }
+    return lines.str();
+}
+
+void save_sequences(const char *path, unordered_map<string, uint64_t> &last_sequence)
+{
+    string temporary_path = string(path) + ".tmp";
+    ofstream file(temporary_path, ios::trunc);
+    file << format_sequences(last_sequence);
+    file.close();
+    if(!file || rename(temporary_path.c_str(), path) < 0) {
+        cerr << "Cannot save the sequences in " << path << "!" << endl;
+    }
+}
+
+/*
+    Sends all the commands in the file (one "subscribe <topic> <SF>" or
+    "unsubscribe <topic>" per line) to the server in a single bulk frame,
+    instead of one frame per command.
+*/
+void send_subscriptions_file(int socket_fd, const char *path)
+{
+    ifstream file(path, ios::binary);
+    if(!file) {
+        cerr << "Cannot open subscriptions file " << path << "!" << endl;
+        return;
+    }
+
+    string body((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if(body.size() > MAX_BULK_LEN) {
+        cerr << "Subscriptions file is too large!" << endl;
+        return;
+    }
+
+    int lines = 0;
+    for(char c : body) {
+        if(c == '\n') {
+            lines ++;
+        }
+    }
+    if(!body.empty() && body.back() != '\n') {
+        lines ++;
+    }
+
+    bool return_value = send_frame(socket_fd, BULK_SUBSCRIPTION_CODE, body.data(), body.size());
+    DIE(return_value == false, "Error in sending bulk subscriptions.");
+
+    cout << "Sent " << lines << " subscription commands." << endl;
+}
+
 /*
     Client
     1. Receives commands from STDIN and sends to the server
@@ -40,49 +375,100 @@ void usage(char *file)
 */
 int main(int argc, char *argv[]) {
     setvbuf(stdout, NULL, _IONBF, BUFSIZ);
+    signal(SIGPIPE, SIG_IGN);
     
     int socket_fd, return_value;
-    struct sockaddr_in server_address;
     char buffer[TOTAL_LEN];
-
-    if(argc < 4) {
-        usage(argv[0]);
-    }
+    const char *subscriptions_file = NULL;
+    const char *state_file = NULL;
+    bool shared_memory;
+    bool batch_frames = false;
+    bool multicast = false;
 
     /*
-        Open socket for TCP and diable nagle
+        -r <state_file> : resume from the sequences saved in the file
+        -z              : take the posts of busy topics in compressed
+        |                 batch frames
+        -g              : take the multicast topics of the server from
+        |                 its multicast group
     */
-    socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    DIE(socket_fd < 0, "Error in opening client's socket.");
-    int neagle = 1;
-    setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &neagle, sizeof(int));
+    int option;
+    while((option = getopt(argc, argv, "r:zg")) != -1) {
+        if(option == 'r') {
+            state_file = optarg;
+        } else if(option == 'z') {
+            batch_frames = true;
+        } else if(option == 'g') {
+            multicast = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
 
     /*
-        Obtain the address and the port of the server
+        <ID> and the address of the server follow the options
     */
-    memset((char *) &server_address, 0, sizeof(server_address));
-    server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(atoi(argv[3]));
-    return_value = inet_aton(argv[2], &server_address.sin_addr);
-    DIE(return_value == 0, "Error in inet aton.");
+    char **arguments = argv + optind;
+    int count = argc - optind;
+
+    if(count >= 2 && strstr(arguments[1], "://") != NULL) {
+        socket_fd = connect_to_server(arguments[1], &shared_memory);
+        if(count > 2) {
+            subscriptions_file = arguments[2];
+        }
+    } else {
+        if(count < 3) {
+            usage(argv[0]);
+        }
+        string URL = string(arguments[1]) + ":" + arguments[2];
+        socket_fd = connect_to_server(URL.c_str(), &shared_memory);
+        if(count > 3) {
+            subscriptions_file = arguments[3];
+        }
+    }
+    const char *ID = arguments[0];
 
     /*
-        Connect the socket with the server
+        In order for the server to know the client's ID, we send an initial
+        packet tot the server with the assigned ID. ID_SHM_CODE also asks
+        the server for a shared memory ring.
+
+        With a state file the client resumes: the ID is followed by the last
+        sequence received on each topic and the server only sends what came
+        after.
+
+        ID_HEARTBEAT_FLAG tells the server that the client answers its
+        heartbeats.
     */
-    return_value = connect(socket_fd, (struct sockaddr*) &server_address, sizeof(server_address));
-    DIE(return_value < 0, "Error in connecting client");
+    unordered_map<string, uint64_t> last_sequence;
+    int ID_operation = shared_memory ? ID_SHM_CODE : ID_CODE;
+    if(state_file != NULL) {
+        load_sequences(state_file, last_sequence);
+        ID_operation |= ID_RESUME_FLAG;
+    }
+    if(batch_frames == true) {
+        ID_operation |= ID_BATCH_FLAG;
+    }
+    if(multicast == true) {
+        ID_operation |= ID_MULTICAST_FLAG;
+    }
+    ID_operation |= ID_HEARTBEAT_FLAG;
+
+    return_value = send_frame(socket_fd, ID_operation, ID, strlen(ID) + 1);
+    DIE(return_value == false, "Error in sending name");
+
+    if(state_file != NULL) {
+        string resume = format_sequences(last_sequence);
+        return_value = send_frame(socket_fd, RESUME_CODE, resume.data(), resume.size());
+        DIE(return_value == false, "Error in sending the sequences");
+    }
 
     /*
-        In order for the server to know the client's ID, we send an initial
-        packet tot the server with the assigned ID.
+        Restore the subscriptions in the given file in one frame.
     */
-    struct Send_Header send_ID_header;
-    send_ID_header.operation = ID_CODE;
-    send_ID_header.size = strlen(argv[1]) + 1;
-    return_value = send(socket_fd, &send_ID_header, sizeof(struct Send_Header), 0);
-    DIE(return_value < 0, "Error in sending header");
-    return_value = send(socket_fd, argv[1], send_ID_header.size, 0);
-    DIE(return_value < 0, "Error in sending name");
+    if(subscriptions_file != NULL) {
+        send_subscriptions_file(socket_fd, subscriptions_file);
+    }
 
     /*
         Create set file descriptor for multiplexing and add
@@ -93,17 +479,58 @@ int main(int argc, char *argv[]) {
     FD_ZERO(&tmp_fds);
 	FD_SET(socket_fd, &read_fds);
 	FD_SET(0, &read_fds);
+    int max_fds = socket_fd;
 
+    /*
+        Shared memory ring, set up by the server after the ID
+    */
+    struct Shared_Ring ring;
+    bool ring_attached = false;
+    bool closing = false;
+
+    struct Multicast_Receiver receiver;
+    receiver.server_fd  = socket_fd;
+    receiver.group_fd   = -1;
+
+
+    while(closing == false) {
+        /*
+            Read the frames in the ring before sleeping. The server only
+            signals the eventfd after the client announced that it waits.
+        */
+        if(ring_attached == true) {
+            struct Send_Header header;
+            vector<char> body;
+            while(closing == false && ring_read_frame(&ring, &header, body) == true) {
+                closing = handle_server_frame(&header, body, last_sequence, &receiver);
+            }
+            if(closing == true) {
+                break;
+            }
+            if(ring_prepare_wait(&ring) == false) {
+                continue;
+            }
+        }
 
-    while(1) {
+        if(receiver.group_fd >= 0 && !FD_ISSET(receiver.group_fd, &read_fds)) {
+            FD_SET(receiver.group_fd, &read_fds);
+            max_fds = max(max_fds, receiver.group_fd);
+        }
         tmp_fds = read_fds;
 
         /*
             Multiplexing
         */
-        return_value = select(socket_fd + 1, &tmp_fds, NULL, NULL, NULL);
+        return_value = select(max_fds + 1, &tmp_fds, NULL, NULL, NULL);
         DIE(return_value < 0, "Error in select");
 
+        if(ring_attached == true && FD_ISSET(ring.event_fd, &tmp_fds)) {
+            ring_finish_wait(&ring);
+        }
+        if(receiver.group_fd >= 0 && FD_ISSET(receiver.group_fd, &tmp_fds)) {
+            receive_multicast(&receiver, last_sequence);
+        }
+
         /*
             STDIN commands
         */
@@ -114,6 +541,25 @@ int main(int argc, char *argv[]) {
             fgets(buffer, BUFLEN - 1, stdin);
             if(strcmp(buffer, EXIT_REQUEST) == 0) {
                 break;
+            } else if(strncmp(buffer, BULK_REQUEST, strlen(BULK_REQUEST)) == 0) {
+                /*
+                    subscribe_file <path> - send the commands in the file
+                    in a single bulk frame
+                */
+                char aux[BUFLEN];
+                aux[0] = '\0';
+                strcpy(aux, buffer);
+
+                char path[BUFLEN];
+                path[0] = '\0';
+                if(check_command_format(aux, 2) == true) {
+                    strcpy(aux, buffer);
+                    obtain_nth_argument(aux, 2, path);
+                    send_subscriptions_file(socket_fd, path);
+                } else {
+                    cerr << "Invalid subscribe_file command!" << endl;
+                }
+                continue;
             } else if(strncmp(buffer, SUBSCRIBE_REQUEST, strlen(SUBSCRIBE_REQUEST)) == 0) {
                 /*
                     Received a subscribe request from stdin and send a packet to
@@ -129,6 +575,7 @@ int main(int argc, char *argv[]) {
                 struct Send_Header header;
                 header.operation = SUBSCRIBE_CODE;
                 header.size = strlen(buffer) + 1;
+                header.sequence = 0;
 
                 /*
                     If the command is valid, then send the composed Header and
@@ -160,6 +607,7 @@ int main(int argc, char *argv[]) {
                 struct Send_Header header;
                 header.operation = UNSUBSCRIBE_CODE;
                 header.size = strlen(buffer) + 1;
+                header.sequence = 0;
 
                 /*
                     If the command is a valid one, then send the received message
@@ -172,6 +620,15 @@ int main(int argc, char *argv[]) {
                     return_value = send(socket_fd, buffer, header.size, 0);
                     DIE(return_value < 0, "Error in sending packet.");
 
+                    /*
+                        A later subscription starts a new range of sequences
+                    */
+                    strcpy(aux, buffer);
+                    char topic[BUFLEN];
+                    topic[0] = '\0';
+                    obtain_nth_argument(aux, 2, topic);
+                    last_sequence.erase(topic);
+
                     cout << "Unsubscribed from topic." << endl;
                 } else {
                     cerr << "Invalid Unsubscribe command!" << endl;
@@ -186,26 +643,35 @@ int main(int argc, char *argv[]) {
                 Obtain the Header and then the message
             */
             struct Send_Header header;
-            return_value = recv(socket_fd, &header, sizeof(struct Send_Header), 0);
+            vector<char> body;
+            if(recv_frame(socket_fd, &header, body, MAX_BULK_LEN) == false) {
+                break;
+            }
 
-            char command[BUFLEN];
-            command[0] = '\0';
-            return_value = recv(socket_fd, command, header.size, 0);
+            /*
+                The server created the shared memory ring, the messages
+                follow in the ring.
+            */
+            if(header.operation == SHM_SETUP_CODE) {
+                int fds[2];
+                if(recv_fds(socket_fd, fds, 2) == true && attach_ring(&ring, fds[0], fds[1]) == true) {
+                    ring_attached = true;
+                    FD_SET(ring.event_fd, &read_fds);
+                    max_fds = max(max_fds, ring.event_fd);
+                }
+                continue;
+            }
 
             /*
                 Break into the cases: Exit, ID-in-use error and subscription
                 message.
             */
-            if(header.operation == EXIT_CODE) {
-                break;
-            } else if(header.operation == ID_IN_USE_CODE) {
-                break;
-            } else {
-                cout << command << endl;
-                continue;
-            }
+            closing = handle_server_frame(&header, body, last_sequence, &receiver);
         }
     }
+    if(state_file != NULL) {
+        save_sequences(state_file, last_sequence);
+    }
     close(socket_fd);
     return 0;
 
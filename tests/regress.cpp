@@ -0,0 +1,637 @@
+/**
+ * @file regress.cpp
+ * @author Dumitrescu Alexandra 323CA
+ * @brief Regression tests of the server components, run without sockets
+ *        on a Database in memory (make test).
+ * @version 0.1
+ * @date 2022-05-07
+ *
+ * @copyright Copyright (c) Dumitrescu Alexandra 2022
+ *
+ */
+
+#include "../include/helpers.h"
+#include "../include/constants.h"
+#include "../include/database.h"
+#include "../include/snapshot.h"
+#include "../include/stored_post.h"
+#include "../include/admission.h"
+#include "../include/retention.h"
+#include "../include/topic_kernels.h"
+#include "../include/subscriber.h"
+#include "../include/compression.h"
+#include "../include/timer_wheel.h"
+#include "../include/event_loop.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <set>
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool condition, const char *test, const char *what) {
+    if(condition == false) {
+        cerr << "FAIL " << test << ": " << what << endl;
+        failures ++;
+    }
+}
+
+static string read_file(const string &path) {
+    ifstream file(path, ios::binary);
+    stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static void write_file(const string &path, const string &content) {
+    ofstream file(path, ios::binary | ios::trunc);
+    file << content;
+}
+
+/**
+ * @brief Offline client with SF on <topic>.
+ */
+static struct Subscriber* offline_client(struct Database* database, const char *ID,
+                                         const char *topic) {
+    struct Subscriber &user = (*database).online[ID];
+    strcpy(user.ID, ID);
+    user.socket_fd  = -1;
+    user.online     = false;
+    journal_client((*database).journal, ID);
+    subscribe_topic(database, &user, topic, true);
+    return &user;
+}
+
+/**
+ * @brief Queues an INT post of <topic> for the offline client.
+ */
+static void queue_int(struct Database* database, struct Subscriber* user,
+                      const char *topic, uint32_t value) {
+    struct Subscription_Post post;
+    memset(&post, 0, sizeof(struct Subscription_Post));
+    strcpy(post.topic, topic);
+    post.data_type = 0;
+    value = htonl(value);
+    memcpy(post.content + 1, &value, sizeof(uint32_t));
+
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(struct sockaddr_in));
+    source.sin_family = AF_INET;
+
+    struct Stored_Post stored;
+    store_post(&stored, intern_topic(database, topic), &post, source,
+               ++(*database).topic_logs[topic].sequence, 0, time(NULL));
+    enqueue_post(database, user, &stored);
+}
+
+/*
+    The server dies after the snapshot is renamed in place and before the
+    journal is emptied: the old journal must not be applied again.
+*/
+static void test_snapshot_crash(const string &directory) {
+    const char *name = "snapshot_crash";
+    string path = directory + "/snap";
+
+    struct Database database;
+    struct Journal journal;
+    check(load_snapshot(&database, &journal, path.c_str()), name, "empty state");
+    struct Subscriber *user = offline_client(&database, "A", "t");
+    for(uint32_t i = 1; i <= 3; i++) {
+        queue_int(&database, user, "t", i);
+    }
+    check(journal_flush(&journal), name, "journal flush");
+
+    string stale = read_file(path + ".journal");
+    check(save_snapshot(&database, path.c_str()), name, "snapshot");
+    write_file(path + ".journal", stale);
+    close(journal.fd);
+
+    struct Database restored;
+    struct Journal restored_journal;
+    check(load_snapshot(&restored, &restored_journal, path.c_str()), name, "load");
+    check(restored.online["A"].SF_queue.size() == 3, name,
+          "the posts of the old journal were queued twice");
+
+    /* The journal of the new epoch is still replayed */
+    queue_int(&restored, &restored.online["A"], "t", 4);
+    check(journal_flush(&restored_journal), name, "journal flush");
+    close(restored_journal.fd);
+
+    struct Database reloaded;
+    struct Journal reloaded_journal;
+    check(load_snapshot(&reloaded, &reloaded_journal, path.c_str()), name, "reload");
+    check(reloaded.online["A"].SF_queue.size() == 4, name, "the new journal was not replayed");
+    close(reloaded_journal.fd);
+}
+
+/*
+    A STRING of CONTENT_LEN bytes without a NUL: the live text and the
+    text made again from the SF queue must be the same and end inside
+    the post.
+*/
+static void test_full_string() {
+    const char *name = "full_string";
+    struct {
+        struct Subscription_Post post;
+        char after[64];
+    } datagram;
+    memset(&datagram, 'x', sizeof(datagram));
+    struct Subscription_Post &post = datagram.post;
+    memset(&post, 0, sizeof(struct Subscription_Post));
+    strcpy(post.topic, "t");
+    post.data_type = 3;
+    memset(post.content, 'a', CONTENT_LEN);
+
+    check(valid_datagram(&post, sizeof(struct Subscription_Post)), name, "rejected");
+    check(strnlen(post.content, CONTENT_LEN) == CONTENT_LEN - 1, name, "not terminated");
+
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(struct sockaddr_in));
+    source.sin_family = AF_INET;
+    source.sin_port   = htons(4242);
+
+    struct Database database;
+    struct Stored_Post stored;
+    store_post(&stored, intern_topic(&database, "t"), &post, source, 1, 0, time(NULL));
+
+    struct Send_Post live, queued;
+    format_post(&post, source, &live);
+    format_stored_post(&stored, &queued);
+    check(strcmp(live.content, queued.content) == 0, name, "live and SF texts differ");
+}
+
+/*
+    Once the table is full of active sources, the new sources share the
+    overflow bucket without rebuilding the table for each of them.
+*/
+static void test_admission_flood() {
+    const char *name = "admission_flood";
+    struct Admission admission;
+    init_admission(&admission, 1000, 1000);
+
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(struct sockaddr_in));
+    source.sin_family = AF_INET;
+    uint32_t address = 0x0a000000;
+    while(admission.overflow.accepted == 0) {
+        source.sin_addr.s_addr = htonl(address ++);
+        admit_datagram(&admission, &source);
+    }
+
+    const struct Source_Bucket *table = admission.buckets.data();
+    size_t sources = admission.used;
+    for(int i = 0; i < 1000; i++) {
+        source.sin_addr.s_addr = htonl(address ++);
+        admit_datagram(&admission, &source);
+    }
+    check(admission.buckets.data() == table && admission.used == sources, name,
+          "the table was aged again for new sources");
+    check(admission.overflow.accepted + admission.overflow.dropped == 1001, name,
+          "the new sources did not use the overflow bucket");
+}
+
+/*
+    A post of a topic without limits at the front of the SF queue and a
+    long run of a topic limited to a few posts behind it: the posts
+    evicted behind the front one must not stay in the queue.
+*/
+static void test_retention_tombstones() {
+    const char *name = "retention_tombstones";
+    struct Retention retention;
+    struct Retention_Policy policy = {0, 4, 0};
+    set_retention_policy(&retention, "limited", &policy);
+
+    struct Database database;
+    database.retention = &retention;
+    struct Subscriber *user = offline_client(&database, "A", "free");
+    subscribe_topic(&database, user, "limited", true);
+
+    queue_int(&database, user, "free", 0);
+    size_t longest = 0;
+    for(uint32_t i = 1; i <= 10000; i++) {
+        queue_int(&database, user, "limited", i);
+        longest = max(longest, user->SF_queue.size());
+    }
+    check(longest <= 2 * (1 + policy.max_count) + 1, name,
+          "the evicted posts piled up behind the front post");
+    check(retention.topics["limited"].over_count == 10000 - policy.max_count, name,
+          "wrong evictions");
+
+    /* The posts kept are the front one and the last ones of the run */
+    vector<uint32_t> kept;
+    for(auto &post : user->SF_queue) {
+        if(post.operation == EVICTED_POST) {
+            continue;
+        }
+        uint32_t value;
+        memcpy(&value, post.value.data() + 1, sizeof(uint32_t));
+        kept.push_back(ntohl(value));
+    }
+    check(kept == vector<uint32_t>({0, 9997, 9998, 9999, 10000}), name, "wrong posts kept");
+
+    /* The numbers of the topic queue still find its posts */
+    struct SF_Topic &queued = user->SF_topics["limited"];
+    bool found = queued.posts.size() == policy.max_count;
+    for(uint64_t number : queued.posts) {
+        const struct Stored_Post &post = user->SF_queue[number - user->SF_first];
+        found = found && post.operation != EVICTED_POST && *post.topic == "limited";
+    }
+    check(found, name, "the topic queue lost its posts");
+}
+
+/*
+    Every kernel level gives the results of the scalar kernels, for the
+    topics of 0 to TOPIC_LEN bytes (TOPIC_LEN: no NUL) and the IDs. The
+    texts end at a page that cannot be read, so a kernel reading past
+    its field crashes the test.
+*/
+static void test_kernel_levels() {
+    const char *name = "kernel_levels";
+    long page = sysconf(_SC_PAGESIZE);
+    char *pages = (char *) mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    DIE(pages == MAP_FAILED, "mmap");
+    DIE(mprotect(pages + page, page, PROT_NONE) < 0, "mprotect");
+    char *topic = pages + page - TOPIC_LEN;
+    char *ID = pages + page - ID_MAX_LEN;
+
+    select_kernels(KERNELS_SCALAR);
+    struct Topic_Kernels scalar = kernels;
+    int best = best_kernel_level();
+    srand(7);
+
+    for(int level = KERNELS_SCALAR + 1; level <= best; level++) {
+        select_kernels(level);
+        struct Topic_Kernels tested = kernels;
+        for(int length = 0; length <= TOPIC_LEN; length++) {
+            for(int i = 0; i < TOPIC_LEN; i++) {
+                topic[i] = (i < length) ? 'a' + rand() % 26 : (i == length ? '\0' : 'x');
+            }
+            check(tested.length(topic, TOPIC_LEN) == scalar.length(topic, TOPIC_LEN), name,
+                  "length differs");
+
+            char expected[TOPIC_BLOCK_LEN], block[TOPIC_BLOCK_LEN];
+            uint64_t expected_hash, hash;
+            int expected_length = scalar.key(topic, TOPIC_LEN, expected, &expected_hash);
+            check(tested.key(topic, TOPIC_LEN, block, &hash) == expected_length &&
+                  memcmp(block, expected, TOPIC_BLOCK_LEN) == 0 && hash == expected_hash,
+                  name, "key differs");
+            for(int blocks = KERNEL_BLOCK_LEN; blocks <= TOPIC_BLOCK_LEN; blocks += KERNEL_BLOCK_LEN) {
+                check(tested.hash(expected, blocks) == scalar.hash(expected, blocks), name,
+                      "hash differs");
+            }
+
+            /* The key of the post and of the topic stored as a string */
+            struct Topic_Key key;
+            make_topic_key(topic, &key);
+            check(key.hash == Topic_Hash()(string(topic, key.length)), name,
+                  "the key of a post does not find its topic");
+
+            for(int i = 0; i < length; i++) {
+                memcpy(block, topic, length);
+                block[i] ^= 1;
+                check(tested.equal(topic, block, length) == false &&
+                      tested.equal(topic, topic, length), name, "equal differs");
+            }
+        }
+
+        for(int length = 0; length < ID_MAX_LEN; length++) {
+            memset(ID, 0, ID_MAX_LEN);
+            for(int i = 0; i < length; i++) {
+                ID[i] = '0' + rand() % 75;
+            }
+            check(tested.hash(ID, ID_MAX_LEN) == scalar.hash(ID, ID_MAX_LEN), name,
+                  "hash of an ID differs");
+            char other[ID_MAX_LEN];
+            memcpy(other, ID, ID_MAX_LEN);
+            other[ID_MAX_LEN - 1] = 1;
+            check(tested.equal(ID, ID, ID_MAX_LEN) && !tested.equal(ID, other, ID_MAX_LEN),
+                  name, "equal of an ID differs");
+        }
+    }
+
+    select_kernels(best);
+    munmap(pages, 2 * page);
+}
+
+/*
+    Raw records of <size> bytes: random posts (few matches) or the same
+    few posts again and again
+*/
+static string batch_records(size_t size, bool repetitive) {
+    string records;
+    uint64_t sequence = 0;
+    while(records.size() < size) {
+        char content[64];
+        int length;
+        if(repetitive) {
+            length = sprintf(content, "1.2.3.4:5 - t%d - INT - 42", (int) (sequence % 3));
+        } else {
+            length = 1 + rand() % (int) sizeof(content);
+            for(int i = 0; i < length; i++) {
+                content[i] = rand();
+            }
+        }
+        append_batch_record(records, ++sequence, content, length);
+    }
+    records.resize(size);
+    return records;
+}
+
+/*
+    The batch codec gives back the records it compressed, and rejects
+    the cut or corrupted blocks without going past their raw length.
+*/
+static void test_batch_codec() {
+    const char *name = "batch_codec";
+    srand(11);
+    for(size_t size = 0; size <= BATCH_RAW_LEN; size = size * 2 + 1) {
+        for(bool repetitive : {false, true}) {
+            string records = batch_records(min(size, (size_t) BATCH_RAW_LEN), repetitive);
+            string body, opened;
+            build_batch(records, body);
+            check(open_batch(body.data(), body.size(), opened) && opened == records, name,
+                  "round trip differs");
+        }
+    }
+
+    string records = batch_records(BATCH_RAW_LEN, true);
+    string body, opened;
+    build_batch(records, body);
+    check(body.size() < records.size() / 4, name, "repetitive records not compressed");
+
+    /* Cut blocks */
+    for(size_t size = 0; size < body.size(); size += 1 + size / 8) {
+        check(open_batch(body.data(), size, opened) == false, name, "cut block accepted");
+    }
+
+    /* Wrong raw length */
+    for(int64_t delta : {-1, 1}) {
+        string wrong = body;
+        uint32_t raw_length = records.size() + delta;
+        memcpy(&wrong[0], &raw_length, sizeof(uint32_t));
+        check(open_batch(wrong.data(), wrong.size(), opened) == false, name,
+              "wrong raw length accepted");
+    }
+    string huge = body;
+    uint32_t raw_length = MAX_BATCH_RAW_LEN + 1;
+    memcpy(&huge[0], &raw_length, sizeof(uint32_t));
+    check(open_batch(huge.data(), huge.size(), opened) == false, name, "huge raw length accepted");
+
+    /* Offset before the output, zero offset, lengths past the block or the output */
+    const char offset_past[] = {0x10, 'a', 0x05, 0x00};
+    const char offset_zero[] = {0x10, 'a', 0x00, 0x00};
+    const char literals_past[] = {(char) 0xf0, 0x20, 'a', 'b'};
+    const char match_past[] = {0x1f, 'a', 0x01, 0x00, (char) 0xff, (char) 0xff, 0x10};
+    check(decompress_block(offset_past, sizeof(offset_past), opened, 100) == false, name,
+          "offset past the output accepted");
+    check(decompress_block(offset_zero, sizeof(offset_zero), opened, 100) == false, name,
+          "zero offset accepted");
+    check(decompress_block(literals_past, sizeof(literals_past), opened, 100) == false, name,
+          "literals past the block accepted");
+    check(decompress_block(match_past, sizeof(match_past), opened, 100) == false &&
+          opened.size() <= 100, name, "match past the raw length accepted");
+
+    /* Corrupted bytes: rejected, or decoded to exactly the raw length */
+    for(int i = 0; i < 2000; i++) {
+        string corrupted = body;
+        size_t position = sizeof(uint32_t) + rand() % (corrupted.size() - sizeof(uint32_t));
+        corrupted[position] ^= 1 + rand() % 255;
+        bool opened_ok = open_batch(corrupted.data(), corrupted.size(), opened);
+        check(opened.size() <= records.size() && (!opened_ok || opened.size() == records.size()),
+              name, "corrupted block went past its raw length");
+    }
+}
+
+/*
+    Sleeping until next_timer_tick each time never passes a timer and
+    wakes the owner a few times per timer, not once per tick.
+*/
+static void test_timer_wheel_sleep() {
+    const char *name = "timer_wheel_sleep";
+    struct Timer_Wheel wheel;
+    init_timer_wheel(&wheel, 1000);
+    srand(13);
+
+    multiset<uint64_t> pending;
+    for(uint64_t id = 0; id < 500; id++) {
+        uint64_t expiry = 1001 + rand() % (id < 250 ? 100 : 1000000);
+        add_timer(&wheel, expiry, id, "");
+        pending.insert(expiry);
+    }
+
+    int wakeups = 0;
+    vector<struct Timer> expired;
+    while(!pending.empty()) {
+        uint64_t tick = next_timer_tick(&wheel);
+        if(tick == 0 || tick > *pending.begin() || ++ wakeups > 500 * WHEEL_LEVELS) {
+            check(false, name, "slept past a timer");
+            return;
+        }
+        expired.clear();
+        advance_timers(&wheel, tick, expired);
+        for(auto &timer : expired) {
+            check(timer.expiry == tick, name, "timer fired at another tick");
+            pending.erase(pending.find(timer.expiry));
+        }
+    }
+    check(next_timer_tick(&wheel) == 0, name, "empty wheel has a next tick");
+}
+
+/*
+    The frames held for write coalescing count the time they were held
+    in the delays of their class.
+*/
+static void test_held_delays() {
+    const char *name = "held_delays";
+    int sockets[2];
+    DIE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0, "socketpair");
+
+    struct Event_Loop loop;
+    loop.coalesce_ns = 1000000;
+    for(int i = 0; i < 3; i++) {
+        queue_frame(&loop, sockets[0], SUBSCRIPTION_SEND, "post", 5, i + 1, PRIORITY_HIGH);
+    }
+    check(loop.delays[PRIORITY_HIGH].count == 0, name, "held frames counted before they left");
+    usleep(2000);
+    flush_held(&loop, now_ns());
+
+    check(loop.held.empty() && loop.output[sockets[0]].empty(), name, "held output not sent");
+    check(loop.delays[PRIORITY_HIGH].count == 3 && loop.delays[PRIORITY_HIGH].max >= 2000000,
+          name, "the time the frames were held is missing");
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+/*
+    A traced post is recorded when the socket accepts its frame, not when
+    the frame is queued behind the output of a slow client.
+*/
+static void test_egress_latency() {
+    const char *name = "egress_latency";
+    int sockets[2];
+    DIE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0, "socketpair");
+    int buffer_size = 4096;
+    setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(int));
+    fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+
+    struct Latency_Tracer tracer;
+    init_tracer(&tracer, 1);
+    struct Event_Loop loop;
+    loop.tracer = &tracer;
+    static const string topic = "t";
+    struct Egress_Mark mark = {now_ns(), &topic, &tracer.replay, TRACE_REPLAY, 0};
+
+    string body(1000, 'x');
+    const int frames = 200;
+    for(int i = 0; i < frames; i++) {
+        queue_frame(&loop, sockets[0], SUBSCRIPTION_SEND, body.data(), body.size(), i + 1,
+                    PRIORITY_NORMAL, &mark, 1);
+    }
+    check(tracer.replay.count < frames, name, "queued frames recorded as sent");
+
+    /* The client reads, the loop sends the rest */
+    char input[1 << 16];
+    for(int round = 0; round < 10000 && tracer.replay.count < frames; round++) {
+        while(recv(sockets[1], input, sizeof(input), 0) > 0) {
+        }
+        schedule_output(&loop);
+        fd_set read_fds, write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(sockets[0], &write_fds);
+        resume_ready(&loop, &read_fds, &write_fds);
+    }
+    check(tracer.replay.count == frames && loop.egress.empty(), name,
+          "the sent frames were not all recorded");
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+/*
+    A subscriber that does not read its shared memory ring never blocks the
+    loop: the frames that do not fit wait in the queues and are written,
+    in order, as the subscriber frees space.
+*/
+static void test_full_ring() {
+    const char *name = "full_ring";
+    int sockets[2];
+    DIE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0, "socketpair");
+    struct Shared_Ring ring;
+    DIE(create_ring(&ring, 4096) == false, "create_ring");
+
+    struct Event_Loop loop;
+    loop.rings[sockets[0]] = &ring;
+    string body(1000, 'x');
+    const int frames = 20;
+    uint64_t start = now_ns();
+    for(int i = 0; i < frames; i++) {
+        check(queue_frame(&loop, sockets[0], SUBSCRIPTION_SEND, body.data(), body.size(), i + 1),
+              name, "frame refused while the ring is full");
+    }
+    check(now_ns() - start < RING_WAIT_NS, name, "the loop waited for the subscriber");
+    check(rings_backlogged(&loop) && loop.output[sockets[0]].empty(), name,
+          "the frames that do not fit are not queued");
+
+    struct Send_Header header;
+    vector<char> received;
+    uint64_t expected = 1;
+    for(int round = 0; round < 1000 && expected <= frames; round++) {
+        while(ring_read_frame(&ring, &header, received)) {
+            check(header.sequence == expected && header.size == (int) body.size(), name,
+                  "frames out of order");
+            expected ++;
+        }
+        schedule_output(&loop);
+    }
+    check(expected == frames + 1 && !rings_backlogged(&loop), name,
+          "the queued frames were not all written");
+
+    forget_socket(&loop, sockets[0]);
+    destroy_ring(&ring);
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+/*
+    Reads one frame, as the coroutine of a client does
+*/
+static Task read_one_frame(struct Event_Loop* loop, int socket_fd, bool *done) {
+    struct Send_Header header;
+    vector<char> body;
+    *done = co_await async_recv_frame(loop, socket_fd, &header, body, MAX_BULK_LEN);
+}
+
+/*
+    A handover waits while a coroutine holds part of a frame: the socket is
+    in <partial> from the first byte of the header to the last byte of the
+    body, also when the client stops in the middle of either of them.
+*/
+static void test_partial_frames() {
+    const char *name = "partial_frames";
+    int sockets[2];
+    DIE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0, "socketpair");
+    struct Event_Loop loop;
+
+    string body(4096, 'x');
+    struct Send_Header header = {(int) body.size(), SUBSCRIBE_CODE, 0};
+    string frame((const char *) &header, sizeof(struct Send_Header));
+    frame += body;
+    size_t cuts[] = {sizeof(struct Send_Header) / 2, sizeof(struct Send_Header),
+                     sizeof(struct Send_Header) + 100};
+
+    for(size_t cut : cuts) {
+        bool done = false;
+        read_one_frame(&loop, sockets[0], &done);
+        check(loop.partial.empty(), name, "waiting for a frame counted as partial");
+
+        DIE(send(sockets[1], frame.data(), cut, 0) != (ssize_t) cut, "send");
+        fd_set read_fds, write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(sockets[0], &read_fds);
+        resume_ready(&loop, &read_fds, &write_fds);
+        check(!done && loop.partial.count(sockets[0]) == 1, name,
+              "a half received frame allows the handover");
+
+        DIE(send(sockets[1], frame.data() + cut, frame.size() - cut, 0) !=
+            (ssize_t) (frame.size() - cut), "send");
+        FD_SET(sockets[0], &read_fds);
+        resume_ready(&loop, &read_fds, &write_fds);
+        check(done && loop.partial.empty(), name, "the frame stays partial once received");
+    }
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+int main() {
+    /* The messages of the server are printed on cout */
+    streambuf *console = cout.rdbuf();
+    ofstream null_stream("/dev/null");
+    cout.rdbuf(null_stream.rdbuf());
+
+    char directory[] = "/tmp/regressXXXXXX";
+    DIE(mkdtemp(directory) == NULL, "mkdtemp");
+
+    test_snapshot_crash(directory);
+    test_full_string();
+    test_admission_flood();
+    test_retention_tombstones();
+    test_kernel_levels();
+    test_batch_codec();
+    test_timer_wheel_sleep();
+    test_held_delays();
+    test_egress_latency();
+    test_full_ring();
+    test_partial_frames();
+
+    cout.rdbuf(console);
+    string remove = string("rm -rf ") + directory;
+    DIE(system(remove.c_str()) != 0, "rm");
+
+    cerr << (failures == 0 ? "all tests passed" : "tests failed") << endl;
+    return failures == 0 ? 0 : 1;
+}